@@ -0,0 +1,551 @@
+// Benchmark driver: runs each workload through the compiler binary a number
+// of times after warmup runs, and reports wall-time percentiles and peak
+// memory, plus the bytecode instructions the workload executes (counted
+// once through --stats-json, so it does not depend on the machine).
+// Results are printed as a table and written to a JSON file.
+//
+// With --baseline FILE the results are also compared against an earlier
+// JSON file, and the exit status is 1 if any benchmark regressed.
+//
+// Usage: ccb-bench [--compiler PATH] [--runs N] [--warmup N] [--out FILE]
+//                  [--baseline FILE] [--threshold PCT] [--insn-threshold PCT] [NAME...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define MAX_RUNS 1000
+#define IO_VALUES 300000
+#define FRONTEND_LINES 100000
+#define BOOTSTRAP_ROUNDS 2000
+#define MAX_BENCHMARKS 16
+
+typedef struct {
+  const char* name;
+  const char* description;
+  const char* program;   // NULL: generated into the work directory
+  const char* input;     // NULL: /dev/null
+  const char* flag;      // extra compiler flag, or NULL
+  const char* flag_arg;
+} Benchmark;
+
+typedef struct {
+  double ms[MAX_RUNS];
+  int runs;
+  long max_rss_kb;
+  long long instructions;
+  int failed;
+} Samples;
+
+typedef struct {
+  char name[64];
+  Samples samples;
+} BaselineEntry;
+
+static char work_dir[] = "/tmp/ccb-bench-XXXXXX";
+static char io_input[256];
+static char frontend_program[256];
+static char stats_path[256];
+
+static Benchmark benchmarks[] = {
+  {"loop", "tight while loop (fibonacci mod 1e6)", "bench/dispatch_loop.ccb", NULL, NULL, NULL},
+  {"recursion", "deep recursion (factorial of 60, repeated)", "bench/recursion.ccb", NULL, NULL, NULL},
+  {"calls", "call-heavy namespaced functions", "bench/calls.ccb", NULL, NULL, NULL},
+  {"io", "in/out of 300000 values", "bench/io.ccb", io_input, NULL, NULL},
+  {"frontend", "lex, parse and compile a 100000-line program", frontend_program, NULL,
+   "--emit-bytecode", "/dev/null"},
+};
+
+#define BENCHMARK_COUNT ((int)(sizeof(benchmarks) / sizeof(benchmarks[0])))
+
+static double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static int WriteIoInput(const char* path) {
+  FILE* out = fopen(path, "w");
+  if (out == NULL) {
+    return 0;
+  }
+  fprintf(out, "%d\n", IO_VALUES);
+  unsigned seed = 12345;
+  for (int i = 0; i < IO_VALUES; i++) {
+    seed = seed * 1103515245u + 12345u;
+    fprintf(out, "%u%c", (seed >> 8) % 100000, i % 16 == 15 ? '\n' : ' ');
+  }
+  return fclose(out) == 0;
+}
+
+// Straight-line arithmetic over a handful of globals, with namespaced
+// functions sprinkled in; it stays within 256 names and 256 constants.
+static int WriteFrontendProgram(const char* path) {
+  FILE* out = fopen(path, "w");
+  if (out == NULL) {
+    return 0;
+  }
+  int lines = 0;
+  fprintf(out, "let a = 1;\nlet b = 2;\nlet c = 3;\n");
+  lines += 3;
+  for (int f = 0; f < 100; f++) {
+    fprintf(out, "ns gen%d {\n  fn f(x, y) -> int {\n    let t = x * %d + y;\n    return t - t / 7 * 7;\n  }\n}\n",
+            f, f + 1);
+    lines += 6;
+  }
+  for (int i = 0; lines < FRONTEND_LINES; i++, lines++) {
+    switch (i % 4) {
+      case 0: fprintf(out, "a = a + %d * b - c / %d;\n", i % 100, i % 9 + 1); break;
+      case 1: fprintf(out, "b = a - %d * c + %d;\n", i % 77, i % 13); break;
+      case 2: fprintf(out, "c = gen%d.f(a, b) + %d;\n", i % 100, i % 31); break;
+      default: fprintf(out, "if (a > b) { a = a - b; } else { b = b - a; }\n"); break;
+    }
+  }
+  fprintf(out, "out a + b + c;\n");
+  return fclose(out) == 0;
+}
+
+static int Prepare() {
+  if (mkdtemp(work_dir) == NULL) {
+    perror("mkdtemp");
+    return 0;
+  }
+  snprintf(io_input, sizeof(io_input), "%s/io.txt", work_dir);
+  snprintf(frontend_program, sizeof(frontend_program), "%s/frontend.ccb", work_dir);
+  snprintf(stats_path, sizeof(stats_path), "%s/stats.json", work_dir);
+  if (!WriteIoInput(io_input) || !WriteFrontendProgram(frontend_program)) {
+    fprintf(stderr, "Could not write benchmark inputs to %s.\n", work_dir);
+    return 0;
+  }
+  return 1;
+}
+
+static void Cleanup() {
+  unlink(io_input);
+  unlink(frontend_program);
+  unlink(stats_path);
+  rmdir(work_dir);
+}
+
+// Runs argv with stdin from input and stdout discarded; returns wall time
+// in ms or a negative value if the run failed.
+static double Spawn(char* const argv[], const char* input, long* max_rss_kb) {
+  double start = Now();
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return -1;
+  }
+  if (pid == 0) {
+    int in = open(input != NULL ? input : "/dev/null", O_RDONLY);
+    int out = open("/dev/null", O_WRONLY);
+    if (in < 0 || out < 0) {
+      _exit(127);
+    }
+    dup2(in, STDIN_FILENO);
+    dup2(out, STDOUT_FILENO);
+    execv(argv[0], argv);
+    _exit(127);
+  }
+
+  int status;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) < 0) {
+    perror("wait4");
+    return -1;
+  }
+  double elapsed = Now() - start;
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    return -1;
+  }
+  if (usage.ru_maxrss > *max_rss_kb) {
+    *max_rss_kb = usage.ru_maxrss;
+  }
+  return elapsed;
+}
+
+static double RunOnce(const char* compiler, const Benchmark* b, long* max_rss_kb) {
+  char* argv[5];
+  int argc = 0;
+  argv[argc++] = (char*)compiler;
+  if (b->flag != NULL) {
+    argv[argc++] = (char*)b->flag;
+    argv[argc++] = (char*)b->flag_arg;
+  }
+  argv[argc++] = (char*)b->program;
+  argv[argc] = NULL;
+  return Spawn(argv, b->input, max_rss_kb);
+}
+
+static char* ReadText(const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    return NULL;
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  rewind(file);
+  char* text = (char*)malloc((size_t)size + 1);
+  size_t read = fread(text, 1, (size_t)size, file);
+  text[read] = '\0';
+  fclose(file);
+  return text;
+}
+
+// Executed instructions of one run on the stack VM, from --stats-json;
+// -1 if the count is unavailable.
+static long long CountInstructions(const char* compiler, const Benchmark* b) {
+  char* argv[] = {(char*)compiler, "--stats-json", stats_path, (char*)b->program, NULL};
+  long rss = 0;
+  if (Spawn(argv, b->input, &rss) < 0) {
+    return -1;
+  }
+  char* text = ReadText(stats_path);
+  if (text == NULL) {
+    return -1;
+  }
+  const char* at = strstr(text, "\"instructions_executed\":");
+  long long count = at != NULL ? atoll(at + strlen("\"instructions_executed\":")) : -1;
+  free(text);
+  return count;
+}
+
+static int CompareDouble(const void* a, const void* b) {
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted samples.
+static double Percentile(const double* sorted, int n, double p) {
+  int rank = (int)ceil(p / 100.0 * n);
+  if (rank < 1) {
+    rank = 1;
+  }
+  return sorted[rank - 1];
+}
+
+static double Mean(const double* samples, int n) {
+  double sum = 0;
+  for (int i = 0; i < n; i++) {
+    sum += samples[i];
+  }
+  return sum / n;
+}
+
+static double StdDev(const double* samples, int n) {
+  if (n < 2) {
+    return 0;
+  }
+  double mean = Mean(samples, n);
+  double sum = 0;
+  for (int i = 0; i < n; i++) {
+    sum += (samples[i] - mean) * (samples[i] - mean);
+  }
+  return sqrt(sum / (n - 1));
+}
+
+static int Selected(const char* name, char** names, int name_count) {
+  if (name_count == 0) {
+    return 1;
+  }
+  for (int i = 0; i < name_count; i++) {
+    if (strcmp(names[i], name) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void WriteJson(FILE* out, const char* compiler, int runs, int warmup,
+                      const Samples* samples, char** names, int name_count) {
+  fprintf(out, "{\n  \"compiler\": \"%s\",\n  \"runs\": %d,\n  \"warmup\": %d,\n  \"benchmarks\": [",
+          compiler, runs, warmup);
+  int first = 1;
+  for (int i = 0; i < BENCHMARK_COUNT; i++) {
+    if (!Selected(benchmarks[i].name, names, name_count) || samples[i].failed) {
+      continue;
+    }
+    double sorted[MAX_RUNS];
+    memcpy(sorted, samples[i].ms, runs * sizeof(double));
+    qsort(sorted, runs, sizeof(double), CompareDouble);
+
+    fprintf(out, "%s\n    {\"name\": \"%s\", \"min_ms\": %.3f, \"median_ms\": %.3f, \"p90_ms\": %.3f, "
+            "\"p99_ms\": %.3f, \"max_ms\": %.3f, \"mean_ms\": %.3f, \"stddev_ms\": %.3f, \"max_rss_kb\": %ld,\n"
+            "     \"instructions\": %lld, \"samples_ms\": [", first ? "" : ",", benchmarks[i].name,
+            sorted[0], Percentile(sorted, runs, 50), Percentile(sorted, runs, 90),
+            Percentile(sorted, runs, 99), sorted[runs - 1], Mean(sorted, runs), StdDev(sorted, runs),
+            samples[i].max_rss_kb, samples[i].instructions);
+    for (int r = 0; r < runs; r++) {
+      fprintf(out, "%s%.3f", r > 0 ? ", " : "", samples[i].ms[r]);
+    }
+    fprintf(out, "]}");
+    first = 0;
+  }
+  fprintf(out, "\n  ]\n}\n");
+}
+
+// Reads the benchmarks of a JSON file written by WriteJson.
+static int LoadBaseline(const char* path, BaselineEntry* entries, int max) {
+  char* text = ReadText(path);
+  if (text == NULL) {
+    fprintf(stderr, "Could not open file \"%s\".\n", path);
+    return -1;
+  }
+  const char* key = "{\"name\": \"";
+  int n = 0;
+  const char* p = text;
+  while (n < max && (p = strstr(p, key)) != NULL) {
+    p += strlen(key);
+    const char* end = strchr(p, '"');
+    if (end == NULL) {
+      break;
+    }
+    BaselineEntry* e = &entries[n++];
+    memset(e, 0, sizeof(*e));
+    snprintf(e->name, sizeof(e->name), "%.*s", (int)(end - p), p);
+    e->samples.instructions = -1;
+
+    const char* next = strstr(end, key);
+    const char* insns = strstr(end, "\"instructions\": ");
+    if (insns != NULL && (next == NULL || insns < next)) {
+      e->samples.instructions = atoll(insns + strlen("\"instructions\": "));
+    }
+    const char* list = strstr(end, "\"samples_ms\": [");
+    if (list != NULL && (next == NULL || list < next)) {
+      char* at = (char*)list + strlen("\"samples_ms\": [");
+      while (*at != ']' && e->samples.runs < MAX_RUNS) {
+        char* after;
+        double ms = strtod(at, &after);
+        if (after == at) {
+          break;
+        }
+        e->samples.ms[e->samples.runs++] = ms;
+        at = after;
+        while (*at == ',' || *at == ' ') {
+          at++;
+        }
+      }
+    }
+    p = end;
+  }
+  free(text);
+  return n;
+}
+
+static double Median(double* values, int n) {
+  qsort(values, n, sizeof(double), CompareDouble);
+  return n % 2 == 1 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+static double SampleMedian(const Samples* s) {
+  double copy[MAX_RUNS];
+  memcpy(copy, s->ms, s->runs * sizeof(double));
+  return Median(copy, s->runs);
+}
+
+// 95% bootstrap interval of median(now) / median(base): both sample sets
+// are resampled with replacement and the 2.5th and 97.5th percentiles of
+// the resulting ratios are taken. The generator is seeded, so a given pair
+// of result files always gives the same interval.
+static void RatioInterval(const Samples* base, const Samples* now, double* lo, double* hi) {
+  static double ratios[BOOTSTRAP_ROUNDS];
+  double a[MAX_RUNS], b[MAX_RUNS];
+  unsigned long long seed = 0x9e3779b97f4a7c15ULL;
+  for (int r = 0; r < BOOTSTRAP_ROUNDS; r++) {
+    for (int i = 0; i < base->runs; i++) {
+      seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+      a[i] = base->ms[(seed >> 33) % (unsigned)base->runs];
+    }
+    for (int i = 0; i < now->runs; i++) {
+      seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+      b[i] = now->ms[(seed >> 33) % (unsigned)now->runs];
+    }
+    ratios[r] = Median(b, now->runs) / Median(a, base->runs);
+  }
+  qsort(ratios, BOOTSTRAP_ROUNDS, sizeof(double), CompareDouble);
+  *lo = ratios[(int)(BOOTSTRAP_ROUNDS * 0.025)];
+  *hi = ratios[(int)(BOOTSTRAP_ROUNDS * 0.975) - 1];
+}
+
+// A benchmark regresses when the whole confidence interval lies above
+// 1 + threshold, or when it executes more than insn_threshold more
+// instructions. Returns the number of regressions.
+static int Compare(const char* baseline_path, const Samples* samples, char** names, int name_count,
+                   double threshold, double insn_threshold) {
+  BaselineEntry* entries = (BaselineEntry*)malloc(MAX_BENCHMARKS * sizeof(BaselineEntry));
+  int count = LoadBaseline(baseline_path, entries, MAX_BENCHMARKS);
+  if (count < 0) {
+    free(entries);
+    return 1;
+  }
+
+  int regressions = 0;
+  printf("\nAgainst %s (time: 95%% bootstrap interval of the median ratio, threshold %.1f%%;"
+         " instructions: threshold %.1f%%)\n", baseline_path, threshold * 100, insn_threshold * 100);
+  printf("%-10s %10s %10s %8s %17s %8s %9s %8s\n", "benchmark", "base ms", "now ms", "change",
+         "95% interval", "time", "insns", "insns");
+  for (int i = 0; i < BENCHMARK_COUNT; i++) {
+    const Samples* now = &samples[i];
+    if (!Selected(benchmarks[i].name, names, name_count) || now->failed) {
+      continue;
+    }
+    const BaselineEntry* base = NULL;
+    for (int e = 0; e < count; e++) {
+      if (strcmp(entries[e].name, benchmarks[i].name) == 0) {
+        base = &entries[e];
+      }
+    }
+    if (base == NULL || base->samples.runs == 0) {
+      printf("%-10s not in baseline\n", benchmarks[i].name);
+      continue;
+    }
+
+    double lo, hi;
+    RatioInterval(&base->samples, now, &lo, &hi);
+    double base_median = SampleMedian(&base->samples);
+    double now_median = SampleMedian(now);
+    const char* time_verdict = "same";
+    if (lo > 1 + threshold) {
+      time_verdict = "SLOWER";
+      regressions++;
+    } else if (hi < 1 - threshold) {
+      time_verdict = "faster";
+    }
+
+    char insn_change[32] = "-";
+    const char* insn_verdict = "-";
+    if (base->samples.instructions > 0 && now->instructions > 0) {
+      double change = (double)now->instructions / (double)base->samples.instructions - 1;
+      snprintf(insn_change, sizeof(insn_change), "%+.2f%%", change * 100);
+      insn_verdict = "same";
+      if (change > insn_threshold) {
+        insn_verdict = "MORE";
+        regressions++;
+      } else if (change < -insn_threshold) {
+        insn_verdict = "fewer";
+      }
+    }
+    printf("%-10s %10.2f %10.2f %+7.1f%% [%6.3f, %6.3f] %8s %9s %8s\n", benchmarks[i].name,
+           base_median, now_median, (now_median / base_median - 1) * 100, lo, hi, time_verdict,
+           insn_change, insn_verdict);
+  }
+  free(entries);
+  if (regressions > 0) {
+    printf("%d regression(s).\n", regressions);
+  } else {
+    printf("No regressions.\n");
+  }
+  return regressions;
+}
+
+static void PrintUsage(const char* argv0) {
+  fprintf(stderr, "Usage: %s [--compiler PATH] [--runs N] [--warmup N] [--out FILE]\n", argv0);
+  fprintf(stderr, "       [--baseline FILE] [--threshold PCT] [--insn-threshold PCT] [NAME...]\n");
+  fprintf(stderr, "Benchmarks:");
+  for (int i = 0; i < BENCHMARK_COUNT; i++) {
+    fprintf(stderr, " %s", benchmarks[i].name);
+  }
+  fprintf(stderr, "\n");
+}
+
+int main(int argc, char* argv[]) {
+  const char* compiler = "bin/compiler";
+  const char* out_path = "bench/results.json";
+  int runs = 10;
+  int warmup = 2;
+  const char* baseline_path = NULL;
+  double threshold = 0.05;
+  double insn_threshold = 0.005;
+  char** names = (char**)malloc((size_t)argc * sizeof(char*));
+  int name_count = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--compiler") == 0 && i + 1 < argc) {
+      compiler = argv[++i];
+    } else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+      runs = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+      warmup = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+      out_path = argv[++i];
+    } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+      baseline_path = argv[++i];
+    } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+      threshold = atof(argv[++i]) / 100;
+    } else if (strcmp(argv[i], "--insn-threshold") == 0 && i + 1 < argc) {
+      insn_threshold = atof(argv[++i]) / 100;
+    } else if (argv[i][0] == '-') {
+      PrintUsage(argv[0]);
+      return 1;
+    } else {
+      names[name_count++] = argv[i];
+    }
+  }
+  if (runs < 2 || runs > MAX_RUNS || warmup < 0) {
+    fprintf(stderr, "--runs must be 2..%d and --warmup non-negative.\n", MAX_RUNS);
+    return 1;
+  }
+  if (!Prepare()) {
+    return 1;
+  }
+
+  Samples* samples = (Samples*)calloc(BENCHMARK_COUNT, sizeof(Samples));
+  int failures = 0;
+  printf("%-10s %10s %10s %10s %10s %10s %10s %12s\n", "benchmark", "min ms", "median ms", "p90 ms",
+         "p99 ms", "stddev", "rss kb", "instructions");
+  for (int i = 0; i < BENCHMARK_COUNT; i++) {
+    const Benchmark* b = &benchmarks[i];
+    if (!Selected(b->name, names, name_count)) {
+      continue;
+    }
+    Samples* s = &samples[i];
+    for (int r = 0; r < warmup + runs && !s->failed; r++) {
+      double ms = RunOnce(compiler, b, &s->max_rss_kb);
+      if (ms < 0) {
+        s->failed = 1;
+      } else if (r >= warmup) {
+        s->ms[r - warmup] = ms;
+      }
+    }
+    if (s->failed) {
+      printf("%-10s FAILED (%s %s)\n", b->name, compiler, b->program);
+      failures++;
+      continue;
+    }
+    s->runs = runs;
+    s->instructions = CountInstructions(compiler, b);
+
+    double sorted[MAX_RUNS];
+    memcpy(sorted, s->ms, runs * sizeof(double));
+    qsort(sorted, runs, sizeof(double), CompareDouble);
+    printf("%-10s %10.2f %10.2f %10.2f %10.2f %10.2f %10ld %12lld   %s\n", b->name, sorted[0],
+           Percentile(sorted, runs, 50), Percentile(sorted, runs, 90), Percentile(sorted, runs, 99),
+           StdDev(sorted, runs), s->max_rss_kb, s->instructions, b->description);
+  }
+
+  FILE* out = fopen(out_path, "w");
+  if (out == NULL) {
+    fprintf(stderr, "Could not open file \"%s\".\n", out_path);
+    failures++;
+  } else {
+    WriteJson(out, compiler, runs, warmup, samples, names, name_count);
+    fclose(out);
+    printf("Results written to %s (%d runs after %d warmup).\n", out_path, runs, warmup);
+  }
+  if (baseline_path != NULL && Compare(baseline_path, samples, names, name_count,
+                                       threshold, insn_threshold) > 0) {
+    failures++;
+  }
+
+  Cleanup();
+  free(samples);
+  free(names);
+  return failures > 0 ? 1 : 0;
+}
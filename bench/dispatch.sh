@@ -0,0 +1,50 @@
+#!/bin/sh
+# Compares switch and computed-goto dispatch of the VM on a loop-heavy script.
+# Usage: sh bench/dispatch.sh [program.ccb]   (RUNS=n to change repetitions)
+
+set -e
+cd "$(dirname "$0")/.."
+
+PROGRAM=${1:-bench/dispatch_loop.ccb}
+RUNS=${RUNS:-5}
+OPT="-O2 -g -Wall -Wextra"
+
+build() {
+  make -s OBJ_DIR=obj/bench-$1 BIN_DIR=bin/bench-$1 CFLAGS="$OPT $2" >/dev/null
+}
+
+now_ns() {
+  date +%s%N
+}
+
+best_time() {
+  best=""
+  i=0
+  while [ $i -lt "$RUNS" ]; do
+    start=$(now_ns)
+    "$1" "$PROGRAM" >/dev/null
+    end=$(now_ns)
+    t=$((end - start))
+    if [ -z "$best" ] || [ $t -lt $best ]; then
+      best=$t
+    fi
+    i=$((i + 1))
+  done
+  echo $best
+}
+
+build switch -DCCB_SWITCH_DISPATCH
+build goto ""
+build count -DCCB_COUNT_INSNS
+
+insns=$(./bin/bench-count/compiler "$PROGRAM" 2>&1 >/dev/null | awk '/instructions executed/ { print $3 }')
+
+t_switch=$(best_time ./bin/bench-switch/compiler)
+t_goto=$(best_time ./bin/bench-goto/compiler)
+
+echo "program: $PROGRAM ($insns instructions, best of $RUNS runs)"
+awk -v n="$insns" -v ts="$t_switch" -v tg="$t_goto" 'BEGIN {
+  printf "switch:        %8.1f ms  %8.1f M instr/s\n", ts / 1e6, n / ts * 1e3
+  printf "computed goto: %8.1f ms  %8.1f M instr/s\n", tg / 1e6, n / tg * 1e3
+  printf "speedup:       %8.2fx\n", ts / tg
+}'
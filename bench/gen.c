@@ -0,0 +1,310 @@
+// Deterministic generator of valid CCB programs for front-end scaling tests.
+//
+// Usage: ccb-gen [--lines N] [--shape mixed|straight|functions|nested|limits]
+//                [--functions N] [--ns-depth N] [--loop-depth N] [--seed N] [-o FILE]
+//
+// All shapes but "limits" respect the limits of the stack codegen: at most
+// 256 global names and 256 distinct literals, and all function code within
+// the first 64K of bytecode (OP_CALL has a 16-bit target), so functions are
+// emitted first and their number is checked against an estimate of their
+// size. Every value stays small, so the programs also run without overflow
+// or division by zero.
+//
+// "limits" crosses them on purpose: every line declares a new global from a
+// new literal, and a function defined after all of it is called first. It
+// compiles up to about 250 lines; the scaling report shows which limits
+// stop larger programs.
+//
+// The function counts of the shapes are sized for DEFAULT_LINES; below
+// that they shrink in proportion unless --functions is given. The 64
+// globals alone take 65 lines, so tiny targets still come out larger, and
+// a warning says so.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GLOBALS 64
+#define CALL_TARGET_LIMIT 65535
+#define LOOP_BOUND 2
+#define DEFAULT_LINES 10000
+
+typedef struct {
+  const char* name;
+  int functions;
+  int ns_depth;
+  int loop_depth;
+  int straight_weight;  // out of 100 top-level blocks
+  int call_weight;
+  int if_weight;
+  int fresh;  // a new global and literal per line, then a function at the end
+} Shape;
+
+static const Shape shapes[] = {
+  {"mixed", 200, 2, 2, 60, 20, 10, 0},
+  {"straight", 0, 0, 0, 100, 0, 0, 0},
+  {"functions", 600, 1, 1, 20, 80, 0, 0},
+  {"nested", 100, 8, 4, 30, 10, 10, 0},
+  {"limits", 0, 0, 0, 100, 0, 0, 1},
+};
+
+typedef struct {
+  FILE* out;
+  long lines;
+  unsigned long long seed;
+} Gen;
+
+static unsigned Next(Gen* g) {
+  g->seed = g->seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (unsigned)(g->seed >> 33);
+}
+
+static int Pick(Gen* g, int n) {
+  return (int)(Next(g) % (unsigned)n);
+}
+
+__attribute__((format(printf, 3, 4)))
+static void Line(Gen* g, int indent, const char* fmt, ...) {
+  fprintf(g->out, "%*s", indent * 2, "");
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(g->out, fmt, args);
+  va_end(args);
+  fputc('\n', g->out);
+  g->lines++;
+}
+
+// Function k lives in namespace path n<k/8>.d1.d2...; callers use the
+// qualified name.
+static void FunctionName(char* buf, size_t size, int k, int ns_depth) {
+  int at = 0;
+  if (ns_depth > 0) {
+    at += snprintf(buf + at, size - at, "n%d.", k / 8);
+    for (int d = 1; d < ns_depth; d++) {
+      at += snprintf(buf + at, size - at, "d%d.", d);
+    }
+  }
+  snprintf(buf + at, size - at, "f%d", k);
+}
+
+// A let inside a loop body would grow the frame every iteration, so loop
+// counters are declared up front and only reset before each loop.
+static int FunctionLoopDepth(const Shape* shape) {
+  return shape->loop_depth > 2 ? 2 : shape->loop_depth;
+}
+
+// Measured bytecode size of one generated function, rounded up.
+static int FunctionBytes(const Shape* shape) {
+  return 44 + 26 * FunctionLoopDepth(shape);
+}
+
+static void FunctionBody(Gen* g, int indent, int k, int loop_depth) {
+  Line(g, indent, "let t = a / 2 + b / 4 + %d;", k % 50);
+  for (int d = 0; d < loop_depth; d++) {
+    Line(g, indent, "let j%d = 0;", d);
+  }
+  for (int d = 0; d < loop_depth; d++) {
+    Line(g, indent + d, "j%d = 0;", d);
+    Line(g, indent + d, "while (j%d < %d) {", d, LOOP_BOUND);
+  }
+  Line(g, indent + loop_depth, "t = t / 2 + %d;", Pick(g, 100));
+  for (int d = loop_depth - 1; d >= 0; d--) {
+    Line(g, indent + d + 1, "j%d = j%d + 1;", d, d);
+    Line(g, indent + d, "}");
+  }
+  Line(g, indent, "return t - t / 1000 * 1000;");
+}
+
+static void Functions(Gen* g, const Shape* shape) {
+  for (int first = 0; first < shape->functions; first += 8) {
+    int indent = 0;
+    if (shape->ns_depth > 0) {
+      Line(g, indent++, "ns n%d {", first / 8);
+      for (int d = 1; d < shape->ns_depth; d++) {
+        Line(g, indent++, "ns d%d {", d);
+      }
+    }
+    for (int k = first; k < first + 8 && k < shape->functions; k++) {
+      Line(g, indent, "fn f%d(a, b) -> int {", k);
+      FunctionBody(g, indent + 1, k, FunctionLoopDepth(shape));
+      Line(g, indent, "}");
+    }
+    while (indent > 0) {
+      Line(g, --indent, "}");
+    }
+  }
+}
+
+static void Straight(Gen* g) {
+  int a = Pick(g, GLOBALS), b = Pick(g, GLOBALS), c = Pick(g, GLOBALS);
+  if (Pick(g, 2) == 0) {
+    Line(g, 0, "g%d = g%d / 2 + %d;", a, b, Pick(g, 100));
+  } else {
+    Line(g, 0, "g%d = g%d / 2 - g%d / 4 + %d;", a, b, c, Pick(g, 100));
+  }
+}
+
+static void Call(Gen* g, const Shape* shape) {
+  char name[256];
+  FunctionName(name, sizeof(name), Pick(g, shape->functions), shape->ns_depth);
+  Line(g, 0, "g%d = %s(g%d, %d);", Pick(g, GLOBALS), name, Pick(g, GLOBALS), Pick(g, 100));
+}
+
+static void If(Gen* g) {
+  int a = Pick(g, GLOBALS), b = Pick(g, GLOBALS), c = Pick(g, GLOBALS);
+  Line(g, 0, "if (g%d > g%d) {", a, b);
+  Line(g, 1, "g%d = g%d / 2;", c, a);
+  Line(g, 0, "} else {");
+  Line(g, 1, "g%d = g%d / 2 + 1;", c, b);
+  Line(g, 0, "}");
+}
+
+// Loop counters are globals i0..i<depth-1>, reset before each loop.
+static void Loops(Gen* g, int depth) {
+  for (int d = 0; d < depth; d++) {
+    Line(g, d, "i%d = 0;", d);
+    Line(g, d, "while (i%d < %d) {", d, LOOP_BOUND);
+  }
+  int a = Pick(g, GLOBALS), b = Pick(g, GLOBALS);
+  Line(g, depth, "g%d = g%d / 2 + i%d;", a, b, depth - 1);
+  for (int d = depth - 1; d >= 0; d--) {
+    Line(g, d + 1, "i%d = i%d + 1;", d, d);
+    Line(g, d, "}");
+  }
+}
+
+static void Fresh(Gen* g, long target) {
+  Line(g, 0, "let v0 = last(1);");
+  for (long k = 1; g->lines < target - 4; k++) {
+    Line(g, 0, "let v%ld = v%ld / 2 + %ld;", k, k - 1, 1000 + k);
+  }
+  Line(g, 0, "fn last(a) -> int {");
+  Line(g, 1, "return a + 1;");
+  Line(g, 0, "}");
+  Line(g, 0, "out v0;");
+}
+
+static void Generate(Gen* g, const Shape* shape, long target) {
+  Line(g, 0, "// Generated by ccb-gen: shape %s, about %ld lines.", shape->name, target);
+  if (shape->fresh) {
+    Fresh(g, target);
+    return;
+  }
+  for (int i = 0; i < GLOBALS; i++) {
+    Line(g, 0, "let g%d = %d;", i, i);
+  }
+  for (int d = 0; d < shape->loop_depth; d++) {
+    Line(g, 0, "let i%d = 0;", d);
+  }
+  Functions(g, shape);
+
+  int loop_weight = 100 - shape->straight_weight - shape->call_weight - shape->if_weight;
+  while (g->lines < target - 1) {
+    int r = Pick(g, 100);
+    if (r < shape->straight_weight) {
+      Straight(g);
+    } else if ((r -= shape->straight_weight) < shape->call_weight && shape->functions > 0) {
+      Call(g, shape);
+    } else if ((r -= shape->call_weight) < shape->if_weight) {
+      If(g);
+    } else if (loop_weight > 0 && shape->loop_depth > 0) {
+      Loops(g, shape->loop_depth);
+    } else {
+      Straight(g);
+    }
+  }
+  Line(g, 0, "out g0 + g1;");
+}
+
+static void PrintUsage(const char* argv0) {
+  fprintf(stderr, "Usage: %s [--lines N] [--shape mixed|straight|functions|nested|limits]\n", argv0);
+  fprintf(stderr, "       [--functions N] [--ns-depth N] [--loop-depth N] [--seed N] [-o FILE]\n");
+}
+
+int main(int argc, char* argv[]) {
+  Shape shape = shapes[0];
+  long lines = DEFAULT_LINES;
+  unsigned long long seed = 1;
+  const char* out_path = NULL;
+  int functions = -1, ns_depth = -1, loop_depth = -1;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--lines") == 0 && i + 1 < argc) {
+      lines = atol(argv[++i]);
+    } else if (strcmp(argv[i], "--shape") == 0 && i + 1 < argc) {
+      const char* name = argv[++i];
+      int found = 0;
+      for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+        if (strcmp(shapes[s].name, name) == 0) {
+          shape = shapes[s];
+          found = 1;
+        }
+      }
+      if (!found) {
+        fprintf(stderr, "Unknown shape \"%s\".\n", name);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--functions") == 0 && i + 1 < argc) {
+      functions = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--ns-depth") == 0 && i + 1 < argc) {
+      ns_depth = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--loop-depth") == 0 && i + 1 < argc) {
+      loop_depth = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      out_path = argv[++i];
+    } else {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (functions >= 0) {
+    shape.functions = functions;
+  } else if (lines < DEFAULT_LINES && shape.functions > 0) {
+    shape.functions = (int)(shape.functions * (lines > 0 ? lines : 0) / DEFAULT_LINES);
+    if (shape.functions < 1) {
+      shape.functions = 1;
+    }
+  }
+  if (ns_depth >= 0) {
+    shape.ns_depth = ns_depth;
+  }
+  if (loop_depth >= 0) {
+    shape.loop_depth = loop_depth;
+  }
+  if (shape.ns_depth > 64 || shape.loop_depth > 8) {
+    fprintf(stderr, "Limits: --ns-depth <= 64, --loop-depth <= 8.\n");
+    return 1;
+  }
+  int max_functions = (CALL_TARGET_LIMIT - 1024) / FunctionBytes(&shape);
+  if (shape.functions > max_functions) {
+    fprintf(stderr, "At most %d functions fit in the 64K of code OP_CALL can reach at this loop depth.\n",
+            max_functions);
+    return 1;
+  }
+
+  Gen g;
+  g.out = stdout;
+  g.lines = 0;
+  g.seed = seed;
+  if (out_path != NULL) {
+    g.out = fopen(out_path, "w");
+    if (g.out == NULL) {
+      fprintf(stderr, "Could not open file \"%s\".\n", out_path);
+      return 1;
+    }
+  }
+  Generate(&g, &shape, lines);
+  if (fclose(g.out) != 0) {
+    fprintf(stderr, "Could not write output.\n");
+    return 1;
+  }
+  if (g.lines > lines + lines / 2 + 8) {
+    fprintf(stderr, "Warning: wrote %ld lines for --lines %ld; the globals and functions "
+            "of shape \"%s\" do not fit in fewer.\n", g.lines, lines, shape.name);
+  }
+  return 0;
+}
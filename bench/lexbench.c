@@ -0,0 +1,90 @@
+// Lexer throughput: tokenizes each file a number of times and reports the
+// best run in MB/s and million tokens per second. It is linked directly
+// against src/lexer/lexer.c, so only NextToken is measured.
+//
+// Usage: ccb-lexbench [--reps N] FILE...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../src/lexer/lexer.h"
+
+static double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static char* ReadText(const char* path, size_t* size) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "Could not open file \"%s\".\n", path);
+    return NULL;
+  }
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  rewind(file);
+  char* text = (char*)malloc((size_t)length + 1);
+  *size = fread(text, 1, (size_t)length, file);
+  text[*size] = '\0';
+  fclose(file);
+  return text;
+}
+
+// Returns the token count; checksum depends on every token so the loop
+// cannot be dropped.
+static long Tokenize(const char* source, unsigned long* checksum) {
+  Lexer* l = NewLexer(source);
+  long count = 0;
+  for (;;) {
+    Token tok = NextToken(l);
+    *checksum = *checksum * 31 + (unsigned long)tok.type + (unsigned long)tok.length;
+    if (tok.type == TOKEN_EOF) {
+      break;
+    }
+    count++;
+  }
+  free(l);
+  return count;
+}
+
+int main(int argc, char* argv[]) {
+  int reps = 5;
+  int files = 0;
+  unsigned long checksum = 0;
+
+  printf("%-32s %9s %10s %9s %9s %10s\n", "file", "MB", "tokens", "best ms", "MB/s", "Mtok/s");
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+      reps = atoi(argv[++i]);
+      continue;
+    }
+    size_t size;
+    char* source = ReadText(argv[i], &size);
+    if (source == NULL) {
+      return 1;
+    }
+    double best = 0;
+    long tokens = 0;
+    for (int r = 0; r < reps; r++) {
+      double start = Now();
+      tokens = Tokenize(source, &checksum);
+      double elapsed = Now() - start;
+      if (r == 0 || elapsed < best) {
+        best = elapsed;
+      }
+    }
+    const char* name = strrchr(argv[i], '/');
+    printf("%-32s %9.2f %10ld %9.2f %9.1f %10.1f\n", name != NULL ? name + 1 : argv[i],
+           size / 1e6, tokens, best * 1e3, size / 1e6 / best, tokens / 1e6 / best);
+    free(source);
+    files++;
+  }
+  if (files == 0 || reps < 1) {
+    fprintf(stderr, "Usage: %s [--reps N] FILE...\n", argv[0]);
+    return 1;
+  }
+  printf("scanner %s, checksum %lx\n", GetScanner()->name, checksum);
+  return 0;
+}
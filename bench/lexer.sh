@@ -0,0 +1,35 @@
+#!/bin/sh
+# Lexer throughput on large generated sources (see bench/lexbench.c), once
+# per scanner variant. "commented" is the last program with deep indentation
+# and a trailing comment on every line, so whitespace and comment runs are
+# long; that is where the vector scanners matter.
+# Usage: sh bench/lexer.sh   (LINES=N, REPS=N, SHAPES="mixed straight ...",
+#                             SCANNERS="scalar sse2 avx2")
+
+set -e
+cd "$(dirname "$0")/.."
+
+LINES=${LINES:-1000000}
+REPS=${REPS:-5}
+SHAPES=${SHAPES:-"mixed straight nested"}
+SCANNERS=${SCANNERS:-"scalar sse2 avx2"}
+WORK=$(mktemp -d /tmp/ccb-lexer-XXXXXX)
+trap 'rm -rf "$WORK"' EXIT
+
+make -s bin/ccb-gen bin/ccb-lexbench >/dev/null
+
+files=""
+for shape in $SHAPES; do
+  ./bin/ccb-gen --shape "$shape" --lines "$LINES" -o "$WORK/$shape.ccb"
+  files="$files $WORK/$shape.ccb"
+  last="$WORK/$shape.ccb"
+done
+awk '{ printf "%40s%s // %s\n", "", $0, "a trailing comment that explains this line" }' "$last" \
+  > "$WORK/commented.ccb"
+files="$files $WORK/commented.ccb"
+
+# An unsupported variant falls back to the next narrower one; the report
+# names the scanner that actually ran.
+for scanner in $SCANNERS; do
+  CCB_LEXER_SIMD=$scanner ./bin/ccb-lexbench --reps "$REPS" $files
+done
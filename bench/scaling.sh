@@ -0,0 +1,87 @@
+#!/bin/sh
+# Front-end scaling: generates programs of growing size with ccb-gen and
+# records per-phase time and memory from --stats-json. The "exp" columns are
+# the growth exponent against the previous size (time ~ lines^exp): about 1
+# is linear, and anything well above it points at superlinear behavior.
+# Usage: sh bench/scaling.sh   (SHAPE=mixed|straight|functions|nested|limits,
+#                               SIZES="10000 100000 ...", OUT=file.csv)
+# The "limits" shape crosses the codegen's fixed limits, so its default
+# sizes start small; a failed size lists the distinct diagnostics.
+
+set -e
+cd "$(dirname "$0")/.."
+
+SHAPE=${SHAPE:-mixed}
+if [ "$SHAPE" = limits ]; then
+  SIZES=${SIZES:-"100 200 300 1000 10000 30000"}
+else
+  SIZES=${SIZES:-"10000 30000 100000 300000 1000000"}
+fi
+OUT=${OUT:-bench/scaling-$SHAPE.csv}
+COMPILER=bin/bench-O2/compiler
+WORK=$(mktemp -d /tmp/ccb-scaling-XXXXXX)
+trap 'rm -rf "$WORK"' EXIT
+
+make -s OBJ_DIR=obj/bench-O2 BIN_DIR=bin/bench-O2 CFLAGS="-O2 -g -Wall -Wextra" all >/dev/null
+make -s bin/ccb-gen >/dev/null
+
+# Pulls a number out of the one-field-per-line --stats-json output.
+field() {
+  sed -n "s/.*\"$1\": \([0-9.]*\).*/\1/p" "$2" | head -n 1
+}
+
+echo "lines,tokens,lex_ms,parse_ms,codegen_ms,frontend_ms,peak_heap_bytes,max_rss_kb,ok" > "$OUT"
+printf "%-9s %9s %9s %9s %9s %10s %8s %6s %12s %10s %6s\n" \
+  lines tokens lex_ms parse_ms cgen_ms front_ms ns/line exp heap_bytes rss_kb exp
+
+prev_lines=""
+for n in $SIZES; do
+  ./bin/ccb-gen --shape "$SHAPE" --lines "$n" -o "$WORK/prog.ccb"
+  ./$COMPILER --stats-json "$WORK/stats.json" "$WORK/prog.ccb" >"$WORK/out" 2>&1 || true
+
+  tokens=$(field tokens "$WORK/stats.json")
+  lex=$(field lex "$WORK/stats.json")
+  parse=$(field parse "$WORK/stats.json")
+  codegen=$(field codegen "$WORK/stats.json")
+  heap=$(field peak_heap_bytes "$WORK/stats.json")
+  rss=$(field max_rss_kb "$WORK/stats.json")
+  ok=$(sed -n 's/.*"ok": \([a-z]*\).*/\1/p' "$WORK/stats.json")
+  front=$(awk -v p="$parse" -v c="$codegen" 'BEGIN { printf "%.3f", p + c }')
+
+  echo "$n,$tokens,$lex,$parse,$codegen,$front,$heap,$rss,$ok" >> "$OUT"
+  awk -v n="$n" -v tok="$tokens" -v lex="$lex" -v parse="$parse" -v cg="$codegen" \
+      -v front="$front" -v heap="$heap" -v rss="$rss" -v ok="$ok" \
+      -v pn="$prev_lines" -v pfront="$prev_front" -v pheap="$prev_heap" 'BEGIN {
+    texp = "-"; hexp = "-"
+    if (pn != "" && pfront > 0 && pheap > 0) {
+      texp = sprintf("%.2f", log(front / pfront) / log(n / pn))
+      hexp = sprintf("%.2f", log(heap / pheap) / log(n / pn))
+    }
+    printf "%-9d %9d %9.2f %9.2f %9.2f %10.2f %8.0f %6s %12d %10d %6s%s\n",
+           n, tok, lex, parse, cg, front, front * 1e6 / n, texp, heap, rss, hexp,
+           ok == "true" ? "" : "  (compile or run failed)"
+  }'
+  if [ "$ok" != "true" ]; then
+    grep -v "^---" "$WORK/out" | awk '!seen[$0]++' | head -n 4 | sed 's/^/    /'
+  fi
+
+  prev_lines=$n
+  prev_front=$front
+  prev_heap=$heap
+done
+
+echo "Results written to $OUT (shape $SHAPE; front = parse, which includes lexing, plus codegen)."
+if command -v gnuplot >/dev/null 2>&1; then
+  gnuplot <<EOF
+set terminal png size 900,500
+set output "${OUT%.csv}.png"
+set datafile separator ","
+set logscale xy
+set key left top
+set xlabel "lines"
+set ylabel "ms / bytes"
+plot "$OUT" using 1:6 skip 1 with linespoints title "front-end ms", \
+     "$OUT" using 1:(\$7/1e6) skip 1 with linespoints title "peak heap MB"
+EOF
+  echo "Plot written to ${OUT%.csv}.png."
+fi
@@ -0,0 +1,55 @@
+#ifndef CCB_H
+#define CCB_H
+
+// Embedding API for CCB: compile a program once, then run it any number
+// of times. A compiled program is immutable and may be run concurrently
+// from several threads, each run getting its own VM.
+//
+// Diagnostics are printed to stdout/stderr as by bin/compiler. Division by
+// zero is not trapped and raises SIGFPE, as it does in the interpreter.
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CCB_API __attribute__((visibility("default")))
+#else
+#define CCB_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct CcbProgram CcbProgram;
+
+typedef enum {
+  CCB_OK,
+  CCB_COMPILE_ERROR,
+  CCB_RUNTIME_ERROR
+} CcbResult;
+
+// Called for every `in`; the returned value is stored in the variable.
+typedef int (*CcbInputFn)(void* user);
+// Called for every `out`.
+typedef void (*CcbOutputFn)(void* user, int value);
+
+typedef struct {
+  CcbInputFn input;   // NULL reads integers from stdin, shared by all runs
+  CcbOutputFn output; // NULL prints one integer per line to stdout
+  void* user;
+} CcbIO;
+
+// Returns NULL on a syntax or codegen error.
+CCB_API CcbProgram* CcbCompile(const char* source);
+// Loads a .ccbc file written by `bin/compiler --emit-bytecode`.
+CCB_API CcbProgram* CcbLoad(const char* path);
+CCB_API void CcbFreeProgram(CcbProgram* program);
+
+// Runs the program from the start with all variables zeroed. io may be NULL.
+// Concurrent runs without an input callback take turns on stdin: each `in`
+// gets the next whole value, in whatever order the runs ask for them.
+CCB_API CcbResult CcbRun(const CcbProgram* program, const CcbIO* io);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "cache.h"
+#include "../common/ccbc.h"
+#include "../vm/vm.h"
+
+typedef struct {
+  char path[4096];
+  struct timespec mtime;
+  off_t size;
+} CacheEntry;
+
+static uint64_t Fnv1a(uint64_t hash, const void* data, size_t length) {
+  const uint8_t* p = (const uint8_t*)data;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= p[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static int MakeDirs(char* path) {
+  for (char* p = path + 1; *p != '\0'; p++) {
+    if (*p == '/') {
+      *p = '\0';
+      if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+        *p = '/';
+        return 0;
+      }
+      *p = '/';
+    }
+  }
+  return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+static int CacheDir(char* dir, size_t size) {
+  const char* env = getenv("CCB_CACHE_DIR");
+  const char* xdg = getenv("XDG_CACHE_HOME");
+  const char* home = getenv("HOME");
+  if (env != NULL && env[0] != '\0') {
+    snprintf(dir, size, "%s", env);
+  } else if (xdg != NULL && xdg[0] != '\0') {
+    snprintf(dir, size, "%s/ccb", xdg);
+  } else if (home != NULL && home[0] != '\0') {
+    snprintf(dir, size, "%s/.cache/ccb", home);
+  } else {
+    return 0;
+  }
+  return MakeDirs(dir);
+}
+
+// The stats file is shared by every process using the cache, so updates
+// happen under an exclusive lock.
+static void UpdateStats(const char* dir, int hit) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/stats", dir);
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    return;
+  }
+  flock(fd, LOCK_EX);
+
+  char buffer[128] = {0};
+  long hits = 0, misses = 0;
+  if (read(fd, buffer, sizeof(buffer) - 1) > 0) {
+    sscanf(buffer, "hits %ld misses %ld", &hits, &misses);
+  }
+  if (hit) {
+    hits++;
+  } else {
+    misses++;
+  }
+
+  int n = snprintf(buffer, sizeof(buffer), "hits %ld misses %ld\n", hits, misses);
+  if (pwrite(fd, buffer, (size_t)n, 0) == n) {
+    ftruncate(fd, n);
+  }
+  flock(fd, LOCK_UN);
+  close(fd);
+}
+
+static int IsEntry(const char* name) {
+  size_t n = strlen(name);
+  return n > 5 && strcmp(name + n - 5, ".ccbc") == 0;
+}
+
+static int CompareEntries(const void* a, const void* b) {
+  const struct timespec* ta = &((const CacheEntry*)a)->mtime;
+  const struct timespec* tb = &((const CacheEntry*)b)->mtime;
+  if (ta->tv_sec != tb->tv_sec) {
+    return (ta->tv_sec > tb->tv_sec) - (ta->tv_sec < tb->tv_sec);
+  }
+  return (ta->tv_nsec > tb->tv_nsec) - (ta->tv_nsec < tb->tv_nsec);
+}
+
+static CacheEntry* ListEntries(const char* dir, int* count, long* total) {
+  *count = 0;
+  *total = 0;
+  DIR* d = opendir(dir);
+  if (d == NULL) {
+    return NULL;
+  }
+
+  CacheEntry* entries = NULL;
+  int capacity = 0;
+  struct dirent* e;
+  while ((e = readdir(d)) != NULL) {
+    if (!IsEntry(e->d_name)) {
+      continue;
+    }
+    if (capacity < *count + 1) {
+      capacity = capacity < 8 ? 8 : capacity * 2;
+      entries = realloc(entries, capacity * sizeof(CacheEntry));
+    }
+    CacheEntry* entry = &entries[*count];
+    snprintf(entry->path, sizeof(entry->path), "%s/%s", dir, e->d_name);
+    struct stat st;
+    if (stat(entry->path, &st) != 0) {
+      continue;
+    }
+    entry->mtime = st.st_mtim;
+    entry->size = st.st_size;
+    *total += st.st_size;
+    (*count)++;
+  }
+  closedir(d);
+  return entries;
+}
+
+// Hits refresh the entry's mtime, so removing the oldest files first is
+// least-recently-used eviction.
+static void Evict(const char* dir, const char* keep) {
+  long limit = CACHE_MAX_BYTES;
+  const char* env = getenv("CCB_CACHE_MAX_BYTES");
+  if (env != NULL && env[0] != '\0') {
+    limit = atol(env);
+  }
+
+  int count;
+  long total;
+  CacheEntry* entries = ListEntries(dir, &count, &total);
+  if (total > limit) {
+    qsort(entries, count, sizeof(CacheEntry), CompareEntries);
+    for (int i = 0; i < count && total > limit; i++) {
+      if (strcmp(entries[i].path, keep) != 0 && unlink(entries[i].path) == 0) {
+        total -= entries[i].size;
+      }
+    }
+  }
+  free(entries);
+}
+
+Chunk* CompileCached(const char* source) {
+  char dir[4096];
+  if (!CacheDir(dir, sizeof(dir))) {
+    return CompileSource(source);
+  }
+
+  size_t length = strlen(source);
+  uint64_t hash = Fnv1a(0xcbf29ce484222325ULL, CCB_COMPILER_VERSION, sizeof(CCB_COMPILER_VERSION));
+  hash = Fnv1a(hash, CCB_CODEGEN_HASH, sizeof(CCB_CODEGEN_HASH));
+  hash = Fnv1a(hash, source, length);
+
+  char path[4096 + 64];
+  snprintf(path, sizeof(path), "%s/%016llx-%zu.ccbc", dir, (unsigned long long)hash, length);
+
+  if (access(path, R_OK) == 0) {
+    Chunk* chunk = LoadBytecodeFile(path);
+    if (chunk != NULL) {
+      utimensat(AT_FDCWD, path, NULL, 0);
+      UpdateStats(dir, 1);
+      return chunk;
+    }
+    unlink(path);
+  }
+
+  UpdateStats(dir, 0);
+  Chunk* chunk = CompileSource(source);
+  if (chunk == NULL) {
+    return NULL;
+  }
+
+  // Concurrent writers each fill their own file; rename makes the entry
+  // appear whole or not at all.
+  char tmp[4096 + 96];
+  snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid());
+  if (WriteBytecodeFile(chunk, tmp)) {
+    if (rename(tmp, path) != 0) {
+      unlink(tmp);
+    }
+    Evict(dir, path);
+  } else {
+    unlink(tmp);
+  }
+  return chunk;
+}
+
+void PrintCacheStats(FILE* out) {
+  char dir[4096];
+  if (!CacheDir(dir, sizeof(dir))) {
+    fprintf(out, "cache: unavailable (set CCB_CACHE_DIR or HOME)\n");
+    return;
+  }
+
+  long hits = 0, misses = 0;
+  char path[4096 + 16];
+  snprintf(path, sizeof(path), "%s/stats", dir);
+  FILE* file = fopen(path, "r");
+  if (file != NULL) {
+    if (fscanf(file, "hits %ld misses %ld", &hits, &misses) != 2) {
+      hits = misses = 0;
+    }
+    fclose(file);
+  }
+
+  int count;
+  long total;
+  free(ListEntries(dir, &count, &total));
+
+  fprintf(out, "cache: %s\n", dir);
+  fprintf(out, "hits: %ld\n", hits);
+  fprintf(out, "misses: %ld\n", misses);
+  fprintf(out, "entries: %d\n", count);
+  fprintf(out, "bytes: %ld\n", total);
+}
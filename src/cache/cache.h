@@ -0,0 +1,21 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include "../common/bytecode.h"
+
+// Bumped by hand only for changes the codegen checksum cannot see.
+#define CCB_COMPILER_VERSION "ccb-4"
+
+// Checksum of the front-end sources, passed in by the Makefile.
+#ifndef CCB_CODEGEN_HASH
+#define CCB_CODEGEN_HASH "unknown"
+#endif
+
+// Default size bound of the cache directory; CCB_CACHE_MAX_BYTES overrides it.
+#define CACHE_MAX_BYTES (64L * 1024 * 1024)
+
+Chunk* CompileCached(const char* source);
+void PrintCacheStats(FILE* out);
+
+#endif
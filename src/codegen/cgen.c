@@ -0,0 +1,635 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "cgen.h"
+#include "../vm/vm.h"
+
+typedef struct {
+  const AstNode* fn;
+  int index;
+} CFunction;
+
+typedef struct {
+  FILE* out;
+  int ok;
+  const Program* program;
+
+  // Per symbol: its slot in g[] and the last function defined under it,
+  // or -1.
+  int* symbol_globals;
+  int* symbol_functions;
+  int global_count;
+
+  CFunction* functions;
+  int function_count;
+  int function_capacity;
+
+  int in_function;
+  // Names visible so far, and every local of the function in slot order;
+  // a local's C name carries its slot.
+  SymbolId locals[256];
+  int local_count;
+  SymbolId slots[256];
+  int slot_count;
+  int temp_count;
+  int depth;
+} CGen;
+
+static void EmitStatementC(CGen* g, NodeId id);
+static char* EmitExpressionC(CGen* g, NodeId id);
+
+static char* Format(const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(NULL, 0, fmt, args);
+  va_end(args);
+
+  char* s = (char*)malloc((size_t)n + 1);
+  va_start(args, fmt);
+  vsnprintf(s, (size_t)n + 1, fmt, args);
+  va_end(args);
+  return s;
+}
+
+static void Line(CGen* g, const char* fmt, ...) {
+  for (int i = 0; i < g->depth; i++) {
+    fputs("  ", g->out);
+  }
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(g->out, fmt, args);
+  va_end(args);
+  fputc('\n', g->out);
+}
+
+static const AstNode* NodeAtC(CGen* g, NodeId id) {
+  return &g->program->nodes[id];
+}
+
+static const char* NameC(CGen* g, SymbolId name) {
+  return g->program->symbols[name];
+}
+
+static int GlobalIndexC(CGen* g, SymbolId name) {
+  if (g->symbol_globals[name] < 0) {
+    g->symbol_globals[name] = g->global_count++;
+  }
+  return g->symbol_globals[name];
+}
+
+static int FindLocalC(CGen* g, SymbolId name) {
+  if (!g->in_function) {
+    return -1;
+  }
+  for (int i = 0; i < g->local_count; i++) {
+    if (g->locals[i] == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static CFunction* FindFunctionC(CGen* g, SymbolId name) {
+  int index = g->symbol_functions[name];
+  return index < 0 ? NULL : &g->functions[index];
+}
+
+static void CollectFunctions(CGen* g, NodeId id) {
+  if (id == NO_NODE) {
+    return;
+  }
+  const AstNode* stmt = NodeAtC(g, id);
+  switch (stmt->type) {
+    case NODE_FUNCTION_STATEMENT: {
+      if (g->function_capacity < g->function_count + 1) {
+        g->function_capacity = g->function_capacity < 8 ? 8 : g->function_capacity * 2;
+        g->functions = realloc(g->functions, g->function_capacity * sizeof(CFunction));
+      }
+      g->functions[g->function_count].fn = stmt;
+      g->functions[g->function_count].index = g->function_count;
+      g->symbol_functions[stmt->as.fn.name] = g->function_count;
+      g->function_count++;
+      CollectFunctions(g, stmt->as.fn.body);
+      break;
+    }
+    case NODE_BLOCK_STATEMENT: {
+      const NodeId* statements = g->program->lists + stmt->as.block.first;
+      for (uint32_t i = 0; i < stmt->as.block.count; i++) {
+        CollectFunctions(g, statements[i]);
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+static int HasSideEffectsC(CGen* g, NodeId id) {
+  if (id == NO_NODE) {
+    return 0;
+  }
+  const AstNode* expr = NodeAtC(g, id);
+  switch (expr->type) {
+    case NODE_INFIX_EXPRESSION:
+      return expr->op == BIN_ASSIGN ||
+             HasSideEffectsC(g, expr->as.infix.left) || HasSideEffectsC(g, expr->as.infix.right);
+    case NODE_CALL_EXPRESSION:
+    case NODE_IF_EXPRESSION:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+// CCB evaluates operands left to right, C does not; a value that must be
+// read before a later side effect is moved into a temporary first.
+static char* Hoist(CGen* g, char* value) {
+  char* temp = Format("t%d", g->temp_count++);
+  Line(g, "int %s = %s;", temp, value);
+  free(value);
+  return temp;
+}
+
+static int SlotC(CGen* g, SymbolId name) {
+  for (int i = 0; i < g->slot_count; i++) {
+    if (g->slots[i] == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static char* VariableC(CGen* g, SymbolId name) {
+  if (FindLocalC(g, name) >= 0) {
+    return Format("l%d_%s", SlotC(g, name), NameC(g, name));
+  }
+  return Format("g[%d]", GlobalIndexC(g, name));
+}
+
+static char* EmitExpressionC(CGen* g, NodeId id) {
+  if (id == NO_NODE) {
+    return Format("0");
+  }
+
+  const AstNode* expr = NodeAtC(g, id);
+  switch (expr->type) {
+    case NODE_INTEGER_LITERAL:
+      return Format("%d", expr->as.value);
+    case NODE_IDENTIFIER:
+      return VariableC(g, expr->as.name);
+    case NODE_INFIX_EXPRESSION: {
+      if (expr->op == BIN_ASSIGN) {
+        char* value = EmitExpressionC(g, expr->as.infix.right);
+        char* target = VariableC(g, NodeAtC(g, expr->as.infix.left)->as.name);
+        char* s = Format("(%s = %s)", target, value);
+        free(value);
+        free(target);
+        return s;
+      }
+
+      char* left = EmitExpressionC(g, expr->as.infix.left);
+      if (NodeAtC(g, expr->as.infix.left)->type != NODE_INTEGER_LITERAL &&
+          HasSideEffectsC(g, expr->as.infix.right)) {
+        left = Hoist(g, left);
+      }
+      char* right = EmitExpressionC(g, expr->as.infix.right);
+      char* s;
+      const char* op = BinaryOpName((BinaryOp)expr->op);
+      if (expr->op == BIN_ADD || expr->op == BIN_SUBTRACT || expr->op == BIN_MULTIPLY) {
+        s = Format("CCB_WRAP(%s, %s, %s)", left, op, right);
+      } else {
+        s = Format("(%s %s %s)", left, op, right);
+      }
+      free(left);
+      free(right);
+      return s;
+    }
+    case NODE_CALL_EXPRESSION: {
+      const AstNode* callee = NodeAtC(g, expr->as.call.function);
+      if (callee->type != NODE_IDENTIFIER) {
+        printf("CODEGEN ERROR: %d:%d: call target must be an identifier.\n", expr->line, expr->column);
+        g->ok = 0;
+        return Format("0");
+      }
+      const char* name = NameC(g, callee->as.name);
+      CFunction* fn = FindFunctionC(g, callee->as.name);
+      if (fn == NULL) {
+        printf("CODEGEN ERROR: Undefined function '%s'\n", name);
+        g->ok = 0;
+        return Format("0");
+      }
+      int arg_count = (int)expr->as.call.arg_count;
+      const NodeId* arguments = g->program->lists + expr->as.call.args;
+      if ((int)fn->fn->as.fn.param_count != arg_count) {
+        printf("CODEGEN ERROR: '%s' expects %d arguments, got %d\n",
+               name, (int)fn->fn->as.fn.param_count, arg_count);
+        g->ok = 0;
+        return Format("0");
+      }
+
+      char** args = (char**)malloc(((size_t)arg_count + 1) * sizeof(char*));
+      size_t length = 0;
+      for (int i = 0; i < arg_count; i++) {
+        args[i] = EmitExpressionC(g, arguments[i]);
+        for (int k = i + 1; k < arg_count; k++) {
+          if (HasSideEffectsC(g, arguments[k])) {
+            args[i] = Hoist(g, args[i]);
+            break;
+          }
+        }
+        length += strlen(args[i]) + 2;
+      }
+
+      char* list = (char*)malloc(length + 1);
+      list[0] = '\0';
+      for (int i = 0; i < arg_count; i++) {
+        if (i > 0) {
+          strcat(list, ", ");
+        }
+        strcat(list, args[i]);
+        free(args[i]);
+      }
+      free(args);
+      char* s = Format("ccb_fn%d(%s)", fn->index, list);
+      free(list);
+      return s;
+    }
+    case NODE_IF_EXPRESSION:
+      EmitStatementC(g, id);
+      return Format("0");
+    default:
+      return Format("0");
+  }
+}
+
+// Comparisons come back wrapped in parentheses; inside if/while they are
+// redundant.
+static char* EmitConditionC(CGen* g, NodeId id) {
+  char* cond = EmitExpressionC(g, id);
+  size_t n = strlen(cond);
+  if (id != NO_NODE && NodeAtC(g, id)->type == NODE_INFIX_EXPRESSION && cond[0] == '(' && cond[n - 1] == ')') {
+    memmove(cond, cond + 1, n - 2);
+    cond[n - 2] = '\0';
+  }
+  return cond;
+}
+
+static void EmitBlockC(CGen* g, NodeId id) {
+  g->depth++;
+  if (id != NO_NODE) {
+    const AstNode* block = NodeAtC(g, id);
+    const NodeId* statements = g->program->lists + block->as.block.first;
+    for (uint32_t i = 0; i < block->as.block.count; i++) {
+      EmitStatementC(g, statements[i]);
+    }
+  }
+  g->depth--;
+}
+
+static void EmitStatementC(CGen* g, NodeId id) {
+  if (id == NO_NODE) {
+    return;
+  }
+
+  const AstNode* stmt = NodeAtC(g, id);
+  switch (stmt->type) {
+    case NODE_LET_STATEMENT: {
+      char* value = EmitExpressionC(g, stmt->as.let.value);
+      if (g->in_function && FindLocalC(g, stmt->as.let.name) < 0) {
+        if (g->local_count >= 256) {
+          printf("Too many locals.\n");
+          g->ok = 0;
+          free(value);
+          return;
+        }
+        g->locals[g->local_count++] = stmt->as.let.name;
+      }
+      char* target = VariableC(g, stmt->as.let.name);
+      Line(g, "%s = %s;", target, value);
+      free(target);
+      free(value);
+      break;
+    }
+    case NODE_EXPRESSION_STATEMENT: {
+      NodeId expression = stmt->as.expression;
+      const AstNode* e = expression != NO_NODE ? NodeAtC(g, expression) : NULL;
+      if (e != NULL && e->type == NODE_IF_EXPRESSION) {
+        EmitStatementC(g, expression);
+      } else if (e != NULL && e->type == NODE_INFIX_EXPRESSION && e->op == BIN_ASSIGN) {
+        char* value = EmitConditionC(g, expression);
+        Line(g, "%s;", value);
+        free(value);
+      } else {
+        char* value = EmitExpressionC(g, expression);
+        Line(g, "(void)%s;", value);
+        free(value);
+      }
+      break;
+    }
+    case NODE_OUT_STATEMENT: {
+      char* value = EmitExpressionC(g, stmt->as.expression);
+      Line(g, "ccb_out(%s);", value);
+      free(value);
+      break;
+    }
+    case NODE_IN_STATEMENT: {
+      if (g->in_function && FindLocalC(g, stmt->as.name) < 0) {
+        printf("CODEGEN ERROR: input to undeclared local '%s'\n", NameC(g, stmt->as.name));
+        g->ok = 0;
+        return;
+      }
+      char* target = VariableC(g, stmt->as.name);
+      Line(g, "%s = ccb_in();", target);
+      free(target);
+      break;
+    }
+    case NODE_BLOCK_STATEMENT: {
+      const NodeId* statements = g->program->lists + stmt->as.block.first;
+      for (uint32_t i = 0; i < stmt->as.block.count; i++) {
+        EmitStatementC(g, statements[i]);
+      }
+      break;
+    }
+    case NODE_IF_EXPRESSION: {
+      char* cond = EmitConditionC(g, stmt->as.branch.condition);
+      Line(g, "if (%s) {", cond);
+      free(cond);
+      EmitBlockC(g, stmt->as.branch.consequence);
+      if (stmt->as.branch.alternative != NO_NODE) {
+        Line(g, "} else {");
+        EmitBlockC(g, stmt->as.branch.alternative);
+      }
+      Line(g, "}");
+      break;
+    }
+    case NODE_WHILE_STATEMENT: {
+      if (!HasSideEffectsC(g, stmt->as.loop.condition)) {
+        char* cond = EmitConditionC(g, stmt->as.loop.condition);
+        Line(g, "while (%s) {", cond);
+        free(cond);
+      } else {
+        Line(g, "for (;;) {");
+        g->depth++;
+        char* cond = EmitExpressionC(g, stmt->as.loop.condition);
+        Line(g, "if (!%s) break;", cond);
+        free(cond);
+        g->depth--;
+      }
+      EmitBlockC(g, stmt->as.loop.body);
+      Line(g, "}");
+      break;
+    }
+    case NODE_FUNCTION_STATEMENT:
+      break;
+    case NODE_RETURN_STATEMENT: {
+      char* value = EmitExpressionC(g, stmt->as.expression);
+      if (g->in_function) {
+        if (HasSideEffectsC(g, stmt->as.expression)) {
+          value = Hoist(g, value);
+        }
+        Line(g, "ccb_depth--;");
+        Line(g, "return %s;", value);
+      } else {
+        Line(g, "(void)%s;", value);
+        Line(g, "ccb_flush();");
+        Line(g, "return 0;");
+      }
+      free(value);
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+// Locals are declared up front: CCB scopes them to the whole function.
+// The walk matches the one codegen assigns stack slots in, so that the slot
+// numbers in the C names match the bytecode.
+static void DeclareLocals(CGen* g, NodeId id) {
+  if (id == NO_NODE) {
+    return;
+  }
+  const AstNode* node = NodeAtC(g, id);
+  switch (node->type) {
+    case NODE_LET_STATEMENT: {
+      SymbolId name = node->as.let.name;
+      if (SlotC(g, name) < 0 && g->slot_count < 256) {
+        Line(g, "int l%d_%s = 0;", g->slot_count, NameC(g, name));
+        g->slots[g->slot_count++] = name;
+      }
+      DeclareLocals(g, node->as.let.value);
+      break;
+    }
+    case NODE_EXPRESSION_STATEMENT:
+    case NODE_OUT_STATEMENT:
+    case NODE_RETURN_STATEMENT:
+      DeclareLocals(g, node->as.expression);
+      break;
+    case NODE_INFIX_EXPRESSION:
+      DeclareLocals(g, node->as.infix.left);
+      DeclareLocals(g, node->as.infix.right);
+      break;
+    case NODE_IF_EXPRESSION:
+      DeclareLocals(g, node->as.branch.condition);
+      DeclareLocals(g, node->as.branch.consequence);
+      DeclareLocals(g, node->as.branch.alternative);
+      break;
+    case NODE_WHILE_STATEMENT:
+      DeclareLocals(g, node->as.loop.condition);
+      DeclareLocals(g, node->as.loop.body);
+      break;
+    case NODE_BLOCK_STATEMENT: {
+      const NodeId* statements = g->program->lists + node->as.block.first;
+      for (uint32_t i = 0; i < node->as.block.count; i++) {
+        DeclareLocals(g, statements[i]);
+      }
+      break;
+    }
+    case NODE_CALL_EXPRESSION: {
+      const NodeId* args = g->program->lists + node->as.call.args;
+      for (uint32_t i = 0; i < node->as.call.arg_count; i++) {
+        DeclareLocals(g, args[i]);
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+static void FunctionSignature(CGen* g, FILE* out, CFunction* f, const char* end) {
+  const AstNode* fn = f->fn;
+  const SymbolId* params = g->program->lists + fn->as.fn.params;
+  int param_count = (int)fn->as.fn.param_count;
+  fprintf(out, "static int ccb_fn%d(", f->index);
+  if (param_count == 0) {
+    fprintf(out, "void");
+  }
+  for (int i = 0; i < param_count; i++) {
+    fprintf(out, "%sint l%d_%s", i > 0 ? ", " : "", i, NameC(g, params[i]));
+  }
+  fprintf(out, ")%s  /* %s */\n", end, NameC(g, fn->as.fn.name));
+}
+
+static void EmitFunctionC(CGen* g, CFunction* f) {
+  const AstNode* fn = f->fn;
+  const SymbolId* params = g->program->lists + fn->as.fn.params;
+  FunctionSignature(g, g->out, f, " {");
+
+  g->in_function = 1;
+  g->local_count = 0;
+  g->temp_count = 0;
+  g->depth = 1;
+  for (uint32_t i = 0; i < fn->as.fn.param_count && i < 256; i++) {
+    g->locals[g->local_count++] = params[i];
+  }
+  g->slot_count = g->local_count;
+  memcpy(g->slots, g->locals, (size_t)g->slot_count * sizeof(SymbolId));
+  DeclareLocals(g, fn->as.fn.body);
+
+  // Only the frame count is bounded, as in the register VM: the stack VM's
+  // 256-value stack has no counterpart here, so deeper recursion can finish.
+  Line(g, "if (ccb_depth >= CCB_CALLSTACK_MAX) ccb_overflow();");
+  Line(g, "ccb_depth++;");
+  g->depth = 0;
+  EmitBlockC(g, fn->as.fn.body);
+  g->depth = 1;
+  const AstNode* body = NodeAtC(g, fn->as.fn.body);
+  uint32_t count = fn->as.fn.body != NO_NODE ? body->as.block.count : 0;
+  if (count == 0 || NodeAtC(g, g->program->lists[body->as.block.first + count - 1])->type != NODE_RETURN_STATEMENT) {
+    Line(g, "ccb_depth--;");
+    Line(g, "return 0;");
+  }
+  fprintf(g->out, "}\n\n");
+  g->in_function = 0;
+  g->depth = 0;
+}
+
+static const char* prelude =
+  "#include <stdio.h>\n"
+  "#include <stdlib.h>\n"
+  "#include <string.h>\n"
+  "#include <unistd.h>\n"
+  "\n"
+  "#define CCB_WRAP(a, op, b) ((int)((unsigned)(a) op (unsigned)(b)))\n"
+  "\n"
+  "static char ccb_buf[1 << 16];\n"
+  "static size_t ccb_len;\n"
+  "\n"
+  "static void ccb_flush(void) {\n"
+  "  size_t done = 0;\n"
+  "  while (done < ccb_len) {\n"
+  "    ssize_t n = write(STDOUT_FILENO, ccb_buf + done, ccb_len - done);\n"
+  "    if (n <= 0) break;\n"
+  "    done += (size_t)n;\n"
+  "  }\n"
+  "  ccb_len = 0;\n"
+  "}\n"
+  "\n"
+  "static inline void ccb_out(int v) {\n"
+  "  char tmp[12];\n"
+  "  int n = 0;\n"
+  "  unsigned u = v < 0 ? 0u - (unsigned)v : (unsigned)v;\n"
+  "  if (ccb_len + sizeof(tmp) + 1 > sizeof(ccb_buf)) ccb_flush();\n"
+  "  do { tmp[n++] = (char)('0' + u % 10); u /= 10; } while (u != 0);\n"
+  "  if (v < 0) ccb_buf[ccb_len++] = '-';\n"
+  "  while (n > 0) ccb_buf[ccb_len++] = tmp[--n];\n"
+  "  ccb_buf[ccb_len++] = '\\n';\n"
+  "}\n"
+  "\n"
+  "static inline int ccb_in(void) {\n"
+  "  int c, neg = 0, any = 0;\n"
+  "  unsigned v = 0;\n"
+  "  ccb_flush();\n"
+  "  do { c = getchar_unlocked(); } while (c == ' ' || (c >= '\\t' && c <= '\\r'));\n"
+  "  if (c == '-' || c == '+') { neg = c == '-'; c = getchar_unlocked(); }\n"
+  "  while (c >= '0' && c <= '9') { v = v * 10 + (unsigned)(c - '0'); any = 1; c = getchar_unlocked(); }\n"
+  "  if (!any) {\n"
+  "    while (c != '\\n' && c != EOF) c = getchar_unlocked();\n"
+  "    return 0;\n"
+  "  }\n"
+  "  if (c != EOF) ungetc(c, stdin);\n"
+  "  return (int)(neg ? 0u - v : v);\n"
+  "}\n"
+  "\n";
+
+// Functions count their nesting against the VM's frame limit and fail the
+// same way: exit status 70 after flushing the output.
+static const char* call_guard =
+  "static int ccb_depth;\n"
+  "\n"
+  "static void ccb_overflow(void) {\n"
+  "  ccb_flush();\n"
+  "  fprintf(stderr, \"RUNTIME ERROR: call stack overflow.\\n\");\n"
+  "  exit(70);\n"
+  "}\n"
+  "\n";
+
+int EmitProgramC(Program* program, const char* source_name, FILE* out) {
+  CGen g;
+  memset(&g, 0, sizeof(g));
+  g.out = tmpfile();
+  g.ok = 1;
+  if (g.out == NULL) {
+    perror("CODEGEN ERROR: tmpfile");
+    return 0;
+  }
+  g.program = program;
+  size_t symbols = (size_t)program->symbol_count + 1;
+  g.symbol_globals = (int*)malloc(symbols * sizeof(int));
+  g.symbol_functions = (int*)malloc(symbols * sizeof(int));
+  memset(g.symbol_globals, 0xff, symbols * sizeof(int));
+  memset(g.symbol_functions, 0xff, symbols * sizeof(int));
+
+  const NodeId* statements = program->lists + program->statements;
+  for (uint32_t i = 0; i < program->statement_count; i++) {
+    CollectFunctions(&g, statements[i]);
+  }
+
+  for (int i = 0; i < g.function_count; i++) {
+    EmitFunctionC(&g, &g.functions[i]);
+  }
+
+  fprintf(g.out, "int main(void) {\n");
+  g.depth = 1;
+  for (uint32_t i = 0; i < program->statement_count; i++) {
+    EmitStatementC(&g, statements[i]);
+  }
+  Line(&g, "ccb_flush();");
+  Line(&g, "return 0;");
+  fprintf(g.out, "}\n");
+
+  if (g.ok) {
+    fprintf(out, "/* Generated by the CCB compiler from %s. */\n\n", source_name);
+    fputs(prelude, out);
+    if (g.function_count > 0) {
+      fprintf(out, "#define CCB_CALLSTACK_MAX %d\n\n", CALLSTACK_MAX);
+      fputs(call_guard, out);
+    }
+    if (g.global_count > 0) {
+      fprintf(out, "static int g[%d];\n", g.global_count);
+    }
+    for (int i = 0; i < g.function_count; i++) {
+      FunctionSignature(&g, out, &g.functions[i], ";");
+    }
+    if (g.global_count > 0 || g.function_count > 0) {
+      fprintf(out, "\n");
+    }
+    FILE* body = g.out;
+    rewind(body);
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), body)) > 0) {
+      fwrite(buffer, 1, n, out);
+    }
+    fclose(body);
+  } else {
+    fclose(g.out);
+  }
+
+  free(g.symbol_globals);
+  free(g.symbol_functions);
+  free(g.functions);
+  return g.ok;
+}
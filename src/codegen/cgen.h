@@ -0,0 +1,9 @@
+#ifndef CGEN_H
+#define CGEN_H
+
+#include <stdio.h>
+#include "../parser/parser.h"
+
+int EmitProgramC(Program* program, const char* source_name, FILE* out);
+
+#endif
@@ -1,37 +1,51 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include "codegen.h"
 
 typedef struct {
-  char* name;
+  SymbolId name;
   int index;
 } Local;
 
 typedef struct {
   Chunk* chunk;
+  const Program* program;
   char* strings[256];
   int string_count;
+  // Per symbol: its slot in strings and in functions, or -1.
+  int* symbol_strings;
+  int* symbol_functions;
 
-  char* fn_names[256];
-  int fn_offsets[256];
+  ChunkFunction* functions;
   int fn_count;
+  int fn_capacity;
 
-  struct {
-    char* name;
+  struct Unresolved {
+    SymbolId name;
     int patch_pos;
-  } unresolved[512];
+    int line;
+    int column;
+  }* unresolved;
   int unresolved_count;
+  int unresolved_capacity;
 
   int in_function;
   Local locals[256];
   int param_count;
   int local_count;
+  // Names of the slots after the parameters, one per distinct `let` name
+  // of the current function; they are pushed on entry.
+  SymbolId slots[256];
+  int slot_count;
+
+  int had_error;
 } Compiler;
 
-void CompileNode(Compiler* compiler, Node* node);
-void CompileExpression(Compiler* compiler, Expression* expr);
-void CompileStatement(Compiler* compiler, Statement* stmt);
+void CompileNode(Compiler* compiler, NodeId id);
+void CompileExpression(Compiler* compiler, NodeId id);
+void CompileStatement(Compiler* compiler, NodeId id);
 
 void InitChunk(Chunk* chunk) {
   chunk->count = 0;
@@ -40,6 +54,15 @@ void InitChunk(Chunk* chunk) {
   chunk->constants = NULL;
   chunk->constants_count = 0;
   chunk->constants_capacity = 0;
+  chunk->names = NULL;
+  chunk->names_count = 0;
+  chunk->functions = NULL;
+  chunk->function_count = 0;
+  chunk->lines = NULL;
+  chunk->line_count = 0;
+  chunk->line_capacity = 0;
+  chunk->mapping = NULL;
+  chunk->mapping_size = 0;
 }
 
 void WriteChunk(Chunk* chunk, uint8_t byte) {
@@ -53,8 +76,23 @@ void WriteChunk(Chunk* chunk, uint8_t byte) {
 }
 
 void FreeChunk(Chunk* chunk) {
-  free(chunk->code);
-  free(chunk->constants);
+  if (chunk->mapping != NULL) {
+    // Names and function names live inside the mapping too; only the
+    // pointer tables were allocated.
+    munmap(chunk->mapping, chunk->mapping_size);
+  } else {
+    free(chunk->code);
+    free(chunk->constants);
+    for (int i = 0; i < chunk->names_count; i++) {
+      free(chunk->names[i]);
+    }
+    for (int i = 0; i < chunk->function_count; i++) {
+      free(chunk->functions[i].name);
+    }
+    free(chunk->lines);
+  }
+  free(chunk->names);
+  free(chunk->functions);
   InitChunk(chunk);
 }
 
@@ -68,38 +106,94 @@ int AddConstant(Chunk* chunk, Value value) {
   return chunk->constants_count++;
 }
 
-static int FindFunction(Compiler* c, const char* name) {
-  for (int i = 0; i < c->fn_count; i++) {
-    if (strcmp(c->fn_names[i], name) == 0) {
-      return c->fn_offsets[i];
+// Starts a new run at the current end of the code unless the line is
+// unchanged; a run that has not covered any code yet is reused.
+void AddLine(Chunk* chunk, int line) {
+  if (chunk->line_count > 0) {
+    LineRun* last = &chunk->lines[chunk->line_count - 1];
+    if (last->line == line) {
+      return;
+    }
+    if (last->offset == chunk->count) {
+      last->line = line;
+      if (chunk->line_count > 1 && chunk->lines[chunk->line_count - 2].line == line) {
+        chunk->line_count--;
+      }
+      return;
     }
   }
-  return -1;
+  if (chunk->line_capacity < chunk->line_count + 1) {
+    int old_capacity = chunk->line_capacity;
+    chunk->line_capacity = old_capacity < 8 ? 8 : old_capacity * 2;
+    chunk->lines = realloc(chunk->lines, chunk->line_capacity * sizeof(LineRun));
+  }
+  chunk->lines[chunk->line_count].offset = chunk->count;
+  chunk->lines[chunk->line_count].line = line;
+  chunk->line_count++;
 }
 
-static void RegisterFunction(Compiler* c, const char* name, int offset) {
-  for (int i = 0; i < c->fn_count; i++) {
-    if (strcmp(c->fn_names[i], name) == 0) {
-      c->fn_offsets[i] = offset;
-      return;
+int LineForOffset(const Chunk* chunk, int offset) {
+  int lo = 0;
+  int hi = chunk->line_count - 1;
+  int line = 0;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (chunk->lines[mid].offset <= offset) {
+      line = chunk->lines[mid].line;
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
     }
   }
-  if (c->fn_count >= 256) {
-    printf("Too many functions.\n");
-    exit(1);
+  return line;
+}
+
+static const char* Name(Compiler* c, SymbolId name) {
+  return c->program->symbols[name];
+}
+
+static int FindFunction(Compiler* c, SymbolId name) {
+  int index = c->symbol_functions[name];
+  return index < 0 ? -1 : c->functions[index].offset;
+}
+
+static void RegisterFunction(Compiler* c, SymbolId name, int offset) {
+  int index = c->symbol_functions[name];
+  if (index >= 0) {
+    c->functions[index].offset = offset;
+    return;
+  }
+  if (c->fn_capacity < c->fn_count + 1) {
+    c->fn_capacity = c->fn_capacity < 16 ? 16 : c->fn_capacity * 2;
+    c->functions = realloc(c->functions, c->fn_capacity * sizeof(ChunkFunction));
   }
-  c->fn_names[c->fn_count] = strdup(name);
-  c->fn_offsets[c->fn_count] = offset;
+  c->functions[c->fn_count].name = strdup(Name(c, name));
+  c->functions[c->fn_count].offset = offset;
+  c->symbol_functions[name] = c->fn_count;
   c->fn_count++;
 }
 
-static void AddUnresolved(Compiler* c, const char* name, int patch_pos) {
-  if (c->unresolved_count >= 512) {
-    printf("Too many unresolved calls.\n");
-    exit(1);
+// OP_CALL addresses its target with 16 bits, so functions must start in
+// the first 64K of code.
+static void WriteCallTarget(Compiler* c, int patch_pos, int offset, int line, int column) {
+  if (offset > UINT16_MAX) {
+    printf("CODEGEN ERROR: %d:%d: Function entry beyond 64K of code.\n", line, column);
+    c->had_error = 1;
+    return;
+  }
+  c->chunk->code[patch_pos] = (offset >> 8) & 0xff;
+  c->chunk->code[patch_pos + 1] = offset & 0xff;
+}
+
+static void AddUnresolved(Compiler* c, SymbolId name, int patch_pos, const AstNode* site) {
+  if (c->unresolved_capacity < c->unresolved_count + 1) {
+    c->unresolved_capacity = c->unresolved_capacity < 16 ? 16 : c->unresolved_capacity * 2;
+    c->unresolved = realloc(c->unresolved, c->unresolved_capacity * sizeof(struct Unresolved));
   }
-  c->unresolved[c->unresolved_count].name = strdup(name);
+  c->unresolved[c->unresolved_count].name = name;
   c->unresolved[c->unresolved_count].patch_pos = patch_pos;
+  c->unresolved[c->unresolved_count].line = site->line;
+  c->unresolved[c->unresolved_count].column = site->column;
   c->unresolved_count++;
 }
 
@@ -107,27 +201,28 @@ static void PatchUnresolved(Compiler* c) {
   for (int i = 0; i < c->unresolved_count; i++) {
     int off = FindFunction(c, c->unresolved[i].name);
     if (off < 0) {
-      printf("CODEGEN ERROR: Undefined function '%s'\n", c->unresolved[i].name);
-      exit(1);
+      printf("CODEGEN ERROR: %d:%d: Undefined function '%s'\n",
+             c->unresolved[i].line, c->unresolved[i].column, Name(c, c->unresolved[i].name));
+      c->had_error = 1;
+      continue;
     }
-    c->chunk->code[c->unresolved[i].patch_pos] = (off >> 8) & 0xff;
-    c->chunk->code[c->unresolved[i].patch_pos + 1] = off & 0xff;
-    free(c->unresolved[i].name);
+    WriteCallTarget(c, c->unresolved[i].patch_pos, off, c->unresolved[i].line, c->unresolved[i].column);
   }
   c->unresolved_count = 0;
 }
 
-uint8_t IdentifierConstant(Compiler* compiler, const char* name) {
-  for (int i = 0; i < compiler->string_count; i++) {
-    if (strcmp(compiler->strings[i], name) == 0) {
-      return (uint8_t)i;
-    }
+uint8_t IdentifierConstant(Compiler* compiler, SymbolId name) {
+  int index = compiler->symbol_strings[name];
+  if (index >= 0) {
+    return (uint8_t)index;
   }
   if (compiler->string_count == 256) {
     printf("Too many string constants.\n");
-    exit(1);
+    compiler->had_error = 1;
+    return 0;
   }
-  compiler->strings[compiler->string_count] = strdup(name);
+  compiler->strings[compiler->string_count] = strdup(Name(compiler, name));
+  compiler->symbol_strings[name] = compiler->string_count;
   return (uint8_t)compiler->string_count++;
 }
 
@@ -142,7 +237,8 @@ void PatchJump(Compiler* compiler, int offset_pos) {
   int jump = compiler->chunk->count - offset_pos;
   if (jump > UINT16_MAX) {
     printf("ERROR: Too much code to jump over.\n");
-    exit(1);
+    compiler->had_error = 1;
+    return;
   }
   compiler->chunk->code[offset_pos] = (jump >> 8) & 0xff;
   compiler->chunk->code[offset_pos + 1] = jump & 0xff;
@@ -153,60 +249,166 @@ void EmitLoop(Compiler* compiler, int loop_start) {
   int offset = compiler->chunk->count - loop_start;
   if (offset > UINT16_MAX) {
     printf("ERROR: Loop body too large.\n");
-    exit(1);
+    compiler->had_error = 1;
+    return;
   }
   WriteChunk(compiler->chunk, (offset >> 8) & 0xff);
   WriteChunk(compiler->chunk, offset & 0xff);
 }
 
-static int FindLocal(Compiler* c, const char* name) {
+static int FindLocal(Compiler* c, SymbolId name) {
   if (!c->in_function) {
     return -1;
   }
   int total = c->param_count + c->local_count;
   for (int i = 0; i < total; i++) {
-    if (strcmp(c->locals[i].name, name) == 0) {
+    if (c->locals[i].name == name) {
       return c->locals[i].index;
     }
   }
   return -1;
 }
 
+// Gives every `let` name of a function body one slot, so that a `let`
+// that runs repeatedly (in a loop) or not at all (in a skipped branch)
+// keeps the frame layout fixed. Nested functions get their own slots.
+// Returns the number of `let` statements under id; with reserve unset it
+// only counts them.
+static int ReserveLocals(Compiler* c, NodeId id, int reserve) {
+  if (id == NO_NODE) {
+    return 0;
+  }
+
+  const Program* program = c->program;
+  const AstNode* node = &program->nodes[id];
+  switch (node->type) {
+    case NODE_LET_STATEMENT: {
+      SymbolId name = node->as.let.name;
+      int known = !reserve;
+      for (int i = 0; i < c->param_count && !known; i++) {
+        known = c->locals[i].name == name;
+      }
+      for (int i = 0; i < c->slot_count && !known; i++) {
+        known = c->slots[i] == name;
+      }
+      if (!known) {
+        if (c->param_count + c->slot_count >= 256) {
+          printf("Too many locals.\n");
+          c->had_error = 1;
+        } else {
+          c->slots[c->slot_count++] = name;
+        }
+      }
+      return 1 + ReserveLocals(c, node->as.let.value, reserve);
+    }
+    case NODE_EXPRESSION_STATEMENT:
+    case NODE_OUT_STATEMENT:
+    case NODE_RETURN_STATEMENT:
+      return ReserveLocals(c, node->as.expression, reserve);
+    case NODE_INFIX_EXPRESSION:
+      return ReserveLocals(c, node->as.infix.left, reserve) +
+             ReserveLocals(c, node->as.infix.right, reserve);
+    case NODE_IF_EXPRESSION:
+      return ReserveLocals(c, node->as.branch.condition, reserve) +
+             ReserveLocals(c, node->as.branch.consequence, reserve) +
+             ReserveLocals(c, node->as.branch.alternative, reserve);
+    case NODE_WHILE_STATEMENT:
+      return ReserveLocals(c, node->as.loop.condition, reserve) +
+             ReserveLocals(c, node->as.loop.body, reserve);
+    case NODE_BLOCK_STATEMENT: {
+      const NodeId* statements = program->lists + node->as.block.first;
+      int count = 0;
+      for (uint32_t i = 0; i < node->as.block.count; i++) {
+        count += ReserveLocals(c, statements[i], reserve);
+      }
+      return count;
+    }
+    case NODE_CALL_EXPRESSION: {
+      const NodeId* args = program->lists + node->as.call.args;
+      int count = 0;
+      for (uint32_t i = 0; i < node->as.call.arg_count; i++) {
+        count += ReserveLocals(c, args[i], reserve);
+      }
+      return count;
+    }
+    default: return 0;
+  }
+}
+
+static int ReservedSlot(Compiler* c, SymbolId name) {
+  for (int i = 0; i < c->slot_count; i++) {
+    if (c->slots[i] == name) {
+      return c->param_count + i;
+    }
+  }
+  return -1;
+}
+
 Chunk* Compile(Program* program) {
   Compiler compiler;
+  compiler.program = program;
   compiler.string_count = 0;
+  compiler.functions = NULL;
   compiler.fn_count = 0;
+  compiler.fn_capacity = 0;
+  compiler.unresolved = NULL;
   compiler.unresolved_count = 0;
+  compiler.unresolved_capacity = 0;
   compiler.in_function = 0;
   compiler.param_count = 0;
   compiler.local_count = 0;
+  compiler.slot_count = 0;
+  compiler.had_error = 0;
+
+  size_t symbols = (size_t)program->symbol_count + 1;
+  compiler.symbol_strings = (int*)malloc(symbols * sizeof(int));
+  compiler.symbol_functions = (int*)malloc(symbols * sizeof(int));
+  memset(compiler.symbol_strings, 0xff, symbols * sizeof(int));
+  memset(compiler.symbol_functions, 0xff, symbols * sizeof(int));
 
   Chunk* chunk = (Chunk*)malloc(sizeof(Chunk));
   InitChunk(chunk);
   compiler.chunk = chunk;
 
-  for (int i = 0; i < program->statement_count; i++) {
-    CompileNode(&compiler, (Node*)program->statements[i]);
+  const NodeId* statements = program->lists + program->statements;
+  for (uint32_t i = 0; i < program->statement_count; i++) {
+    CompileNode(&compiler, statements[i]);
   }
 
   PatchUnresolved(&compiler);
+  free(compiler.unresolved);
+  free(compiler.symbol_strings);
+  free(compiler.symbol_functions);
 
   WriteChunk(compiler.chunk, OP_RETURN);
-  return compiler.chunk;
+
+  chunk->names = (char**)malloc((compiler.string_count + 1) * sizeof(char*));
+  memcpy(chunk->names, compiler.strings, compiler.string_count * sizeof(char*));
+  chunk->names_count = compiler.string_count;
+
+  chunk->functions = compiler.functions;
+  chunk->function_count = compiler.fn_count;
+
+  if (compiler.had_error) {
+    FreeChunk(chunk);
+    free(chunk);
+    return NULL;
+  }
+  return chunk;
 }
 
-void CompileNode(Compiler* compiler, Node* node) {
-  if (node == NULL) {
+void CompileNode(Compiler* compiler, NodeId id) {
+  if (id == NO_NODE) {
     return;
   }
 
-  switch (node->type) {
+  switch (compiler->program->nodes[id].type) {
     case NODE_IDENTIFIER:
     case NODE_INTEGER_LITERAL:
     case NODE_INFIX_EXPRESSION:
     case NODE_IF_EXPRESSION:
     case NODE_CALL_EXPRESSION:
-      CompileExpression(compiler, (Expression*)node);
+      CompileExpression(compiler, id);
       break;
 
     case NODE_LET_STATEMENT:
@@ -217,214 +419,258 @@ void CompileNode(Compiler* compiler, Node* node) {
     case NODE_IN_STATEMENT:
     case NODE_FUNCTION_STATEMENT:
     case NODE_RETURN_STATEMENT:
-      CompileStatement(compiler, (Statement*)node);
+      CompileStatement(compiler, id);
       break;
 
     default:
-      printf("CODEGEN ERROR: Unknown node type %d\n", node->type);
+      printf("CODEGEN ERROR: Unknown node type %d\n", compiler->program->nodes[id].type);
       break;
   }
 }
 
-static void EnsureFunctionReturn(Compiler* c) {
-  int const_index = AddConstant(c->chunk, 0);
+// Equal literals share a pool slot; OP_CONSTANT has an 8-bit operand, so
+// at most 256 distinct values fit.
+static void EmitConstant(Compiler* c, Value value) {
+  int index = -1;
+  for (int i = 0; i < c->chunk->constants_count; i++) {
+    if (c->chunk->constants[i] == value) {
+      index = i;
+      break;
+    }
+  }
+  if (index < 0) {
+    if (c->chunk->constants_count == 256) {
+      printf("Too many constants.\n");
+      c->had_error = 1;
+      return;
+    }
+    index = AddConstant(c->chunk, value);
+  }
   WriteChunk(c->chunk, OP_CONSTANT);
-  WriteChunk(c->chunk, (uint8_t)const_index);
+  WriteChunk(c->chunk, (uint8_t)index);
+}
+
+static void EnsureFunctionReturn(Compiler* c) {
+  EmitConstant(c, 0);
   WriteChunk(c->chunk, OP_RETURN);
 }
 
-void CompileExpression(Compiler* compiler, Expression* expr) {
-  if (expr == NULL) {
+void CompileExpression(Compiler* compiler, NodeId id) {
+  if (id == NO_NODE) {
     return;
   }
 
-  switch (expr->node.type) {
+  const Program* program = compiler->program;
+  const AstNode* expr = &program->nodes[id];
+  switch (expr->type) {
     case NODE_INTEGER_LITERAL: {
-      IntegerLiteral* lit = (IntegerLiteral*)expr;
-      int const_index = AddConstant(compiler->chunk, lit->value);
-      WriteChunk(compiler->chunk, OP_CONSTANT);
-      WriteChunk(compiler->chunk, (uint8_t)const_index);
+      EmitConstant(compiler, expr->as.value);
       break;
     }
     case NODE_IDENTIFIER: {
-      Identifier* ident = (Identifier*)expr;
-      int li = FindLocal(compiler, ident->value);
+      int li = FindLocal(compiler, expr->as.name);
       if (li >= 0) {
         WriteChunk(compiler->chunk, OP_GET_LOCAL);
         WriteChunk(compiler->chunk, (uint8_t)li);
       } else {
-        uint8_t arg = IdentifierConstant(compiler, ident->value);
+        uint8_t arg = IdentifierConstant(compiler, expr->as.name);
         WriteChunk(compiler->chunk, OP_GET_GLOBAL);
         WriteChunk(compiler->chunk, arg);
       }
       break;
     }
     case NODE_INFIX_EXPRESSION: {
-      InfixExpression* infix = (InfixExpression*)expr;
-      if (strcmp(infix->operator, "=") == 0) {
-        CompileExpression(compiler, infix->right);
-        Identifier* ident = (Identifier*)infix->left;
-        int li = FindLocal(compiler, ident->value);
+      if (expr->op == BIN_ASSIGN) {
+        CompileExpression(compiler, expr->as.infix.right);
+        SymbolId name = program->nodes[expr->as.infix.left].as.name;
+        int li = FindLocal(compiler, name);
         if (li >= 0) {
           WriteChunk(compiler->chunk, OP_SET_LOCAL);
           WriteChunk(compiler->chunk, (uint8_t)li);
         } else {
-          uint8_t arg = IdentifierConstant(compiler, ident->value);
+          uint8_t arg = IdentifierConstant(compiler, name);
           WriteChunk(compiler->chunk, OP_SET_GLOBAL);
           WriteChunk(compiler->chunk, arg);
         }
       } else {
-        CompileExpression(compiler, infix->left);
-        CompileExpression(compiler, infix->right);
-        if (strcmp(infix->operator, "+") == 0) {
-          WriteChunk(compiler->chunk, OP_ADD);
-        } else if (strcmp(infix->operator, "-") == 0) {
-          WriteChunk(compiler->chunk, OP_SUBTRACT);
-        } else if (strcmp(infix->operator, "*") == 0) {
-          WriteChunk(compiler->chunk, OP_MULTIPLY);
-        } else if (strcmp(infix->operator, "/") == 0) {
-          WriteChunk(compiler->chunk, OP_DIVIDE);
-        } else if (strcmp(infix->operator, "<") == 0) {
-          WriteChunk(compiler->chunk, OP_LESS);
-        } else if (strcmp(infix->operator, ">") == 0) {
-          WriteChunk(compiler->chunk, OP_GREATER);
-        } else if (strcmp(infix->operator, "<=") == 0) {
-          WriteChunk(compiler->chunk, OP_LESS_EQUAL);
-        } else if (strcmp(infix->operator, ">=") == 0) {
-          WriteChunk(compiler->chunk, OP_GREATER_EQUAL);
-        } else if (strcmp(infix->operator, "==") == 0) { 
-          WriteChunk(compiler->chunk, OP_EQUAL);
-        } else if (strcmp(infix->operator, "!=") == 0) {
-          WriteChunk(compiler->chunk, OP_NOT_EQUAL);
-        }
+        CompileExpression(compiler, expr->as.infix.left);
+        CompileExpression(compiler, expr->as.infix.right);
+        WriteChunk(compiler->chunk, (uint8_t)(OP_ADD + expr->op));
       }
       break;
     }
     case NODE_IF_EXPRESSION: {
-      IfExpression* if_exp = (IfExpression*)expr;
-      CompileExpression(compiler, if_exp->condition);
+      CompileExpression(compiler, expr->as.branch.condition);
       int then_jump = EmitJump(compiler, OP_JUMP_IF_FALSE);
-      CompileStatement(compiler, (Statement*)if_exp->consequence);
+      CompileStatement(compiler, expr->as.branch.consequence);
       int else_jump = EmitJump(compiler, OP_JUMP);
       PatchJump(compiler, then_jump);
-      if (if_exp->alternative != NULL) {
-        CompileStatement(compiler, (Statement*)if_exp->alternative);
-      }
+      CompileStatement(compiler, expr->as.branch.alternative);
       PatchJump(compiler, else_jump);
       break;
     }
     case NODE_CALL_EXPRESSION: {
-      CallExpression* call = (CallExpression*)expr;
-      for (int i = 0; i < call->arg_count; i++) {
-        CompileExpression(compiler, call->arguments[i]);
+      const NodeId* args = program->lists + expr->as.call.args;
+      for (uint32_t i = 0; i < expr->as.call.arg_count; i++) {
+        CompileExpression(compiler, args[i]);
       }
-      if (call->function->node.type != NODE_IDENTIFIER) {
-        printf("CODEGEN ERROR: call target must be an identifier.\n");
-        exit(1);
+      const AstNode* callee = &program->nodes[expr->as.call.function];
+      if (callee->type != NODE_IDENTIFIER) {
+        printf("CODEGEN ERROR: %d:%d: call target must be an identifier.\n",
+               expr->line, expr->column);
+        compiler->had_error = 1;
+        break;
       }
-      Identifier* ident = (Identifier*)call->function;
-      int off = FindFunction(compiler, ident->value);
+      int off = FindFunction(compiler, callee->as.name);
       WriteChunk(compiler->chunk, OP_CALL);
       int pos = compiler->chunk->count;
+      WriteChunk(compiler->chunk, 0xff);
+      WriteChunk(compiler->chunk, 0xff);
       if (off < 0) {
-        WriteChunk(compiler->chunk, 0xff);
-        WriteChunk(compiler->chunk, 0xff);
-        AddUnresolved(compiler, ident->value, pos);
+        AddUnresolved(compiler, callee->as.name, pos, expr);
       } else {
-        WriteChunk(compiler->chunk, (off >> 8) & 0xff);
-        WriteChunk(compiler->chunk, off & 0xff);
+        WriteCallTarget(compiler, pos, off, expr->line, expr->column);
       }
-      WriteChunk(compiler->chunk, (uint8_t)call->arg_count);
+      WriteChunk(compiler->chunk, (uint8_t)expr->as.call.arg_count);
       break;
     }
     default: break;
   }
 }
 
-void CompileStatement(Compiler* compiler, Statement* stmt) {
-  if (stmt == NULL) {
+// A `let` at the top level of the function body that declares the next
+// unpushed slot keeps its value on the stack as that slot; the remaining
+// slots are pushed as zeros before the first statement that holds any
+// other `let`. Statements without one leave the stack as they found it.
+static void CompileFunctionBody(Compiler* c, NodeId body) {
+  const Program* program = c->program;
+  const AstNode* block = &program->nodes[body];
+  if (body == NO_NODE || block->type != NODE_BLOCK_STATEMENT) {
+    for (int i = 0; i < c->slot_count; i++) {
+      EmitConstant(c, 0);
+    }
+    CompileStatement(c, body);
+    return;
+  }
+
+  int pushed = 0;
+  const NodeId* statements = program->lists + block->as.block.first;
+  for (uint32_t i = 0; i < block->as.block.count; i++) {
+    const AstNode* stmt = &program->nodes[statements[i]];
+    if (pushed < c->slot_count && statements[i] != NO_NODE && stmt->type == NODE_LET_STATEMENT &&
+        FindLocal(c, stmt->as.let.name) < 0 &&
+        ReservedSlot(c, stmt->as.let.name) == c->param_count + pushed &&
+        ReserveLocals(c, stmt->as.let.value, 0) == 0) {
+      AddLine(c->chunk, stmt->line);
+      CompileExpression(c, stmt->as.let.value);
+      int idx = c->param_count + c->local_count;
+      c->locals[idx].name = stmt->as.let.name;
+      c->locals[idx].index = c->param_count + pushed;
+      c->local_count++;
+      pushed++;
+      continue;
+    }
+    if (pushed < c->slot_count && ReserveLocals(c, statements[i], 0) > 0) {
+      for (; pushed < c->slot_count; pushed++) {
+        EmitConstant(c, 0);
+      }
+    }
+    CompileNode(c, statements[i]);
+  }
+}
+
+void CompileStatement(Compiler* compiler, NodeId id) {
+  if (id == NO_NODE) {
     return;
   }
 
-  switch (stmt->node.type) {
+  const Program* program = compiler->program;
+  const AstNode* stmt = &program->nodes[id];
+  if (stmt->type != NODE_BLOCK_STATEMENT) {
+    AddLine(compiler->chunk, stmt->line);
+  }
+
+  switch (stmt->type) {
     case NODE_LET_STATEMENT: {
-      LetStatement* let_stmt = (LetStatement*)stmt;
       if (compiler->in_function) {
-        CompileExpression(compiler, let_stmt->value);
-        int idx = compiler->param_count + compiler->local_count;
-        if (idx >= 256) {
-          printf("Too many locals.\n");
-          exit(1);
+        CompileExpression(compiler, stmt->as.let.value);
+        int li = FindLocal(compiler, stmt->as.let.name);
+        if (li < 0) {
+          li = ReservedSlot(compiler, stmt->as.let.name);
+          if (li < 0) {
+            break;
+          }
+          int idx = compiler->param_count + compiler->local_count;
+          compiler->locals[idx].name = stmt->as.let.name;
+          compiler->locals[idx].index = li;
+          compiler->local_count++;
         }
-        compiler->locals[idx].name = strdup(let_stmt->name->value);
-        compiler->locals[idx].index = idx;
-        compiler->local_count++;
+        WriteChunk(compiler->chunk, OP_SET_LOCAL);
+        WriteChunk(compiler->chunk, (uint8_t)li);
+        WriteChunk(compiler->chunk, OP_POP);
       } else {
-        CompileExpression(compiler, let_stmt->value);
-        uint8_t arg = IdentifierConstant(compiler, let_stmt->name->value);
+        CompileExpression(compiler, stmt->as.let.value);
+        uint8_t arg = IdentifierConstant(compiler, stmt->as.let.name);
         WriteChunk(compiler->chunk, OP_DEFINE_GLOBAL);
         WriteChunk(compiler->chunk, arg);
       }
       break;
     }
     case NODE_EXPRESSION_STATEMENT: {
-      ExpressionStatement* es = (ExpressionStatement*)stmt;
-      CompileExpression(compiler, es->expression);
-      if (es->expression->node.type != NODE_IF_EXPRESSION &&
-          es->expression->node.type != NODE_CALL_EXPRESSION) {
-        WriteChunk(compiler->chunk, OP_POP);
+      if (stmt->as.expression == NO_NODE) {
+        break;
       }
-      if (es->expression->node.type == NODE_CALL_EXPRESSION) {
+      CompileExpression(compiler, stmt->as.expression);
+      if (program->nodes[stmt->as.expression].type != NODE_IF_EXPRESSION) {
         WriteChunk(compiler->chunk, OP_POP);
       }
       break;
     }
     case NODE_OUT_STATEMENT: {
-      OutStatement* out_stmt = (OutStatement*)stmt;
-      CompileExpression(compiler, out_stmt->value);
+      CompileExpression(compiler, stmt->as.expression);
       WriteChunk(compiler->chunk, OP_OUT);
       break;
     }
     case NODE_IN_STATEMENT: {
-      InStatement* in_stmt = (InStatement*)stmt;
       if (compiler->in_function) {
-        int li = FindLocal(compiler, in_stmt->name->value);
+        int li = FindLocal(compiler, stmt->as.name);
         if (li < 0) {
-          printf("CODEGEN ERROR: input to undeclared local '%s'\n", in_stmt->name->value);
-          exit(1);
+          printf("CODEGEN ERROR: %d:%d: input to undeclared local '%s'\n",
+                 stmt->line, stmt->column, Name(compiler, stmt->as.name));
+          compiler->had_error = 1;
+          break;
         }
         WriteChunk(compiler->chunk, OP_IN_LOCAL);
         WriteChunk(compiler->chunk, (uint8_t)li);
       } else {
-        uint8_t arg = IdentifierConstant(compiler, in_stmt->name->value);
+        uint8_t arg = IdentifierConstant(compiler, stmt->as.name);
         WriteChunk(compiler->chunk, OP_IN);
         WriteChunk(compiler->chunk, arg);
       }
       break;
     }
     case NODE_BLOCK_STATEMENT: {
-      BlockStatement* block = (BlockStatement*)stmt;
-      for (int i = 0; i < block->statement_count; i++) {
-        CompileNode(compiler, (Node*)block->statements[i]);
+      const NodeId* statements = program->lists + stmt->as.block.first;
+      for (uint32_t i = 0; i < stmt->as.block.count; i++) {
+        CompileNode(compiler, statements[i]);
       }
       break;
     }
     case NODE_WHILE_STATEMENT: {
-      WhileStatement* while_stmt = (WhileStatement*)stmt;
       int loop_start = compiler->chunk->count;
-      CompileExpression(compiler, while_stmt->condition);
+      CompileExpression(compiler, stmt->as.loop.condition);
       int exit_jump = EmitJump(compiler, OP_JUMP_IF_FALSE);
-      CompileStatement(compiler, (Statement*)while_stmt->body);
+      CompileStatement(compiler, stmt->as.loop.body);
+      AddLine(compiler->chunk, stmt->line);
       EmitLoop(compiler, loop_start);
       PatchJump(compiler, exit_jump);
       break;
     }
     case NODE_FUNCTION_STATEMENT: {
-      FunctionStatement* fn = (FunctionStatement*)stmt;
       int skip = EmitJump(compiler, OP_JUMP);
 
       int entry = compiler->chunk->count;
-      RegisterFunction(compiler, fn->name->value, entry);
+      RegisterFunction(compiler, stmt->as.fn.name, entry);
 
       int saved_in_function = compiler->in_function;
       int saved_param_count = compiler->param_count;
@@ -434,39 +680,40 @@ void CompileStatement(Compiler* compiler, Statement* stmt) {
       for (int i = 0; i < saved_total; i++) {
         saved_locals[i] = compiler->locals[i];
       }
+      int saved_slot_count = compiler->slot_count;
+      SymbolId saved_slots[256];
+      memcpy(saved_slots, compiler->slots, (size_t)saved_slot_count * sizeof(SymbolId));
 
+      const SymbolId* params = program->lists + stmt->as.fn.params;
       compiler->in_function = 1;
-      compiler->param_count = fn->param_count;
+      compiler->param_count = (int)stmt->as.fn.param_count;
       compiler->local_count = 0;
-      for (int i = 0; i < fn->param_count; i++) {
-        compiler->locals[i].name = strdup(fn->params[i]->value);
+      for (int i = 0; i < compiler->param_count; i++) {
+        compiler->locals[i].name = params[i];
         compiler->locals[i].index = i;
       }
-
-      CompileStatement(compiler, (Statement*)fn->body);
+      compiler->slot_count = 0;
+      ReserveLocals(compiler, stmt->as.fn.body, 1);
+      CompileFunctionBody(compiler, stmt->as.fn.body);
       EnsureFunctionReturn(compiler);
 
-      for (int i = 0; i < compiler->param_count + compiler->local_count; i++) {
-        free(compiler->locals[i].name);
-      }
       compiler->in_function = saved_in_function;
       compiler->param_count = saved_param_count;
       compiler->local_count = saved_local_count;
       for (int i = 0; i < saved_param_count + saved_local_count; i++) {
         compiler->locals[i] = saved_locals[i];
       }
+      compiler->slot_count = saved_slot_count;
+      memcpy(compiler->slots, saved_slots, (size_t)saved_slot_count * sizeof(SymbolId));
 
       PatchJump(compiler, skip);
       break;
     }
     case NODE_RETURN_STATEMENT: {
-      ReturnStatement* rs = (ReturnStatement*)stmt;
-      if (rs->value) {
-        CompileExpression(compiler, rs->value);
+      if (stmt->as.expression != NO_NODE) {
+        CompileExpression(compiler, stmt->as.expression);
       } else {
-        int ci = AddConstant(compiler->chunk, 0);
-        WriteChunk(compiler->chunk, OP_CONSTANT);
-        WriteChunk(compiler->chunk, (uint8_t)ci);
+        EmitConstant(compiler, 0);
       }
       WriteChunk(compiler->chunk, OP_RETURN);
       break;
@@ -474,4 +721,3 @@ void CompileStatement(Compiler* compiler, Statement* stmt) {
     default: break;
   }
 }
-
@@ -0,0 +1,559 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "regcodegen.h"
+
+#define REG_MAX 65535
+
+// Top-level code keeps globals in the first registers of the script frame,
+// so its temporaries are numbered from TEMP_BASE and relocated above the
+// globals once their final count is known.
+#define TEMP_BASE 0x8000
+
+typedef struct {
+  RegChunk* chunk;
+  const Program* program;
+
+  // Per symbol: its global slot and its entry in chunk->functions, or -1.
+  int* symbol_globals;
+  int* symbol_functions;
+
+  int* relocations;
+  int relocation_count;
+  int relocation_capacity;
+
+  // Calls made before their function was defined, checked at the end.
+  struct PendingCall {
+    int function;
+    int line;
+    int column;
+  }* pending;
+  int pending_count;
+  int pending_capacity;
+
+  int in_function;
+  SymbolId locals[256];
+  int local_count;
+  int next_reg;
+  int max_reg;
+
+  int had_error;
+} RegCompiler;
+
+static void CompileStatementReg(RegCompiler* rc, NodeId id);
+static int CompileExpressionReg(RegCompiler* rc, NodeId id, int dst);
+
+void InitRegChunk(RegChunk* chunk) {
+  chunk->code = NULL;
+  chunk->count = 0;
+  chunk->capacity = 0;
+  chunk->functions = NULL;
+  chunk->function_count = 0;
+  chunk->function_capacity = 0;
+  chunk->global_count = 0;
+  chunk->frame_size = 0;
+}
+
+void FreeRegChunk(RegChunk* chunk) {
+  for (int i = 0; i < chunk->function_count; i++) {
+    free(chunk->functions[i].name);
+  }
+  free(chunk->functions);
+  free(chunk->code);
+  InitRegChunk(chunk);
+}
+
+static int Emit(RegCompiler* rc, uint8_t op, int a, int b, int c, Value k) {
+  RegChunk* chunk = rc->chunk;
+  if (chunk->capacity < chunk->count + 1) {
+    int old_capacity = chunk->capacity;
+    chunk->capacity = old_capacity < 8 ? 8 : old_capacity * 2;
+    chunk->code = realloc(chunk->code, chunk->capacity * sizeof(RegInstr));
+  }
+  RegInstr* in = &chunk->code[chunk->count];
+  in->op = op;
+  in->a = (uint16_t)a;
+  in->b = (uint16_t)b;
+  in->c = (uint16_t)c;
+  in->k = k;
+  in->target = -1;
+
+  if (!rc->in_function) {
+    if (rc->relocation_capacity < rc->relocation_count + 1) {
+      int old_capacity = rc->relocation_capacity;
+      rc->relocation_capacity = old_capacity < 8 ? 8 : old_capacity * 2;
+      rc->relocations = realloc(rc->relocations, rc->relocation_capacity * sizeof(int));
+    }
+    rc->relocations[rc->relocation_count++] = chunk->count;
+  }
+  return chunk->count++;
+}
+
+static void PatchTarget(RegCompiler* rc, int at) {
+  rc->chunk->code[at].target = rc->chunk->count;
+}
+
+static int TempReg(RegCompiler* rc, int n) {
+  return rc->in_function ? n : TEMP_BASE + n;
+}
+
+static int NewTemp(RegCompiler* rc) {
+  if (rc->next_reg >= (rc->in_function ? REG_MAX : REG_MAX - TEMP_BASE)) {
+    printf("Too many registers.\n");
+    rc->had_error = 1;
+    return TempReg(rc, 0);
+  }
+  int r = rc->next_reg++;
+  if (rc->next_reg > rc->max_reg) {
+    rc->max_reg = rc->next_reg;
+  }
+  return TempReg(rc, r);
+}
+
+static const AstNode* NodeAt(RegCompiler* rc, NodeId id) {
+  return &rc->program->nodes[id];
+}
+
+static int GlobalIndex(RegCompiler* rc, SymbolId name) {
+  if (rc->symbol_globals[name] >= 0) {
+    return rc->symbol_globals[name];
+  }
+  if (rc->chunk->global_count >= TEMP_BASE) {
+    printf("Too many globals.\n");
+    rc->had_error = 1;
+    return 0;
+  }
+  rc->symbol_globals[name] = rc->chunk->global_count;
+  return rc->chunk->global_count++;
+}
+
+static int FunctionIndex(RegCompiler* rc, SymbolId name) {
+  if (rc->symbol_functions[name] >= 0) {
+    return rc->symbol_functions[name];
+  }
+  RegChunk* chunk = rc->chunk;
+  if (chunk->function_capacity < chunk->function_count + 1) {
+    int old_capacity = chunk->function_capacity;
+    chunk->function_capacity = old_capacity < 8 ? 8 : old_capacity * 2;
+    chunk->functions = realloc(chunk->functions, chunk->function_capacity * sizeof(RegFunction));
+  }
+  RegFunction* fn = &chunk->functions[chunk->function_count];
+  fn->name = strdup(rc->program->symbols[name]);
+  fn->entry = -1;
+  fn->frame_size = 0;
+  fn->param_count = 0;
+  fn->local_count = 0;
+  rc->symbol_functions[name] = chunk->function_count;
+  return chunk->function_count++;
+}
+
+static void AddPendingCall(RegCompiler* rc, int function, const AstNode* site) {
+  if (rc->pending_capacity < rc->pending_count + 1) {
+    rc->pending_capacity = rc->pending_capacity < 16 ? 16 : rc->pending_capacity * 2;
+    rc->pending = realloc(rc->pending, rc->pending_capacity * sizeof(struct PendingCall));
+  }
+  rc->pending[rc->pending_count].function = function;
+  rc->pending[rc->pending_count].line = site->line;
+  rc->pending[rc->pending_count].column = site->column;
+  rc->pending_count++;
+}
+
+static int FindLocalReg(RegCompiler* rc, SymbolId name) {
+  if (!rc->in_function) {
+    return -1;
+  }
+  for (int i = 0; i < rc->local_count; i++) {
+    if (rc->locals[i] == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static int AddLocalReg(RegCompiler* rc, SymbolId name) {
+  if (rc->local_count >= 256) {
+    printf("Too many locals.\n");
+    rc->had_error = 1;
+    return 0;
+  }
+  rc->locals[rc->local_count] = name;
+  return rc->local_count++;
+}
+
+static int IsLiteral(RegCompiler* rc, NodeId id) {
+  return id != NO_NODE && NodeAt(rc, id)->type == NODE_INTEGER_LITERAL;
+}
+
+static int ResultReg(RegCompiler* rc, int dst) {
+  return dst >= 0 ? dst : NewTemp(rc);
+}
+
+static int CompileInto(RegCompiler* rc, NodeId id, int dst) {
+  int r = CompileExpressionReg(rc, id, dst);
+  if (r != dst) {
+    Emit(rc, ROP_MOVE, dst, r, 0, 0);
+  }
+  return dst;
+}
+
+static int HasSideEffects(RegCompiler* rc, NodeId id) {
+  if (id == NO_NODE) {
+    return 0;
+  }
+  const AstNode* expr = NodeAt(rc, id);
+  switch (expr->type) {
+    case NODE_INFIX_EXPRESSION:
+      return expr->op == BIN_ASSIGN ||
+             HasSideEffects(rc, expr->as.infix.left) || HasSideEffects(rc, expr->as.infix.right);
+    case NODE_CALL_EXPRESSION:
+    case NODE_IF_EXPRESSION:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+// A global used in place must be copied if evaluating the right operand
+// could change it before the operation reads it.
+static int CompileLeftOperand(RegCompiler* rc, const AstNode* infix) {
+  int left = CompileExpressionReg(rc, infix->as.infix.left, -1);
+  if (!rc->in_function && left < TEMP_BASE && HasSideEffects(rc, infix->as.infix.right)) {
+    int r = NewTemp(rc);
+    Emit(rc, ROP_MOVE, r, left, 0, 0);
+    return r;
+  }
+  return left;
+}
+
+static int CompileExpressionReg(RegCompiler* rc, NodeId id, int dst) {
+  if (id == NO_NODE) {
+    int r = ResultReg(rc, dst);
+    Emit(rc, ROP_LOADK, r, 0, 0, 0);
+    return r;
+  }
+
+  const AstNode* expr = NodeAt(rc, id);
+  switch (expr->type) {
+    case NODE_INTEGER_LITERAL: {
+      int r = ResultReg(rc, dst);
+      Emit(rc, ROP_LOADK, r, 0, 0, expr->as.value);
+      return r;
+    }
+    case NODE_IDENTIFIER: {
+      int li = FindLocalReg(rc, expr->as.name);
+      if (li >= 0) {
+        return li;
+      }
+      if (!rc->in_function) {
+        return GlobalIndex(rc, expr->as.name);
+      }
+      int r = ResultReg(rc, dst);
+      Emit(rc, ROP_GET_GLOBAL, r, GlobalIndex(rc, expr->as.name), 0, 0);
+      return r;
+    }
+    case NODE_INFIX_EXPRESSION: {
+      if (expr->op == BIN_ASSIGN) {
+        SymbolId name = NodeAt(rc, expr->as.infix.left)->as.name;
+        int li = FindLocalReg(rc, name);
+        if (li >= 0) {
+          return CompileInto(rc, expr->as.infix.right, li);
+        }
+        if (!rc->in_function) {
+          return CompileInto(rc, expr->as.infix.right, GlobalIndex(rc, name));
+        }
+        int r = CompileExpressionReg(rc, expr->as.infix.right, dst);
+        Emit(rc, ROP_SET_GLOBAL, GlobalIndex(rc, name), r, 0, 0);
+        return r;
+      }
+
+      int saved = rc->next_reg;
+      int left = CompileLeftOperand(rc, expr);
+      if (IsLiteral(rc, expr->as.infix.right)) {
+        rc->next_reg = saved;
+        int r = ResultReg(rc, dst);
+        Emit(rc, ROP_ADD_K + 2 * expr->op, r, left, 0, NodeAt(rc, expr->as.infix.right)->as.value);
+        return r;
+      }
+      int right = CompileExpressionReg(rc, expr->as.infix.right, -1);
+      rc->next_reg = saved;
+      int r = ResultReg(rc, dst);
+      Emit(rc, ROP_ADD + 2 * expr->op, r, left, right, 0);
+      return r;
+    }
+    case NODE_IF_EXPRESSION: {
+      CompileStatementReg(rc, id);
+      int r = ResultReg(rc, dst);
+      Emit(rc, ROP_LOADK, r, 0, 0, 0);
+      return r;
+    }
+    case NODE_CALL_EXPRESSION: {
+      const AstNode* callee = NodeAt(rc, expr->as.call.function);
+      if (callee->type != NODE_IDENTIFIER) {
+        printf("CODEGEN ERROR: %d:%d: call target must be an identifier.\n",
+               expr->line, expr->column);
+        rc->had_error = 1;
+        int r = ResultReg(rc, dst);
+        Emit(rc, ROP_LOADK, r, 0, 0, 0);
+        return r;
+      }
+      int arg_count = (int)expr->as.call.arg_count;
+      const NodeId* args = rc->program->lists + expr->as.call.args;
+      int saved = rc->next_reg;
+      int base = TempReg(rc, rc->next_reg);
+      for (int i = 0; i < arg_count; i++) {
+        NewTemp(rc);
+      }
+      for (int i = 0; i < arg_count; i++) {
+        CompileInto(rc, args[i], base + i);
+      }
+      rc->next_reg = saved;
+      int r = ResultReg(rc, dst);
+      int fn = FunctionIndex(rc, callee->as.name);
+      if (rc->chunk->functions[fn].entry < 0) {
+        AddPendingCall(rc, fn, expr);
+      }
+      int at = Emit(rc, ROP_CALL, r, base, arg_count, 0);
+      rc->chunk->code[at].target = fn;
+      return r;
+    }
+    default: {
+      int r = ResultReg(rc, dst);
+      Emit(rc, ROP_LOADK, r, 0, 0, 0);
+      return r;
+    }
+  }
+}
+
+// Emits a jump taken when the condition is false and returns it for patching.
+static int CompileCondition(RegCompiler* rc, NodeId cond) {
+  int saved = rc->next_reg;
+  if (cond != NO_NODE && NodeAt(rc, cond)->type == NODE_INFIX_EXPRESSION) {
+    const AstNode* infix = NodeAt(rc, cond);
+    if (infix->op >= BIN_LESS && infix->op != BIN_ASSIGN) {
+      int ci = infix->op - BIN_LESS;
+      int left = CompileLeftOperand(rc, infix);
+      int at;
+      if (IsLiteral(rc, infix->as.infix.right)) {
+        at = Emit(rc, ROP_JUMP_UNLESS_LESS_K + 2 * ci, left, 0, 0,
+                  NodeAt(rc, infix->as.infix.right)->as.value);
+      } else {
+        int right = CompileExpressionReg(rc, infix->as.infix.right, -1);
+        at = Emit(rc, ROP_JUMP_UNLESS_LESS + 2 * ci, left, right, 0, 0);
+      }
+      rc->next_reg = saved;
+      return at;
+    }
+  }
+  int r = CompileExpressionReg(rc, cond, -1);
+  rc->next_reg = saved;
+  return Emit(rc, ROP_JUMP_IF_FALSE, r, 0, 0, 0);
+}
+
+static void CompileFunctionReg(RegCompiler* rc, const AstNode* fn) {
+  int skip = Emit(rc, ROP_JUMP, 0, 0, 0, 0);
+  int index = FunctionIndex(rc, fn->as.fn.name);
+  rc->chunk->functions[index].entry = rc->chunk->count;
+
+  int saved_in_function = rc->in_function;
+  int saved_local_count = rc->local_count;
+  int saved_next_reg = rc->next_reg;
+  int saved_max_reg = rc->max_reg;
+  SymbolId saved_locals[256];
+  memcpy(saved_locals, rc->locals, sizeof(saved_locals));
+
+  const SymbolId* params = rc->program->lists + fn->as.fn.params;
+  rc->in_function = 1;
+  rc->local_count = 0;
+  for (uint32_t i = 0; i < fn->as.fn.param_count; i++) {
+    AddLocalReg(rc, params[i]);
+  }
+  rc->next_reg = rc->local_count;
+  rc->max_reg = rc->local_count;
+
+  CompileStatementReg(rc, fn->as.fn.body);
+  rc->next_reg = rc->local_count;
+  int r = NewTemp(rc);
+  Emit(rc, ROP_LOADK, r, 0, 0, 0);
+  Emit(rc, ROP_RETURN, r, 0, 0, 0);
+
+  rc->chunk->functions[index].frame_size = rc->max_reg;
+  rc->chunk->functions[index].param_count = (int)fn->as.fn.param_count;
+  rc->chunk->functions[index].local_count = rc->local_count;
+
+  memcpy(rc->locals, saved_locals, sizeof(saved_locals));
+  rc->in_function = saved_in_function;
+  rc->local_count = saved_local_count;
+  rc->next_reg = saved_next_reg;
+  rc->max_reg = saved_max_reg;
+
+  PatchTarget(rc, skip);
+}
+
+static void CompileStatementReg(RegCompiler* rc, NodeId id) {
+  if (id == NO_NODE) {
+    return;
+  }
+  rc->next_reg = rc->local_count;
+
+  const AstNode* stmt = NodeAt(rc, id);
+  switch (stmt->type) {
+    case NODE_LET_STATEMENT: {
+      if (rc->in_function) {
+        // A repeated `let` assigns the existing register, as in the stack VM.
+        int li = FindLocalReg(rc, stmt->as.let.name);
+        if (li >= 0) {
+          CompileInto(rc, stmt->as.let.value, li);
+          break;
+        }
+        int slot = rc->local_count;
+        NewTemp(rc);
+        CompileInto(rc, stmt->as.let.value, slot);
+        AddLocalReg(rc, stmt->as.let.name);
+      } else {
+        CompileInto(rc, stmt->as.let.value, GlobalIndex(rc, stmt->as.let.name));
+      }
+      break;
+    }
+    case NODE_EXPRESSION_STATEMENT: {
+      NodeId expression = stmt->as.expression;
+      if (expression != NO_NODE && NodeAt(rc, expression)->type == NODE_IF_EXPRESSION) {
+        CompileStatementReg(rc, expression);
+      } else {
+        CompileExpressionReg(rc, expression, -1);
+      }
+      break;
+    }
+    case NODE_OUT_STATEMENT: {
+      int r = CompileExpressionReg(rc, stmt->as.expression, -1);
+      Emit(rc, ROP_OUT, r, 0, 0, 0);
+      break;
+    }
+    case NODE_IN_STATEMENT: {
+      if (rc->in_function) {
+        int li = FindLocalReg(rc, stmt->as.name);
+        if (li < 0) {
+          printf("CODEGEN ERROR: %d:%d: input to undeclared local '%s'\n",
+                 stmt->line, stmt->column, rc->program->symbols[stmt->as.name]);
+          rc->had_error = 1;
+          break;
+        }
+        Emit(rc, ROP_IN_LOCAL, li, 0, 0, 0);
+      } else {
+        Emit(rc, ROP_IN_LOCAL, GlobalIndex(rc, stmt->as.name), 0, 0, 0);
+      }
+      break;
+    }
+    case NODE_BLOCK_STATEMENT: {
+      const NodeId* statements = rc->program->lists + stmt->as.block.first;
+      for (uint32_t i = 0; i < stmt->as.block.count; i++) {
+        CompileStatementReg(rc, statements[i]);
+      }
+      break;
+    }
+    case NODE_IF_EXPRESSION: {
+      int then_jump = CompileCondition(rc, stmt->as.branch.condition);
+      CompileStatementReg(rc, stmt->as.branch.consequence);
+      if (stmt->as.branch.alternative != NO_NODE) {
+        int else_jump = Emit(rc, ROP_JUMP, 0, 0, 0, 0);
+        PatchTarget(rc, then_jump);
+        CompileStatementReg(rc, stmt->as.branch.alternative);
+        PatchTarget(rc, else_jump);
+      } else {
+        PatchTarget(rc, then_jump);
+      }
+      break;
+    }
+    case NODE_WHILE_STATEMENT: {
+      int loop_start = rc->chunk->count;
+      int exit_jump = CompileCondition(rc, stmt->as.loop.condition);
+      CompileStatementReg(rc, stmt->as.loop.body);
+      int back = Emit(rc, ROP_JUMP, 0, 0, 0, 0);
+      rc->chunk->code[back].target = loop_start;
+      PatchTarget(rc, exit_jump);
+      break;
+    }
+    case NODE_FUNCTION_STATEMENT:
+      CompileFunctionReg(rc, stmt);
+      break;
+    case NODE_RETURN_STATEMENT: {
+      int r = CompileExpressionReg(rc, stmt->as.expression, -1);
+      Emit(rc, ROP_RETURN, r, 0, 0, 0);
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+static void Relocate(uint16_t* reg, int global_count) {
+  if (*reg >= TEMP_BASE) {
+    *reg = (uint16_t)(*reg - TEMP_BASE + global_count);
+  }
+}
+
+static void RelocateTemps(RegCompiler* rc) {
+  int globals = rc->chunk->global_count;
+  for (int i = 0; i < rc->relocation_count; i++) {
+    RegInstr* in = &rc->chunk->code[rc->relocations[i]];
+    switch (in->op) {
+      case ROP_GET_GLOBAL:
+        Relocate(&in->a, globals);
+        break;
+      case ROP_SET_GLOBAL:
+        Relocate(&in->b, globals);
+        break;
+      case ROP_JUMP:
+      case ROP_HALT:
+        break;
+      default:
+        Relocate(&in->a, globals);
+        Relocate(&in->b, globals);
+        Relocate(&in->c, globals);
+        break;
+    }
+  }
+}
+
+RegChunk* CompileRegister(Program* program) {
+  RegCompiler rc;
+  memset(&rc, 0, sizeof(rc));
+
+  rc.program = program;
+  size_t symbols = (size_t)program->symbol_count + 1;
+  rc.symbol_globals = (int*)malloc(symbols * sizeof(int));
+  rc.symbol_functions = (int*)malloc(symbols * sizeof(int));
+  memset(rc.symbol_globals, 0xff, symbols * sizeof(int));
+  memset(rc.symbol_functions, 0xff, symbols * sizeof(int));
+
+  RegChunk* chunk = (RegChunk*)malloc(sizeof(RegChunk));
+  InitRegChunk(chunk);
+  rc.chunk = chunk;
+
+  const NodeId* statements = program->lists + program->statements;
+  for (uint32_t i = 0; i < program->statement_count; i++) {
+    CompileStatementReg(&rc, statements[i]);
+  }
+  Emit(&rc, ROP_HALT, 0, 0, 0, 0);
+  RelocateTemps(&rc);
+  chunk->frame_size = chunk->global_count + rc.max_reg;
+
+  for (int i = 0; i < rc.pending_count; i++) {
+    const RegFunction* fn = &chunk->functions[rc.pending[i].function];
+    if (fn->entry < 0) {
+      printf("CODEGEN ERROR: %d:%d: Undefined function '%s'\n",
+             rc.pending[i].line, rc.pending[i].column, fn->name);
+      rc.had_error = 1;
+    }
+  }
+
+  free(rc.symbol_globals);
+  free(rc.symbol_functions);
+  free(rc.relocations);
+  free(rc.pending);
+  if (rc.had_error) {
+    FreeRegChunk(chunk);
+    free(chunk);
+    return NULL;
+  }
+  return chunk;
+}
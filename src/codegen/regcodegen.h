@@ -0,0 +1,10 @@
+#ifndef REGCODEGEN_H
+#define REGCODEGEN_H
+
+#include "../parser/parser.h"
+#include "../common/regcode.h"
+
+// NULL after printing a codegen error.
+RegChunk* CompileRegister(Program* program);
+
+#endif
@@ -0,0 +1,74 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_MAX_BLOCK (1024 * 1024)
+#define ARENA_ALIGN sizeof(void*)
+
+struct ArenaBlock {
+  ArenaBlock* prev;
+  char data[];
+};
+
+void InitArena(Arena* a) {
+  a->head = NULL;
+  a->next = NULL;
+  a->end = NULL;
+  a->block_size = ARENA_FIRST_BLOCK;
+}
+
+void FreeArena(Arena* a) {
+  ArenaBlock* b = a->head;
+  while (b) {
+    ArenaBlock* prev = b->prev;
+    free(b);
+    b = prev;
+  }
+  InitArena(a);
+}
+
+static int NewBlock(Arena* a, size_t min) {
+  size_t size = a->block_size;
+  if (size < min) {
+    size = min;
+  }
+  ArenaBlock* b = (ArenaBlock*)malloc(sizeof(ArenaBlock) + size);
+  if (!b) {
+    return 0;
+  }
+  b->prev = a->head;
+  a->head = b;
+  a->next = b->data;
+  a->end = b->data + size;
+  if (a->block_size < ARENA_MAX_BLOCK) {
+    a->block_size *= 2;
+  }
+  return 1;
+}
+
+static void* Bump(Arena* a, size_t size, size_t align) {
+  uintptr_t p = ((uintptr_t)a->next + (align - 1)) & ~(uintptr_t)(align - 1);
+  if (!a->head || p + size > (uintptr_t)a->end) {
+    if (!NewBlock(a, size)) {
+      return NULL;
+    }
+    p = (uintptr_t)a->next;
+  }
+  a->next = (char*)p + size;
+  return (void*)p;
+}
+
+void* ArenaAlloc(Arena* a, size_t size) {
+  return Bump(a, size, ARENA_ALIGN);
+}
+
+char* ArenaStrndup(Arena* a, const char* s, size_t n) {
+  char* r = (char*)Bump(a, n + 1, 1);
+  if (!r) {
+    return NULL;
+  }
+  memcpy(r, s, n);
+  r[n] = '\0';
+  return r;
+}
@@ -0,0 +1,28 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct ArenaBlock ArenaBlock;
+
+// Bump allocator: memory is only released all at once by FreeArena.
+// Blocks start at ARENA_FIRST_BLOCK bytes and double up to 1 MiB; larger
+// requests get a block of their own.
+typedef struct {
+  ArenaBlock* head;
+  char* next;
+  char* end;
+  size_t block_size;
+} Arena;
+
+#define ARENA_FIRST_BLOCK (64 * 1024)
+
+void InitArena(Arena* a);
+void FreeArena(Arena* a);
+
+// Pointer-aligned and uninitialized; NULL when out of memory.
+void* ArenaAlloc(Arena* a, size_t size);
+// NUL-terminated copy of s[0, n), or NULL when out of memory.
+char* ArenaStrndup(Arena* a, const char* s, size_t n);
+
+#endif
@@ -0,0 +1,23 @@
+#include <stdlib.h>
+#include "ast.h"
+
+const char* BinaryOpName(BinaryOp op) {
+  switch (op) {
+#define X(name, sym) case BIN_##name: return #sym;
+    CCB_BINARY_OPS(X)
+#undef X
+    case BIN_ASSIGN: return "=";
+  }
+  return "?";
+}
+
+void FreeProgram(Program* program) {
+  if (!program) {
+    return;
+  }
+  free(program->nodes);
+  free(program->lists);
+  free(program->symbols);
+  FreeArena(&program->arena);
+  free(program);
+}
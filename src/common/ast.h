@@ -1,7 +1,9 @@
 #ifndef AST_H
 #define AST_H
 
-#include "token.h"
+#include <stdint.h>
+#include "arena.h"
+#include "bytecode.h"
 
 typedef enum {
   NODE_PROGRAM,
@@ -21,112 +23,68 @@ typedef enum {
   NODE_CALL_EXPRESSION
 } NodeType;
 
-typedef struct Node { NodeType type; } Node;
-
-typedef struct Expression { Node node; } Expression;
-typedef struct Statement  { Node node; } Statement;
-
+// Binary operators in CCB_BINARY_OPS order, so that OP_ADD + op and
+// ROP_ADD + 2 * op select the instruction; assignment comes last.
+typedef enum {
+#define X(name, op) BIN_##name,
+  CCB_BINARY_OPS(X)
+#undef X
+  BIN_ASSIGN
+} BinaryOp;
+
+// Nodes refer to each other by index into Program.nodes. Index 0 is a
+// placeholder, so NO_NODE marks a child the parser could not build.
+typedef uint32_t NodeId;
+// Index into Program.symbols; equal names share one id.
+typedef uint32_t SymbolId;
+
+#define NO_NODE 0
+
+// Source position is that of the node's first token, 1-based. Child lists
+// (block statements, call arguments, parameters) are runs of
+// Program.lists holding node ids, or symbol ids for parameters.
 typedef struct {
-  Expression base;
-  Token token;
-  int value;
-} IntegerLiteral;
-
+  uint8_t type;  // NodeType
+  uint8_t op;    // BinaryOp of an infix expression
+  int line;
+  int column;
+  union {
+    int value;                                             // integer literal
+    SymbolId name;                                         // identifier, in
+    NodeId expression;                                     // expression, out, return
+    struct { NodeId left, right; } infix;
+    struct { SymbolId name; NodeId value; } let;
+    struct { uint32_t first, count; } block;
+    struct { NodeId condition, consequence, alternative; } branch;
+    struct { NodeId condition, body; } loop;
+    struct { SymbolId name; uint32_t params, param_count; NodeId body; } fn;
+    struct { NodeId function; uint32_t args, arg_count; } call;
+  } as;
+} AstNode;
+
+// Nodes, lists and the symbol table are contiguous arrays; symbol text
+// lives in arena.
 typedef struct {
-  Expression base;
-  Token token;
-  char* value;
-} Identifier;
+  AstNode* nodes;
+  uint32_t node_count;
+  uint32_t node_capacity;
 
-typedef struct {
-  Expression base;
-  Token token;
-  Expression* left;
-  char* operator;
-  Expression* right;
-} InfixExpression;
+  uint32_t* lists;
+  uint32_t list_count;
+  uint32_t list_capacity;
 
-typedef struct {
-  Statement base;
-  Token token;
-  Identifier* name;
-  Expression* value;
-} LetStatement;
+  const char** symbols;
+  uint32_t symbol_count;
+  uint32_t symbol_capacity;
 
-typedef struct {
-  Statement base;
-  Token token;
-  Expression* expression;
-} ExpressionStatement;
+  // Top-level statements, a run of lists.
+  uint32_t statements;
+  uint32_t statement_count;
 
-typedef struct {
-  Node node;
-  Statement** statements;
-  int statement_count;
+  Arena arena;
 } Program;
 
-typedef struct {
-  Statement base;
-  Token token;
-  Statement** statements;
-  int statement_count;
-} BlockStatement;
-
-typedef struct {
-  Statement base;
-  Token token;
-  Expression* condition;
-  BlockStatement* consequence;
-  BlockStatement* alternative;
-} IfExpression;
-
-typedef struct {
-  Statement base;
-  Token token;
-  Expression* condition;
-  BlockStatement* body;
-} WhileStatement;
-
-typedef struct {
-  Statement base;
-  Token token;
-  Expression* value;
-} OutStatement;
-
-typedef struct {
-  Statement base;
-  Token token;
-  Identifier* name;
-} InStatement;
-
-typedef struct {
-  Statement base;
-  Token token;
-  Identifier* name;
-  Identifier** params;
-  int param_count;
-  BlockStatement* body;
-  char* return_type;
-} FunctionStatement;
-
-typedef struct {
-  Statement base;
-  Token token;
-  Expression* value;
-} ReturnStatement;
-
-typedef struct {
-  Expression base;
-  Token token;
-  Expression* function;
-  Expression** arguments;
-  int arg_count;
-} CallExpression;
-
+const char* BinaryOpName(BinaryOp op);
 void FreeProgram(Program* program);
-void FreeExpression(Expression* expr);
-void FreeStatement(Statement* stmt);
-void PrintAst(Program* p);
 
 #endif
-
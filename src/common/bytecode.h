@@ -1,6 +1,7 @@
 #ifndef BYTECODE_H
 #define BYTECODE_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 typedef enum {
@@ -38,8 +39,35 @@ typedef enum {
   OP_RETURN
 } OpCode;
 
+#define CCB_ARITH_OPS(X) \
+  X(ADD, +)              \
+  X(SUBTRACT, -)         \
+  X(MULTIPLY, *)         \
+  X(DIVIDE, /)
+
+#define CCB_COMPARE_OPS(X) \
+  X(LESS, <)               \
+  X(GREATER, >)            \
+  X(LESS_EQUAL, <=)        \
+  X(GREATER_EQUAL, >=)     \
+  X(EQUAL, ==)             \
+  X(NOT_EQUAL, !=)
+
+#define CCB_BINARY_OPS(X) CCB_ARITH_OPS(X) CCB_COMPARE_OPS(X)
+
 typedef int Value;
 
+typedef struct {
+  char* name;
+  int offset;
+} ChunkFunction;
+
+// Instructions from offset up to the next run's offset come from line.
+typedef struct {
+  int offset;
+  int line;
+} LineRun;
+
 typedef struct {
   int count;
   int capacity;
@@ -48,12 +76,29 @@ typedef struct {
   Value* constants;
   int constants_count;
   int constants_capacity;
+
+  // Operand of OP_*_GLOBAL -> variable name.
+  char** names;
+  int names_count;
+
+  ChunkFunction* functions;
+  int function_count;
+
+  LineRun* lines;
+  int line_count;
+  int line_capacity;
+
+  // Set when code and constants point into a mapped .ccbc file.
+  void* mapping;
+  size_t mapping_size;
 } Chunk;
 
 void InitChunk(Chunk* chunk);
 void WriteChunk(Chunk* chunk, uint8_t byte);
 void FreeChunk(Chunk* chunk);
 int AddConstant(Chunk* chucnk, Value value);
+void AddLine(Chunk* chunk, int line);
+int LineForOffset(const Chunk* chunk, int offset);
 
 #endif
 
@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ccbc.h"
+
+#define CCBC_BYTE_ORDER 0x01020304u
+
+static uint32_t AddString(char* pool, uint32_t* size, const char* s) {
+  uint32_t at = *size;
+  size_t n = strlen(s) + 1;
+  if (pool != NULL) {
+    memcpy(pool + at, s, n);
+  }
+  *size += (uint32_t)n;
+  return at;
+}
+
+int WriteBytecodeFile(const Chunk* chunk, const char* path) {
+  CcbcHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CCBC_MAGIC, 4);
+  header.version = CCBC_VERSION;
+  header.byte_order = CCBC_BYTE_ORDER;
+  header.code_size = (uint32_t)chunk->count;
+  header.constants_count = (uint32_t)chunk->constants_count;
+  header.function_count = (uint32_t)chunk->function_count;
+  header.names_count = (uint32_t)chunk->names_count;
+  header.line_count = (uint32_t)chunk->line_count;
+
+  for (int i = 0; i < chunk->function_count; i++) {
+    AddString(NULL, &header.strings_size, chunk->functions[i].name);
+  }
+  for (int i = 0; i < chunk->names_count; i++) {
+    AddString(NULL, &header.strings_size, chunk->names[i]);
+  }
+
+  char* pool = (char*)malloc(header.strings_size + 1);
+  uint32_t* functions = (uint32_t*)malloc((header.function_count * 2 + 1) * sizeof(uint32_t));
+  uint32_t* names = (uint32_t*)malloc((header.names_count + 1) * sizeof(uint32_t));
+  uint32_t size = 0;
+  for (int i = 0; i < chunk->function_count; i++) {
+    functions[i * 2] = (uint32_t)chunk->functions[i].offset;
+    functions[i * 2 + 1] = AddString(pool, &size, chunk->functions[i].name);
+  }
+  for (int i = 0; i < chunk->names_count; i++) {
+    names[i] = AddString(pool, &size, chunk->names[i]);
+  }
+
+  FILE* file = fopen(path, "wb");
+  int ok = file != NULL;
+  if (ok) {
+    ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+         fwrite(chunk->constants, sizeof(Value), header.constants_count, file) == header.constants_count &&
+         fwrite(functions, sizeof(uint32_t) * 2, header.function_count, file) == header.function_count &&
+         fwrite(names, sizeof(uint32_t), header.names_count, file) == header.names_count &&
+         fwrite(chunk->lines, sizeof(LineRun), header.line_count, file) == header.line_count &&
+         fwrite(pool, 1, header.strings_size, file) == header.strings_size &&
+         fwrite(chunk->code, 1, header.code_size, file) == header.code_size;
+    ok = fclose(file) == 0 && ok;
+  }
+  if (!ok) {
+    fprintf(stderr, "Could not write bytecode file \"%s\".\n", path);
+  }
+
+  free(pool);
+  free(functions);
+  free(names);
+  return ok;
+}
+
+static char* PoolString(const char* pool, uint32_t size, uint32_t at) {
+  if (at >= size || memchr(pool + at, '\0', size - at) == NULL) {
+    return NULL;
+  }
+  return (char*)pool + at;
+}
+
+// The chunk points into the mapping for code, constants, lines and name
+// strings; only the name and function pointer tables are built on load.
+// Nothing runs from the mapping itself: DecodeChunk validates the code and
+// translates it into a private Instr array for the VM, and the JIT
+// compiles it into its own memory. The mapping saves the front end and
+// the read, not the decoded copy, and is not shared executable code.
+Chunk* LoadBytecodeFile(const char* path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Could not open file \"%s\".\n", path);
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CcbcHeader)) {
+    fprintf(stderr, "LOAD ERROR: \"%s\" is not a bytecode file.\n", path);
+    close(fd);
+    return NULL;
+  }
+
+  size_t size = (size_t)st.st_size;
+  void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Could not map file \"%s\".\n", path);
+    return NULL;
+  }
+
+  const CcbcHeader* header = (const CcbcHeader*)map;
+  if (memcmp(header->magic, CCBC_MAGIC, 4) != 0 || header->byte_order != CCBC_BYTE_ORDER) {
+    fprintf(stderr, "LOAD ERROR: \"%s\" is not a bytecode file.\n", path);
+    munmap(map, size);
+    return NULL;
+  }
+  if (header->version != CCBC_VERSION) {
+    fprintf(stderr, "LOAD ERROR: \"%s\" has bytecode version %u, expected %u.\n",
+            path, header->version, CCBC_VERSION);
+    munmap(map, size);
+    return NULL;
+  }
+
+  uint64_t expected = sizeof(CcbcHeader) +
+                      (uint64_t)header->constants_count * sizeof(Value) +
+                      (uint64_t)header->function_count * 2 * sizeof(uint32_t) +
+                      (uint64_t)header->names_count * sizeof(uint32_t) +
+                      (uint64_t)header->line_count * sizeof(LineRun) +
+                      header->strings_size + header->code_size;
+  if (expected != size || header->code_size == 0 ||
+      header->code_size > INT32_MAX || header->constants_count > INT32_MAX ||
+      header->function_count > 65536 || header->names_count > 65536 ||
+      header->line_count > header->code_size) {
+    fprintf(stderr, "LOAD ERROR: \"%s\" is truncated or corrupt.\n", path);
+    munmap(map, size);
+    return NULL;
+  }
+
+  const uint8_t* p = (const uint8_t*)map + sizeof(CcbcHeader);
+  Value* constants = (Value*)p;
+  p += header->constants_count * sizeof(Value);
+  const uint32_t* functions = (const uint32_t*)p;
+  p += header->function_count * 2 * sizeof(uint32_t);
+  const uint32_t* names = (const uint32_t*)p;
+  p += header->names_count * sizeof(uint32_t);
+  LineRun* lines = (LineRun*)p;
+  p += header->line_count * sizeof(LineRun);
+  const char* pool = (const char*)p;
+  p += header->strings_size;
+
+  Chunk* chunk = (Chunk*)malloc(sizeof(Chunk));
+  InitChunk(chunk);
+  chunk->mapping = map;
+  chunk->mapping_size = size;
+  chunk->code = (uint8_t*)p;
+  chunk->count = (int)header->code_size;
+  chunk->capacity = chunk->count;
+  chunk->constants = constants;
+  chunk->constants_count = (int)header->constants_count;
+  chunk->constants_capacity = chunk->constants_count;
+  chunk->lines = lines;
+  chunk->line_count = (int)header->line_count;
+  chunk->line_capacity = chunk->line_count;
+
+  chunk->functions = (ChunkFunction*)malloc((header->function_count + 1) * sizeof(ChunkFunction));
+  chunk->names = (char**)malloc((header->names_count + 1) * sizeof(char*));
+  int ok = 1;
+  for (uint32_t i = 0; i < header->function_count && ok; i++) {
+    chunk->functions[i].offset = (int)functions[i * 2];
+    chunk->functions[i].name = PoolString(pool, header->strings_size, functions[i * 2 + 1]);
+    ok = chunk->functions[i].name != NULL && functions[i * 2] < header->code_size;
+    chunk->function_count++;
+  }
+  for (uint32_t i = 0; i < header->names_count && ok; i++) {
+    chunk->names[i] = PoolString(pool, header->strings_size, names[i]);
+    ok = chunk->names[i] != NULL;
+    chunk->names_count++;
+  }
+
+  for (int i = 0; i < chunk->line_count && ok; i++) {
+    ok = lines[i].offset >= 0 && (uint32_t)lines[i].offset < header->code_size &&
+         (i == 0 || lines[i].offset > lines[i - 1].offset);
+  }
+
+  if (!ok) {
+    fprintf(stderr, "LOAD ERROR: \"%s\" is truncated or corrupt.\n", path);
+    FreeChunk(chunk);
+    free(chunk);
+    return NULL;
+  }
+  return chunk;
+}
@@ -0,0 +1,35 @@
+#ifndef CCBC_H
+#define CCBC_H
+
+#include "bytecode.h"
+
+#define CCBC_MAGIC "CCBC"
+#define CCBC_VERSION 2
+
+// On-disk layout, all fields in host byte order:
+//   CcbcHeader
+//   int32_t  constants[constants_count]
+//   uint32_t functions[function_count][2]   { code offset, name offset }
+//   uint32_t names[names_count]             name offset
+//   int32_t  lines[line_count][2]           { code offset, source line }
+//   char     strings[strings_size]          NUL-terminated names
+//   uint8_t  code[code_size]
+// The loader checks the container and DecodeChunk checks opcodes, operands
+// and jump targets, but stack balance is not verified: only load files
+// produced by this compiler.
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t code_size;
+  uint32_t constants_count;
+  uint32_t function_count;
+  uint32_t names_count;
+  uint32_t line_count;
+  uint32_t strings_size;
+} CcbcHeader;
+
+int WriteBytecodeFile(const Chunk* chunk, const char* path);
+Chunk* LoadBytecodeFile(const char* path);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef REGCODE_H
+#define REGCODE_H
+
+#include "bytecode.h"
+
+// Three-address code for the register VM. Registers are frame slots:
+// parameters first, then locals, then temporaries. The script frame holds
+// the globals in its first registers, so G[i] is the script frame's R[i].
+typedef enum {
+  ROP_LOADK,          // R[a] = k
+  ROP_MOVE,           // R[a] = R[b]
+  ROP_GET_GLOBAL,     // R[a] = G[b]
+  ROP_SET_GLOBAL,     // G[a] = R[b]
+
+#define X(name, op) ROP_##name, ROP_##name##_K,   // R[a] = R[b] op R[c] / k
+  CCB_BINARY_OPS(X)
+#undef X
+
+  ROP_JUMP,           // pc = target
+  ROP_JUMP_IF_FALSE,  // if (!R[a]) pc = target
+
+#define X(name, op) ROP_JUMP_UNLESS_##name, ROP_JUMP_UNLESS_##name##_K,   // if (!(R[a] op R[b] / k)) pc = target
+  CCB_COMPARE_OPS(X)
+#undef X
+
+  ROP_IN_LOCAL,       // R[a] = input
+  ROP_OUT,            // output R[a]
+
+  ROP_CALL,           // R[a] = functions[target](R[b] .. R[b + c - 1])
+  ROP_RETURN,         // return R[a]
+  ROP_HALT,
+
+  ROP_COUNT
+} RegOpCode;
+
+typedef struct {
+  uint8_t op;
+  uint16_t a;
+  uint16_t b;
+  uint16_t c;
+  Value k;
+  int32_t target;
+} RegInstr;
+
+// Registers [param_count, local_count) hold the function's `let` locals
+// and are zeroed on every call, like the stack VM's reserved slots.
+typedef struct {
+  char* name;
+  int entry;
+  int frame_size;
+  int param_count;
+  int local_count;
+} RegFunction;
+
+typedef struct {
+  RegInstr* code;
+  int count;
+  int capacity;
+
+  RegFunction* functions;
+  int function_count;
+  int function_capacity;
+
+  int global_count;
+  int frame_size;
+} RegChunk;
+
+void InitRegChunk(RegChunk* chunk);
+void FreeRegChunk(RegChunk* chunk);
+
+#endif
@@ -43,9 +43,15 @@ typedef enum {
   TOKEN_RETURN
 } TokenType;
 
+// start/length is the token's text in the source buffer, which must
+// outlive the tokens; it is not NUL-terminated.
 typedef struct {
   TokenType type;
-  char* literal;
+  const char* start;
+  int length;
+  int value;  // TOKEN_INT only
+  int line;
+  int column;
 } Token;
 
 #endif
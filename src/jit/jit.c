@@ -0,0 +1,510 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "jit.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include "../vm/verify.h"
+
+// Native register assignment for JIT-compiled code:
+//   rbx - top of the value stack (next free slot)
+//   r12 - base of the current call frame
+//   r13 - globals
+//   r14 - JitContext
+//   r15 - end of the value stack, for overflow checks
+enum { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+       R12 = 12, R13 = 13, R14 = 14, R15 = 15 };
+
+typedef struct {
+  Value* stack_top;
+  Value* globals;
+  Value* stack_limit;
+  void* saved_rsp;
+  int32_t depth;
+  Value stack[STACK_MAX];
+  Value global_slots[GLOBALS_MAX];
+} JitContext;
+
+typedef struct {
+  int at;
+  int target;
+} JitPatch;
+
+typedef struct {
+  uint8_t* code;
+  int count;
+  int capacity;
+
+  int* native_of;
+  JitPatch* patches;
+  int patch_count;
+  int patch_capacity;
+
+  int overflow_stub;
+  int callstack_stub;
+  int epilogue;
+} Jit;
+
+static void EmitByte(Jit* j, uint8_t byte) {
+  if (j->capacity < j->count + 1) {
+    int old_capacity = j->capacity;
+    j->capacity = old_capacity < 256 ? 256 : old_capacity * 2;
+    j->code = realloc(j->code, j->capacity);
+  }
+  j->code[j->count++] = byte;
+}
+
+static void EmitBytes(Jit* j, const uint8_t* bytes, int n) {
+  for (int i = 0; i < n; i++) {
+    EmitByte(j, bytes[i]);
+  }
+}
+
+static void EmitU32(Jit* j, uint32_t v) {
+  for (int i = 0; i < 4; i++) {
+    EmitByte(j, (uint8_t)(v >> (8 * i)));
+  }
+}
+
+static void EmitU64(Jit* j, uint64_t v) {
+  for (int i = 0; i < 8; i++) {
+    EmitByte(j, (uint8_t)(v >> (8 * i)));
+  }
+}
+
+// op reg, [base + disp32]; wide selects a 64-bit operand (REX.W).
+static void EmitMem(Jit* j, int wide, const uint8_t* opcode, int oplen, int reg, int base, int32_t disp) {
+  uint8_t rex = 0x40 | (wide ? 0x08 : 0) | ((reg >> 3) << 2) | (base >> 3);
+  if (rex != 0x40) {
+    EmitByte(j, rex);
+  }
+  EmitBytes(j, opcode, oplen);
+  EmitByte(j, (uint8_t)(0x80 | ((reg & 7) << 3) | (base & 7)));
+  if ((base & 7) == RSP) {
+    EmitByte(j, 0x24);
+  }
+  EmitU32(j, (uint32_t)disp);
+}
+
+static void LoadMem32(Jit* j, int reg, int base, int32_t disp) {
+  static const uint8_t op[] = { 0x8b };
+  EmitMem(j, 0, op, 1, reg, base, disp);
+}
+
+static void StoreMem32(Jit* j, int base, int32_t disp, int reg) {
+  static const uint8_t op[] = { 0x89 };
+  EmitMem(j, 0, op, 1, reg, base, disp);
+}
+
+static void LoadMem64(Jit* j, int reg, int base, int32_t disp) {
+  static const uint8_t op[] = { 0x8b };
+  EmitMem(j, 1, op, 1, reg, base, disp);
+}
+
+static void StoreMem64(Jit* j, int base, int32_t disp, int reg) {
+  static const uint8_t op[] = { 0x89 };
+  EmitMem(j, 1, op, 1, reg, base, disp);
+}
+
+static void AdjustStack(Jit* j, int8_t delta) {
+  // add rbx, imm8
+  uint8_t bytes[] = { 0x48, 0x83, 0xc3, (uint8_t)delta };
+  EmitBytes(j, bytes, sizeof(bytes));
+}
+
+static void EmitJumpTo(Jit* j, const uint8_t* opcode, int oplen, int native_target) {
+  EmitBytes(j, opcode, oplen);
+  EmitU32(j, (uint32_t)(native_target - (j->count + 4)));
+}
+
+static void EmitJumpToBytecode(Jit* j, const uint8_t* opcode, int oplen, int target) {
+  EmitBytes(j, opcode, oplen);
+  if (j->patch_capacity < j->patch_count + 1) {
+    int old_capacity = j->patch_capacity;
+    j->patch_capacity = old_capacity < 16 ? 16 : old_capacity * 2;
+    j->patches = realloc(j->patches, j->patch_capacity * sizeof(JitPatch));
+  }
+  j->patches[j->patch_count].at = j->count;
+  j->patches[j->patch_count].target = target;
+  j->patch_count++;
+  EmitU32(j, 0);
+}
+
+static void EmitCallHelper(Jit* j, void* fn) {
+  static const uint8_t mov_rax[] = { 0x48, 0xb8 };
+  static const uint8_t call_rax[] = { 0xff, 0xd0 };
+  EmitBytes(j, mov_rax, sizeof(mov_rax));
+  EmitU64(j, (uint64_t)(uintptr_t)fn);
+  EmitBytes(j, call_rax, sizeof(call_rax));
+}
+
+static void CheckOverflow(Jit* j) {
+  // cmp rbx, r15; jae overflow_stub
+  static const uint8_t cmp[] = { 0x4c, 0x39, 0xfb };
+  static const uint8_t jae[] = { 0x0f, 0x83 };
+  EmitBytes(j, cmp, sizeof(cmp));
+  EmitJumpTo(j, jae, sizeof(jae), j->overflow_stub);
+}
+
+static void PushReg32(Jit* j, int reg) {
+  CheckOverflow(j);
+  StoreMem32(j, RBX, 0, reg);
+  AdjustStack(j, 4);
+}
+
+static void PopReg32(Jit* j, int reg) {
+  AdjustStack(j, -4);
+  LoadMem32(j, reg, RBX, 0);
+}
+
+static void JitStackOverflow() {
+  fprintf(stderr, "RUNTIME ERROR: stack overflow.\n");
+}
+
+static void JitCallStackOverflow() {
+  fprintf(stderr, "RUNTIME ERROR: call stack overflow.\n");
+}
+
+static void EmitPrologue(Jit* j) {
+  static const uint8_t enter[] = {
+    0x55,                   // push rbp
+    0x48, 0x89, 0xe5,       // mov rbp, rsp
+    0x53,                   // push rbx
+    0x41, 0x54,             // push r12
+    0x41, 0x55,             // push r13
+    0x41, 0x56,             // push r14
+    0x41, 0x57,             // push r15
+    0x48, 0x83, 0xec, 0x08, // sub rsp, 8
+    0x49, 0x89, 0xfe,       // mov r14, rdi
+  };
+  EmitBytes(j, enter, sizeof(enter));
+  LoadMem64(j, RBX, R14, offsetof(JitContext, stack_top));
+  LoadMem64(j, R12, R14, offsetof(JitContext, stack_top));
+  LoadMem64(j, R13, R14, offsetof(JitContext, globals));
+  LoadMem64(j, R15, R14, offsetof(JitContext, stack_limit));
+  StoreMem64(j, R14, offsetof(JitContext, saved_rsp), RSP);
+
+  static const uint8_t jmp[] = { 0xe9 };
+  EmitJumpToBytecode(j, jmp, sizeof(jmp), 0);
+}
+
+static void EmitStubs(Jit* j) {
+  static const uint8_t leave[] = {
+    0x48, 0x83, 0xc4, 0x08, // add rsp, 8
+    0x41, 0x5f,             // pop r15
+    0x41, 0x5e,             // pop r14
+    0x41, 0x5d,             // pop r13
+    0x41, 0x5c,             // pop r12
+    0x5b,                   // pop rbx
+    0x5d,                   // pop rbp
+    0xc3,                   // ret
+  };
+
+  j->epilogue = j->count;
+  LoadMem64(j, RSP, R14, offsetof(JitContext, saved_rsp));
+  EmitBytes(j, leave, sizeof(leave));
+
+  // Both stubs report the error and leave through the epilogue, which
+  // restores rsp however deep the native call chain is.
+  static const uint8_t jmp[] = { 0xe9 };
+  j->overflow_stub = j->count;
+  EmitCallHelper(j, (void*)JitStackOverflow);
+  EmitByte(j, 0xb8);  // mov eax, INTERPRET_RUNTIME_ERROR
+  EmitU32(j, INTERPRET_RUNTIME_ERROR);
+  EmitJumpTo(j, jmp, sizeof(jmp), j->epilogue);
+
+  j->callstack_stub = j->count;
+  EmitCallHelper(j, (void*)JitCallStackOverflow);
+  EmitByte(j, 0xb8);  // mov eax, INTERPRET_RUNTIME_ERROR
+  EmitU32(j, INTERPRET_RUNTIME_ERROR);
+  EmitJumpTo(j, jmp, sizeof(jmp), j->epilogue);
+}
+
+static void EmitBinary(Jit* j, uint8_t op) {
+  static const uint8_t add[] = { 0x03 };
+  static const uint8_t sub[] = { 0x2b };
+  static const uint8_t imul[] = { 0x0f, 0xaf };
+  static const uint8_t cmp[] = { 0x3b };
+  static const uint8_t cdq_idiv_ecx[] = { 0x99, 0xf7, 0xf9 };
+  static const uint8_t movzx_eax_al[] = { 0x0f, 0xb6, 0xc0 };
+
+  AdjustStack(j, -4);
+  LoadMem32(j, RAX, RBX, -4);
+  switch (op) {
+    case OP_ADD: EmitMem(j, 0, add, 1, RAX, RBX, 0); break;
+    case OP_SUBTRACT: EmitMem(j, 0, sub, 1, RAX, RBX, 0); break;
+    case OP_MULTIPLY: EmitMem(j, 0, imul, 2, RAX, RBX, 0); break;
+    case OP_DIVIDE:
+      LoadMem32(j, RCX, RBX, 0);
+      EmitBytes(j, cdq_idiv_ecx, sizeof(cdq_idiv_ecx));
+      break;
+    default: {
+      uint8_t setcc = 0;
+      switch (op) {
+        case OP_LESS: setcc = 0x9c; break;
+        case OP_GREATER: setcc = 0x9f; break;
+        case OP_LESS_EQUAL: setcc = 0x9e; break;
+        case OP_GREATER_EQUAL: setcc = 0x9d; break;
+        case OP_EQUAL: setcc = 0x94; break;
+        case OP_NOT_EQUAL: setcc = 0x95; break;
+      }
+      uint8_t set_al[] = { 0x0f, setcc, 0xc0 };
+      EmitMem(j, 0, cmp, 1, RAX, RBX, 0);
+      EmitBytes(j, set_al, sizeof(set_al));
+      EmitBytes(j, movzx_eax_al, sizeof(movzx_eax_al));
+      break;
+    }
+  }
+  StoreMem32(j, RBX, -4, RAX);
+}
+
+static int EmitInstruction(Jit* j, const Chunk* chunk, int pos) {
+  static const uint8_t jmp[] = { 0xe9 };
+  static const uint8_t jz[] = { 0x0f, 0x84 };
+  static const uint8_t jae[] = { 0x0f, 0x83 };
+  static const uint8_t call[] = { 0xe8 };
+  static const uint8_t test_eax[] = { 0x85, 0xc0 };
+  static const uint8_t push_r12[] = { 0x41, 0x54 };
+  static const uint8_t pop_r12[] = { 0x41, 0x5c };
+  static const uint8_t lea[] = { 0x8d };
+  static const uint8_t mov_rbx_r12[] = { 0x4c, 0x89, 0xe3 };
+  static const uint8_t ret[] = { 0xc3 };
+  static const uint8_t inc_dec_dword[] = { 0xff };
+  static const uint8_t cmp_dword_imm[] = { 0x81 };
+
+  const uint8_t* code = chunk->code;
+  uint8_t op = code[pos];
+  // One-byte instructions may end the code; they have no operand.
+  int operand = pos + 1 < chunk->count ? code[pos + 1] : 0;
+  int32_t depth = offsetof(JitContext, depth);
+
+  switch (op) {
+    case OP_CONSTANT:
+      if (operand >= chunk->constants_count) {
+        printf("JIT ERROR: Bad constant index %d at %d\n", operand, pos);
+        return 0;
+      }
+      CheckOverflow(j);
+      {
+        static const uint8_t mov_imm[] = { 0xc7 };
+        EmitMem(j, 0, mov_imm, 1, 0, RBX, 0);
+        EmitU32(j, (uint32_t)chunk->constants[operand]);
+      }
+      AdjustStack(j, 4);
+      break;
+    case OP_POP:
+      AdjustStack(j, -4);
+      break;
+    case OP_DEFINE_GLOBAL:
+      PopReg32(j, RAX);
+      StoreMem32(j, R13, operand * 4, RAX);
+      break;
+    case OP_GET_GLOBAL:
+      LoadMem32(j, RAX, R13, operand * 4);
+      PushReg32(j, RAX);
+      break;
+    case OP_SET_GLOBAL:
+      LoadMem32(j, RAX, RBX, -4);
+      StoreMem32(j, R13, operand * 4, RAX);
+      break;
+    case OP_GET_LOCAL:
+      LoadMem32(j, RAX, R12, operand * 4);
+      PushReg32(j, RAX);
+      break;
+    case OP_SET_LOCAL:
+      LoadMem32(j, RAX, RBX, -4);
+      StoreMem32(j, R12, operand * 4, RAX);
+      break;
+
+    case OP_ADD:
+    case OP_SUBTRACT:
+    case OP_MULTIPLY:
+    case OP_DIVIDE:
+    case OP_LESS:
+    case OP_GREATER:
+    case OP_LESS_EQUAL:
+    case OP_GREATER_EQUAL:
+    case OP_EQUAL:
+    case OP_NOT_EQUAL:
+      EmitBinary(j, op);
+      break;
+
+    case OP_JUMP:
+      EmitJumpToBytecode(j, jmp, sizeof(jmp), pos + 1 + ((code[pos + 1] << 8) | code[pos + 2]));
+      break;
+    case OP_JUMP_IF_FALSE:
+      PopReg32(j, RAX);
+      EmitBytes(j, test_eax, sizeof(test_eax));
+      EmitJumpToBytecode(j, jz, sizeof(jz), pos + 1 + ((code[pos + 1] << 8) | code[pos + 2]));
+      break;
+    case OP_LOOP:
+      EmitJumpToBytecode(j, jmp, sizeof(jmp), pos + 1 - ((code[pos + 1] << 8) | code[pos + 2]));
+      break;
+
+    case OP_IN:
+      EmitCallHelper(j, (void*)ReadValue);
+      StoreMem32(j, R13, operand * 4, RAX);
+      break;
+    case OP_IN_LOCAL:
+      EmitCallHelper(j, (void*)ReadValue);
+      StoreMem32(j, R12, operand * 4, RAX);
+      break;
+    case OP_OUT:
+      PopReg32(j, RDI);
+      EmitCallHelper(j, (void*)WriteValue);
+      break;
+
+    case OP_CALL: {
+      int target = (code[pos + 1] << 8) | code[pos + 2];
+      int argc = code[pos + 3];
+      EmitMem(j, 0, cmp_dword_imm, 1, 7, R14, depth);
+      EmitU32(j, CALLSTACK_MAX);
+      EmitJumpTo(j, jae, sizeof(jae), j->callstack_stub);
+      EmitMem(j, 0, inc_dec_dword, 1, 0, R14, depth);
+      EmitBytes(j, push_r12, sizeof(push_r12));
+      EmitMem(j, 1, lea, 1, R12, RBX, -4 * argc);
+      EmitJumpToBytecode(j, call, sizeof(call), target);
+      EmitBytes(j, pop_r12, sizeof(pop_r12));
+      break;
+    }
+    case OP_RETURN: {
+      EmitMem(j, 0, cmp_dword_imm, 1, 7, R14, depth);
+      EmitU32(j, 0);
+      EmitByte(j, 0xb8);  // mov eax, INTERPRET_OK
+      EmitU32(j, INTERPRET_OK);
+      EmitJumpTo(j, jz, sizeof(jz), j->epilogue);
+      LoadMem32(j, RAX, RBX, -4);
+      EmitBytes(j, mov_rbx_r12, sizeof(mov_rbx_r12));
+      StoreMem32(j, RBX, 0, RAX);
+      AdjustStack(j, 4);
+      EmitMem(j, 0, inc_dec_dword, 1, 1, R14, depth);
+      EmitBytes(j, ret, sizeof(ret));
+      break;
+    }
+    default:
+      printf("JIT ERROR: Unknown opcode %d at %d\n", op, pos);
+      return 0;
+  }
+  return 1;
+}
+
+static int CompileJit(Jit* j, const Chunk* chunk) {
+  j->native_of = (int*)malloc(((size_t)chunk->count + 1) * sizeof(int));
+  for (int i = 0; i <= chunk->count; i++) {
+    j->native_of[i] = -1;
+  }
+
+  EmitStubs(j);
+  int entry = j->count;
+  EmitPrologue(j);
+
+  for (int pos = 0; pos < chunk->count;) {
+    int operands = OperandBytes(chunk->code[pos]);
+    if (operands < 0 || pos + 1 + operands > chunk->count) {
+      printf("JIT ERROR: Bad instruction at %d\n", pos);
+      return -1;
+    }
+    j->native_of[pos] = j->count;
+    if (!EmitInstruction(j, chunk, pos)) {
+      return -1;
+    }
+    pos += 1 + operands;
+  }
+
+  for (int i = 0; i < j->patch_count; i++) {
+    int target = j->patches[i].target;
+    if (target < 0 || target >= chunk->count || j->native_of[target] < 0) {
+      printf("JIT ERROR: Bad jump target %d\n", target);
+      return -1;
+    }
+    int rel = j->native_of[target] - (j->patches[i].at + 4);
+    memcpy(&j->code[j->patches[i].at], &rel, 4);
+  }
+  return entry;
+}
+
+InterpretResult RunJit(const Chunk* chunk) {
+  Jit j;
+  memset(&j, 0, sizeof(j));
+
+  int entry = CompileJit(&j, chunk);
+  free(j.native_of);
+  free(j.patches);
+  if (entry < 0) {
+    free(j.code);
+    return INTERPRET_COMPILE_ERROR;
+  }
+
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t size = ((size_t)j.count + page - 1) / page * page;
+  uint8_t* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    perror("JIT ERROR: mmap");
+    free(j.code);
+    return INTERPRET_RUNTIME_ERROR;
+  }
+  memcpy(mem, j.code, (size_t)j.count);
+  free(j.code);
+  if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+    perror("JIT ERROR: mprotect");
+    munmap(mem, size);
+    return INTERPRET_RUNTIME_ERROR;
+  }
+
+  JitContext* ctx = (JitContext*)calloc(1, sizeof(JitContext));
+  ctx->stack_top = ctx->stack;
+  ctx->globals = ctx->global_slots;
+  ctx->stack_limit = ctx->stack + STACK_MAX;
+
+  int (*run)(JitContext*) = (int (*)(JitContext*))(void*)(mem + entry);
+  InterpretResult result = (InterpretResult)run(ctx);
+  FlushOutput();
+
+  free(ctx);
+  munmap(mem, size);
+  return result;
+}
+
+static InterpretResult RunInterpreter(void* chunk) {
+  return InterpretChunk((Chunk*)chunk);
+}
+
+static InterpretResult RunJitChunk(void* chunk) {
+  return RunJit((const Chunk*)chunk);
+}
+
+InterpretResult VerifyJit(Chunk* chunk) {
+  VerifyEngine interpreter = { "interpreter", RunInterpreter, chunk };
+  VerifyEngine jit = { "jit", RunJitChunk, chunk };
+  return VerifyEngines("JIT VERIFY", interpreter, jit);
+}
+
+#else
+
+InterpretResult RunJit(const Chunk* chunk) {
+  fprintf(stderr, "JIT is not supported on this platform, using the interpreter.\n");
+  return InterpretChunk((Chunk*)chunk);
+}
+
+InterpretResult VerifyJit(Chunk* chunk) {
+  return RunJit(chunk);
+}
+
+#endif
+
+InterpretResult InterpretJit(const char* source, int verify) {
+  Chunk* chunk = CompileSource(source);
+  if (chunk == NULL) {
+    return INTERPRET_COMPILE_ERROR;
+  }
+
+  InterpretResult result = verify ? VerifyJit(chunk) : RunJit(chunk);
+
+  FreeChunk(chunk);
+  free(chunk);
+  return result;
+}
@@ -0,0 +1,10 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "../vm/vm.h"
+
+InterpretResult RunJit(const Chunk* chunk);
+InterpretResult VerifyJit(Chunk* chunk);
+InterpretResult InterpretJit(const char* source, int verify);
+
+#endif
@@ -1,9 +1,13 @@
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <limits.h>
 #include "lexer.h"
 
 static void ReadChar(Lexer* l) {
+  if (l->ch == '\n') {
+    l->line++;
+    l->line_start = l->read_position;
+  }
   if ((size_t)l->read_position >= l->input_len) {
     l->ch = 0;
   } else {
@@ -13,6 +17,13 @@ static void ReadChar(Lexer* l) {
   l->read_position += 1;
 }
 
+// Moves to pos; the bytes skipped must not include a '\n'.
+static void SeekTo(Lexer* l, size_t pos) {
+  l->position = (int)pos;
+  l->read_position = (int)pos + 1;
+  l->ch = pos < l->input_len ? l->input[pos] : 0;
+}
+
 Lexer* NewLexer(const char* input) {
   Lexer* l = (Lexer*)malloc(sizeof(Lexer));
   l->input = input;
@@ -20,72 +31,140 @@ Lexer* NewLexer(const char* input) {
   l->position = 0;
   l->read_position = 0;
   l->ch = 0;
+  l->line = 1;
+  l->line_start = 0;
+  l->scan = GetScanner();
   ReadChar(l);
   return l;
 }
 
-static void SkipWhiteSpace(Lexer* l) {
-  while (isspace((unsigned char)l->ch)) {
-    ReadChar(l);
-  }
-}
+// Runs up to this long are scanned inline; most tokens and the gaps
+// between them are that short. Longer runs continue in the vector scanner,
+// called out of line so that NextToken itself stays free of calls.
+#define INLINE_SCAN 8
 
-static char* ReadIdentifier(Lexer* l) {
-  int start = l->position;
-  ReadChar(l);
-  while (isalnum((unsigned char)l->ch) || l->ch == '_') {
-    ReadChar(l);
-  }
-  int length = l->position - start;
-  char* ident = (char*)malloc((size_t)length + 1);
-  memcpy(ident, &l->input[start], (size_t)length);
-  ident[length] = '\0';
-  return ident;
+static void UpdateLines(Lexer* l, int newlines, size_t last_newline) {
+  if (newlines > 0) {
+    l->line += newlines;
+    l->line_start = (int)last_newline + 1;
+  }
 }
 
-static char* ReadNumber(Lexer* l) {
-  int start = l->position;
-  while (isdigit((unsigned char)l->ch)) {
-    ReadChar(l);
-  }
-  int length = l->position - start;
-  char* num = (char*)malloc((size_t)length + 1);
-  memcpy(num, &l->input[start], (size_t)length);
-  num[length] = '\0';
-  return num;
+__attribute__((noinline))
+static void SkipLongWhiteSpace(Lexer* l, size_t pos, int newlines, size_t last_newline) {
+  int more = 0;
+  size_t last = 0;
+  pos = l->scan->space(l->input, pos, l->input_len, &more, &last);
+  UpdateLines(l, newlines, last_newline);
+  UpdateLines(l, more, last);
+  SeekTo(l, pos);
 }
 
-static TokenType LookUpIdent(const char* ident) {
-  if (strcmp(ident, "let") == 0) {
-    return TOKEN_LET;
+static void SkipWhiteSpace(Lexer* l) {
+  if (!IsSpace(l->ch)) {
+    return;
   }
-  if (strcmp(ident, "if") == 0) {
-    return TOKEN_IF;
+  const char* s = l->input;
+  size_t pos = (size_t)l->position;
+  size_t end = l->input_len;
+  size_t limit = pos + INLINE_SCAN < end ? pos + INLINE_SCAN : end;
+  int newlines = 0;
+  size_t last_newline = 0;
+  while (pos < limit && IsSpace(s[pos])) {
+    if (s[pos] == '\n') {
+      newlines++;
+      last_newline = pos;
+    }
+    pos++;
   }
-  if (strcmp(ident, "else") == 0) {
-    return TOKEN_ELSE;
+  if (pos == limit && pos < end && IsSpace(s[pos])) {
+    SkipLongWhiteSpace(l, pos, newlines, last_newline);
+    return;
   }
-  if (strcmp(ident, "while") == 0) {
-    return TOKEN_WHILE;
+  UpdateLines(l, newlines, last_newline);
+  SeekTo(l, pos);
+}
+
+// Stops on the '\n' that ends the comment, or at the end of input.
+__attribute__((noinline))
+static void SkipComment(Lexer* l) {
+  const char* at = l->input + l->position;
+  const char* newline = (const char*)memchr(at, '\n', l->input_len - (size_t)l->position);
+  SeekTo(l, newline != NULL ? (size_t)(newline - l->input) : l->input_len);
+}
+
+__attribute__((noinline))
+static size_t ScanLongIdentifier(const Lexer* l, size_t pos) {
+  return l->scan->ident(l->input, pos, l->input_len);
+}
+
+__attribute__((noinline))
+static size_t ScanLongNumber(const Lexer* l, size_t pos) {
+  return l->scan->digits(l->input, pos, l->input_len);
+}
+
+static void ReadIdentifier(Lexer* l) {
+  const char* s = l->input;
+  size_t pos = (size_t)l->position + 1;
+  size_t limit = pos + INLINE_SCAN < l->input_len ? pos + INLINE_SCAN : l->input_len;
+  while (pos < limit && IsIdentChar(s[pos])) {
+    pos++;
   }
-  if (strcmp(ident, "out") == 0) {
-    return TOKEN_OUT;
+  if (pos == limit && pos < l->input_len && IsIdentChar(s[pos])) {
+    pos = ScanLongIdentifier(l, pos);
   }
-  if (strcmp(ident, "in") == 0) {
-    return TOKEN_IN;
+  SeekTo(l, pos);
+}
+
+// Same result as atoi: saturates like strtol, then truncates to int.
+static int ReadNumber(Lexer* l) {
+  const char* s = l->input;
+  size_t pos = (size_t)l->position;
+  size_t limit = pos + INLINE_SCAN < l->input_len ? pos + INLINE_SCAN : l->input_len;
+  while (pos < limit && IsDigit(s[pos])) {
+    pos++;
   }
-  if (strcmp(ident, "ns") == 0) {
-    return TOKEN_NS;
+  if (pos == limit && pos < l->input_len && IsDigit(s[pos])) {
+    pos = ScanLongNumber(l, pos);
   }
-  if (strcmp(ident, "fn") == 0) {
-    return TOKEN_FN;
+  long value = 0;
+  for (size_t i = (size_t)l->position; i < pos; i++) {
+    int digit = s[i] - '0';
+    value = value > (LONG_MAX - digit) / 10 ? LONG_MAX : value * 10 + digit;
   }
-  if (strcmp(ident, "return") == 0) {
-    return TOKEN_RETURN;
+  SeekTo(l, pos);
+  return (int)value;
+}
+
+#define KEYWORD(text, type) \
+  return memcmp(ident, text, sizeof(text) - 1) == 0 ? (type) : TOKEN_IDENT
+
+// Keywords are told apart by length and first letter, then one memcmp
+// confirms the candidate.
+static TokenType LookUpIdent(const char* ident, int length) {
+  switch (length) {
+    case 2:
+      switch (ident[0]) {
+        case 'i': return ident[1] == 'f' ? TOKEN_IF : ident[1] == 'n' ? TOKEN_IN : TOKEN_IDENT;
+        case 'n': KEYWORD("ns", TOKEN_NS);
+        case 'f': KEYWORD("fn", TOKEN_FN);
+      }
+      break;
+    case 3:
+      switch (ident[0]) {
+        case 'l': KEYWORD("let", TOKEN_LET);
+        case 'o': KEYWORD("out", TOKEN_OUT);
+      }
+      break;
+    case 4: KEYWORD("else", TOKEN_ELSE);
+    case 5: KEYWORD("while", TOKEN_WHILE);
+    case 6: KEYWORD("return", TOKEN_RETURN);
   }
   return TOKEN_IDENT;
 }
 
+#undef KEYWORD
+
 static char PeekChar(Lexer* l) {
   if ((size_t)l->read_position >= l->input_len) {
     return 0;
@@ -94,133 +173,147 @@ static char PeekChar(Lexer* l) {
   }
 }
 
-static Token NewToken(TokenType type, char* literal) {
+static Token NewToken(TokenType type) {
   Token tok;
   tok.type = type;
-  tok.literal = literal;
+  tok.start = NULL;
+  tok.length = 0;
+  tok.value = 0;
+  tok.line = 0;
+  tok.column = 0;
   return tok;
 }
 
 Token NextToken(Lexer* l) {
   Token tok;
 
-  SkipWhiteSpace(l);
+  for (;;) {
+    SkipWhiteSpace(l);
+    if (l->ch != '/' || PeekChar(l) != '/') {
+      break;
+    }
+    SkipComment(l);
+  }
+  int line = l->line;
+  int column = l->position - l->line_start + 1;
+  int start = l->position;
 
   switch (l->ch) {
     case '=':
       if (PeekChar(l) == '=') {
         ReadChar(l);
-        tok = NewToken(TOKEN_EQUAL, "==");
+        tok = NewToken(TOKEN_EQUAL);
       } else {
-        tok = NewToken(TOKEN_ASSIGN, "=");
+        tok = NewToken(TOKEN_ASSIGN);
       }
       break;
 
     case ';':
-      tok = NewToken(TOKEN_SEMICOLON, ";");
+      tok = NewToken(TOKEN_SEMICOLON);
       break;
     case ',':
-      tok = NewToken(TOKEN_COMMA, ",");
+      tok = NewToken(TOKEN_COMMA);
       break;
     case '.':
-      tok = NewToken(TOKEN_DOT, ".");
+      tok = NewToken(TOKEN_DOT);
       break;
 
     case '(' :
-      tok = NewToken(TOKEN_LPAREN, "(");
+      tok = NewToken(TOKEN_LPAREN);
       break;
     case ')' :
-      tok = NewToken(TOKEN_RPAREN, ")");
+      tok = NewToken(TOKEN_RPAREN);
       break;
     case '{' :
-      tok = NewToken(TOKEN_LBRACE, "{");
+      tok = NewToken(TOKEN_LBRACE);
       break;
     case '}' :
-      tok = NewToken(TOKEN_RBRACE, "}");
+      tok = NewToken(TOKEN_RBRACE);
       break;
 
     case '+':
-      tok = NewToken(TOKEN_PLUS, "+");
+      tok = NewToken(TOKEN_PLUS);
       break;
     case '*':
-      tok = NewToken(TOKEN_ASTERISK, "*");
+      tok = NewToken(TOKEN_ASTERISK);
       break;
 
     case '-':
       if (PeekChar(l) == '>') {
         ReadChar(l);
-        tok = NewToken(TOKEN_ARROW, "->");
+        tok = NewToken(TOKEN_ARROW);
       } else {
-        tok = NewToken(TOKEN_MINUS, "-");
+        tok = NewToken(TOKEN_MINUS);
       }
       break;
 
     case '/':
-      if (PeekChar(l) == '/') {
-        while (l->ch != '\n' && l->ch != 0) {
-          ReadChar(l);
-        }
-        return NextToken(l);
-      } else {
-        tok = NewToken(TOKEN_SLASH, "/");
-      }
+      tok = NewToken(TOKEN_SLASH);
       break;
 
     case '<':
       if (PeekChar(l) == '=') {
         ReadChar(l);
-        tok = NewToken(TOKEN_LESS_EQUAL, "<=");
+        tok = NewToken(TOKEN_LESS_EQUAL);
       } else {
-        tok = NewToken(TOKEN_LESS, "<");
+        tok = NewToken(TOKEN_LESS);
       }
       break;
 
     case '>':
       if (PeekChar(l) == '=') {
         ReadChar(l);
-        tok = NewToken(TOKEN_GREATER_EQUAL, ">=");
+        tok = NewToken(TOKEN_GREATER_EQUAL);
       } else {
-        tok = NewToken(TOKEN_GREATER, ">");
+        tok = NewToken(TOKEN_GREATER);
       }
       break;
 
     case '!':
       if (PeekChar(l) == '=') {
         ReadChar(l);
-        tok = NewToken(TOKEN_NOT_EQUAL, "!=");
+        tok = NewToken(TOKEN_NOT_EQUAL);
       } else {
-        char* illegal = (char*)malloc(2);
-        illegal[0] = '!';
-        illegal[1] = '\0';
-        tok = NewToken(TOKEN_ILLEGAL, illegal);
+        tok = NewToken(TOKEN_ILLEGAL);
       }
       break;
 
     case 0:
-      tok = NewToken(TOKEN_EOF, "");
+      tok = NewToken(TOKEN_EOF);
       break;
 
     default:
-      if (isalpha((unsigned char)l->ch) || l->ch == '_') {
-        char* literal = ReadIdentifier(l);
-        TokenType type = LookUpIdent(literal);
-        tok.type = type;
-        tok.literal = literal;
+      if (IsIdentStart(l->ch)) {
+        ReadIdentifier(l);
+        tok = NewToken(TOKEN_IDENT);
+        tok.start = &l->input[start];
+        tok.length = l->position - start;
+        tok.type = LookUpIdent(tok.start, tok.length);
+        tok.line = line;
+        tok.column = column;
         return tok;
-      } else if (isdigit((unsigned char)l->ch)) {
-        char* literal = ReadNumber(l);
-        tok.type = TOKEN_INT;
-        tok.literal = literal;
+      } else if (IsDigit(l->ch)) {
+        tok = NewToken(TOKEN_INT);
+        tok.value = ReadNumber(l);
+        tok.start = &l->input[start];
+        tok.length = l->position - start;
+        tok.line = line;
+        tok.column = column;
         return tok;
       } else {
-        char* illegal_char_str = (char*)malloc(2);
-        illegal_char_str[0] = l->ch;
-        illegal_char_str[1] = '\0';
-        tok = NewToken(TOKEN_ILLEGAL, illegal_char_str);
+        tok = NewToken(TOKEN_ILLEGAL);
       }
       break;
   }
 
+  if (tok.type == TOKEN_EOF) {
+    tok.start = l->input + l->input_len;
+  } else {
+    tok.start = &l->input[start];
+    tok.length = l->position + 1 - start;
+  }
+  tok.line = line;
+  tok.column = column;
   ReadChar(l);
   return tok;
 }
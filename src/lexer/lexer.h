@@ -2,6 +2,7 @@
 #define LEXER_H
 
 #include "../common/token.h"
+#include "scan.h"
 
 typedef struct {
   const char* input;
@@ -9,6 +10,9 @@ typedef struct {
   int position;
   int read_position;
   char ch;
+  int line;        // of ch, 1-based
+  int line_start;  // offset of the first byte of that line
+  const Scanner* scan;
 } Lexer;
 
 Lexer* NewLexer(const char* input);
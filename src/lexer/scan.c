@@ -0,0 +1,191 @@
+#include <stdlib.h>
+#include <string.h>
+#include "scan.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CCB_X86_SIMD
+#endif
+
+const unsigned char char_class[256] = {
+  [' '] = CHAR_SPACE, ['\t'] = CHAR_SPACE, ['\n'] = CHAR_SPACE,
+  ['\v'] = CHAR_SPACE, ['\f'] = CHAR_SPACE, ['\r'] = CHAR_SPACE,
+  ['0' ... '9'] = CHAR_DIGIT,
+  ['a' ... 'z'] = CHAR_ALPHA,
+  ['A' ... 'Z'] = CHAR_ALPHA,
+  ['_'] = CHAR_ALPHA,
+};
+
+static size_t SpaceScalar(const char* s, size_t pos, size_t end, int* newlines, size_t* last_newline) {
+  while (pos < end && IsSpace(s[pos])) {
+    if (s[pos] == '\n') {
+      (*newlines)++;
+      *last_newline = pos;
+    }
+    pos++;
+  }
+  return pos;
+}
+
+static size_t IdentScalar(const char* s, size_t pos, size_t end) {
+  while (pos < end && IsIdentChar(s[pos])) {
+    pos++;
+  }
+  return pos;
+}
+
+static size_t DigitsScalar(const char* s, size_t pos, size_t end) {
+  while (pos < end && IsDigit(s[pos])) {
+    pos++;
+  }
+  return pos;
+}
+
+static const Scanner scalar_scanner = {"scalar", SpaceScalar, IdentScalar, DigitsScalar};
+
+#ifdef CCB_X86_SIMD
+
+// The vector loops take one block at a time; stop is the bitmask of bytes
+// outside the class, and the first of them ends the run. The tail shorter
+// than a block goes to the scalar loop.
+
+// Byte-wise lo <= c <= hi as the unsigned test c - lo <= hi - lo.
+static inline __m128i InRange16(__m128i c, char lo, char hi) {
+  __m128i d = _mm_sub_epi8(c, _mm_set1_epi8(lo));
+  return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8((char)(hi - lo))), d);
+}
+
+static inline __m128i IdentMask16(__m128i c) {
+  __m128i letters = InRange16(_mm_or_si128(c, _mm_set1_epi8(0x20)), 'a', 'z');
+  __m128i other = _mm_or_si128(InRange16(c, '0', '9'), _mm_cmpeq_epi8(c, _mm_set1_epi8('_')));
+  return _mm_or_si128(letters, other);
+}
+
+static size_t SpaceSse2(const char* s, size_t pos, size_t end, int* newlines, size_t* last_newline) {
+  while (pos + 16 <= end) {
+    __m128i c = _mm_loadu_si128((const __m128i*)(s + pos));
+    __m128i space = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')), InRange16(c, '\t', '\r'));
+    unsigned stop = ~(unsigned)_mm_movemask_epi8(space) & 0xffff;
+    unsigned nl = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8('\n')));
+    if (stop != 0) {
+      nl &= (1u << __builtin_ctz(stop)) - 1;
+    }
+    if (nl != 0) {
+      *newlines += __builtin_popcount(nl);
+      *last_newline = pos + 31 - __builtin_clz(nl);
+    }
+    if (stop != 0) {
+      return pos + __builtin_ctz(stop);
+    }
+    pos += 16;
+  }
+  return SpaceScalar(s, pos, end, newlines, last_newline);
+}
+
+static size_t IdentSse2(const char* s, size_t pos, size_t end) {
+  while (pos + 16 <= end) {
+    __m128i c = _mm_loadu_si128((const __m128i*)(s + pos));
+    unsigned stop = ~(unsigned)_mm_movemask_epi8(IdentMask16(c)) & 0xffff;
+    if (stop != 0) {
+      return pos + __builtin_ctz(stop);
+    }
+    pos += 16;
+  }
+  return IdentScalar(s, pos, end);
+}
+
+static size_t DigitsSse2(const char* s, size_t pos, size_t end) {
+  while (pos + 16 <= end) {
+    __m128i c = _mm_loadu_si128((const __m128i*)(s + pos));
+    unsigned stop = ~(unsigned)_mm_movemask_epi8(InRange16(c, '0', '9')) & 0xffff;
+    if (stop != 0) {
+      return pos + __builtin_ctz(stop);
+    }
+    pos += 16;
+  }
+  return DigitsScalar(s, pos, end);
+}
+
+static const Scanner sse2_scanner = {"sse2", SpaceSse2, IdentSse2, DigitsSse2};
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i InRange32(__m256i c, char lo, char hi) {
+  __m256i d = _mm256_sub_epi8(c, _mm256_set1_epi8(lo));
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8((char)(hi - lo))), d);
+}
+
+AVX2 static inline __m256i IdentMask32(__m256i c) {
+  __m256i letters = InRange32(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), 'a', 'z');
+  __m256i other = _mm256_or_si256(InRange32(c, '0', '9'), _mm256_cmpeq_epi8(c, _mm256_set1_epi8('_')));
+  return _mm256_or_si256(letters, other);
+}
+
+AVX2 static size_t SpaceAvx2(const char* s, size_t pos, size_t end, int* newlines, size_t* last_newline) {
+  while (pos + 32 <= end) {
+    __m256i c = _mm256_loadu_si256((const __m256i*)(s + pos));
+    __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(' ')), InRange32(c, '\t', '\r'));
+    unsigned stop = ~(unsigned)_mm256_movemask_epi8(space);
+    unsigned nl = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('\n')));
+    if (stop != 0) {
+      nl &= (1u << __builtin_ctz(stop)) - 1;
+    }
+    if (nl != 0) {
+      *newlines += __builtin_popcount(nl);
+      *last_newline = pos + 31 - __builtin_clz(nl);
+    }
+    if (stop != 0) {
+      return pos + __builtin_ctz(stop);
+    }
+    pos += 32;
+  }
+  return SpaceSse2(s, pos, end, newlines, last_newline);
+}
+
+AVX2 static size_t IdentAvx2(const char* s, size_t pos, size_t end) {
+  while (pos + 32 <= end) {
+    __m256i c = _mm256_loadu_si256((const __m256i*)(s + pos));
+    unsigned stop = ~(unsigned)_mm256_movemask_epi8(IdentMask32(c));
+    if (stop != 0) {
+      return pos + __builtin_ctz(stop);
+    }
+    pos += 32;
+  }
+  return IdentSse2(s, pos, end);
+}
+
+AVX2 static size_t DigitsAvx2(const char* s, size_t pos, size_t end) {
+  while (pos + 32 <= end) {
+    __m256i c = _mm256_loadu_si256((const __m256i*)(s + pos));
+    unsigned stop = ~(unsigned)_mm256_movemask_epi8(InRange32(c, '0', '9'));
+    if (stop != 0) {
+      return pos + __builtin_ctz(stop);
+    }
+    pos += 32;
+  }
+  return DigitsSse2(s, pos, end);
+}
+
+static const Scanner avx2_scanner = {"avx2", SpaceAvx2, IdentAvx2, DigitsAvx2};
+
+#endif
+
+const Scanner* GetScanner() {
+  static const Scanner* selected;
+  if (selected == NULL) {
+    const char* env = getenv("CCB_LEXER_SIMD");
+    const Scanner* scanner = &scalar_scanner;
+#ifdef CCB_X86_SIMD
+    __builtin_cpu_init();
+    scanner = __builtin_cpu_supports("avx2") ? &avx2_scanner : &sse2_scanner;
+    if (env != NULL && strcmp(env, "sse2") == 0) {
+      scanner = &sse2_scanner;
+    }
+#endif
+    if (env != NULL && strcmp(env, "scalar") == 0) {
+      scanner = &scalar_scanner;
+    }
+    selected = scanner;
+  }
+  return selected;
+}
@@ -0,0 +1,46 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+enum {
+  CHAR_SPACE = 1,
+  CHAR_DIGIT = 2,
+  CHAR_ALPHA = 4,  // letters and '_'
+};
+
+// Fixed ASCII classes, so lexing does not depend on the C locale.
+extern const unsigned char char_class[256];
+
+static inline int IsSpace(char c) {
+  return char_class[(unsigned char)c] & CHAR_SPACE;
+}
+
+static inline int IsDigit(char c) {
+  return char_class[(unsigned char)c] & CHAR_DIGIT;
+}
+
+static inline int IsIdentStart(char c) {
+  return char_class[(unsigned char)c] & CHAR_ALPHA;
+}
+
+static inline int IsIdentChar(char c) {
+  return char_class[(unsigned char)c] & (CHAR_ALPHA | CHAR_DIGIT);
+}
+
+// Each function returns the index of the first byte in s[pos, end) outside
+// its class, or end. They may read whole vectors only within s[0, end).
+typedef struct {
+  const char* name;
+  // Whitespace; also counts the '\n' bytes skipped and records the last.
+  size_t (*space)(const char* s, size_t pos, size_t end, int* newlines, size_t* last_newline);
+  // Letters, digits and '_'.
+  size_t (*ident)(const char* s, size_t pos, size_t end);
+  size_t (*digits)(const char* s, size_t pos, size_t end);
+} Scanner;
+
+// The widest variant the CPU supports (checked once with CPUID), unless
+// CCB_LEXER_SIMD=scalar|sse2|avx2 asks for a narrower one.
+const Scanner* GetScanner();
+
+#endif
@@ -0,0 +1,59 @@
+#include <stdlib.h>
+#include "../../include/ccb.h"
+#include "../vm/vm.h"
+#include "../common/ccbc.h"
+
+struct CcbProgram {
+  Chunk* chunk;
+  DecodedChunk decoded;
+};
+
+static CcbProgram* Wrap(Chunk* chunk) {
+  if (chunk == NULL) {
+    return NULL;
+  }
+
+  CcbProgram* program = (CcbProgram*)malloc(sizeof(CcbProgram));
+  program->chunk = chunk;
+  if (!DecodeChunk(chunk, &program->decoded)) {
+    FreeChunk(chunk);
+    free(chunk);
+    free(program);
+    return NULL;
+  }
+  return program;
+}
+
+CcbProgram* CcbCompile(const char* source) {
+  return Wrap(CompileSource(source));
+}
+
+CcbProgram* CcbLoad(const char* path) {
+  return Wrap(LoadBytecodeFile(path));
+}
+
+void CcbFreeProgram(CcbProgram* program) {
+  if (program == NULL) {
+    return;
+  }
+  FreeDecoded(&program->decoded);
+  FreeChunk(program->chunk);
+  free(program->chunk);
+  free(program);
+}
+
+CcbResult CcbRun(const CcbProgram* program, const CcbIO* io) {
+  VM vm;
+  ResetVM(&vm);
+  if (io != NULL) {
+    SetVMIO(&vm, io->input, io->output, io->user);
+  } else {
+    SetVMIO(&vm, NULL, NULL, NULL);
+  }
+
+  switch (RunVM(&vm, &program->decoded)) {
+    case INTERPRET_OK: return CCB_OK;
+    case INTERPRET_COMPILE_ERROR: return CCB_COMPILE_ERROR;
+    default: return CCB_RUNTIME_ERROR;
+  }
+}
@@ -2,9 +2,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include "vm/vm.h"
+#include "vm/regvm.h"
+#include "vm/disasm.h"
+#include "jit/jit.h"
 #include "common/token.h"
 #include "lexer/lexer.h"
 #include "parser/parser.h"
+#include "codegen/cgen.h"
+#include "common/ccbc.h"
+#include "cache/cache.h"
+#include "stats/stats.h"
 
 static char* ReadFile(const char* path) {
   FILE* file = fopen(path, "rb");
@@ -37,41 +44,346 @@ static char* ReadFile(const char* path) {
   return buffer;
 }
 
-static int HasCcbExtension(const char* path) {
+static int HasExtension(const char* path, const char* extension) {
   const char* dot = strrchr(path, '.');
   if (dot == NULL) {
     return 0;
   }
-  return strcasecmp(dot, ".ccb") == 0;
+  return strcasecmp(dot, extension) == 0;
+}
+
+static int EmitC(const char* source, const char* path, const char* out_path) {
+  Lexer* l = NewLexer(source);
+  Parser* p = NewParser(l);
+  Program* program = ParseProgram(p);
+
+  int ok = 0;
+  if (program != NULL && !p->had_error) {
+    FILE* out = fopen(out_path, "w");
+    if (out == NULL) {
+      fprintf(stderr, "Could not open file \"%s\".\n", out_path);
+    } else {
+      ok = EmitProgramC(program, path, out);
+      fclose(out);
+      if (!ok) {
+        remove(out_path);
+      }
+    }
+  }
+  FreeProgram(program);
+
+  free(p->ns_prefix);
+  free(l);
+  free(p);
+  return ok;
+}
+
+static void PrintUsage(const char* program) {
+  fprintf(stderr, "Usage: %s [options] [path]\n", program);
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --register     run on the register-based VM\n");
+  fprintf(stderr, "  --register-verify  run both the stack and the register VM and compare their output\n");
+  fprintf(stderr, "  --jit          compile to native x86-64 code and run it\n");
+  fprintf(stderr, "  --jit-verify   run both the interpreter and the JIT and compare their output\n");
+  fprintf(stderr, "  --emit-c FILE  translate the program to C and write it to FILE\n");
+  fprintf(stderr, "  --emit-bytecode FILE  compile the program and save its bytecode (.ccbc) to FILE\n");
+  fprintf(stderr, "  --disasm       compile the program and print its bytecode with a static summary instead of running it\n");
+  fprintf(stderr, "  --binary-output  write `out` values as little-endian int32 instead of text\n");
+  fprintf(stderr, "  --binary-input   read `in` values as little-endian int32 instead of text\n");
+  fprintf(stderr, "  --cache        reuse compiled bytecode from the on-disk cache (CCB_CACHE_DIR)\n");
+  fprintf(stderr, "  --cache-stats  print cache hit/miss counters and size, then exit\n");
+  fprintf(stderr, "  --profile-ops   count instructions, cycles and opcode pairs; report to stderr\n");
+  fprintf(stderr, "  --profile-ops-json FILE  same, written to FILE as JSON\n");
+  fprintf(stderr, "  --profile-functions  calls, inclusive and exclusive cycles per function; report to stderr\n");
+  fprintf(stderr, "  --profile-lines  print the source annotated with per-line instruction counts\n");
+  fprintf(stderr, "  --profile-flamegraph FILE  write collapsed call stacks for flamegraph.pl to FILE\n");
+  fprintf(stderr, "  --stats        time each compiler phase and report sizes, peak memory and run counters to stderr\n");
+  fprintf(stderr, "  --stats-json FILE  same, written to FILE as JSON\n");
+  fprintf(stderr, "A .ccbc path is loaded and run without recompiling.\n");
+}
+
+typedef enum {
+  ENGINE_STACK,
+  ENGINE_REGISTER,
+  ENGINE_REGISTER_VERIFY,
+  ENGINE_JIT,
+  ENGINE_JIT_VERIFY,
+  ENGINE_PROFILE_OPS,
+  ENGINE_PROFILE_FUNCTIONS,
+  ENGINE_PROFILE_FLAMEGRAPH,
+  ENGINE_PROFILE_LINES,
+  ENGINE_STATS
+} Engine;
+
+static InterpretResult ProfileOps(Chunk* chunk, const char* json_path) {
+  DecodedChunk decoded;
+  if (!DecodeChunk(chunk, &decoded)) {
+    return INTERPRET_COMPILE_ERROR;
+  }
+
+  VM* vm = NewVM();
+  OpProfile* profile = NewOpProfile();
+  InterpretResult result = RunVMProfiled(vm, &decoded, profile);
+
+  if (json_path != NULL) {
+    FILE* out = fopen(json_path, "w");
+    if (out == NULL) {
+      fprintf(stderr, "Could not open file \"%s\".\n", json_path);
+    } else {
+      WriteOpProfileJson(profile, out);
+      fclose(out);
+    }
+  } else {
+    PrintOpProfile(profile, stderr);
+  }
+
+  free(profile);
+  FreeVM(vm);
+  FreeDecoded(&decoded);
+  return result;
+}
+
+// The stderr report is printed when asked for; collapsed stacks are written
+// whenever flamegraph_path is set.
+static InterpretResult ProfileFunctions(Chunk* chunk, int report, const char* flamegraph_path) {
+  DecodedChunk decoded;
+  if (!DecodeChunk(chunk, &decoded)) {
+    return INTERPRET_COMPILE_ERROR;
+  }
+
+  VM* vm = NewVM();
+  FnProfile* profile = NewFnProfile(chunk, &decoded);
+  InterpretResult result = RunVMCallProfiled(vm, &decoded, profile);
+
+  if (flamegraph_path != NULL) {
+    FILE* out = fopen(flamegraph_path, "w");
+    if (out == NULL) {
+      fprintf(stderr, "Could not open file \"%s\".\n", flamegraph_path);
+    } else {
+      WriteCollapsedStacks(profile, out);
+      fclose(out);
+    }
+  }
+  if (report) {
+    PrintFnProfile(profile, stderr);
+  }
+
+  FreeFnProfile(profile);
+  FreeVM(vm);
+  FreeDecoded(&decoded);
+  return result;
+}
+
+// source is NULL for a loaded .ccbc; the report then lists line numbers only.
+static InterpretResult ProfileLines(Chunk* chunk, const char* source) {
+  DecodedChunk decoded;
+  if (!DecodeChunk(chunk, &decoded)) {
+    return INTERPRET_COMPILE_ERROR;
+  }
+
+  VM* vm = NewVM();
+  uint64_t* hits = (uint64_t*)calloc((size_t)decoded.count + 1, sizeof(uint64_t));
+  InterpretResult result = RunVMLineProfiled(vm, &decoded, hits);
+  PrintLineProfile(chunk, &decoded, hits, source, stderr);
+
+  free(hits);
+  FreeVM(vm);
+  FreeDecoded(&decoded);
+  return result;
+}
+
+static InterpretResult RunChunk(Chunk* chunk, const char* source, Engine engine, const char* profile_path) {
+  switch (engine) {
+    case ENGINE_JIT: return RunJit(chunk);
+    case ENGINE_JIT_VERIFY: return VerifyJit(chunk);
+    case ENGINE_PROFILE_OPS: return ProfileOps(chunk, profile_path);
+    case ENGINE_PROFILE_FUNCTIONS: return ProfileFunctions(chunk, 1, profile_path);
+    case ENGINE_PROFILE_FLAMEGRAPH: return ProfileFunctions(chunk, 0, profile_path);
+    case ENGINE_PROFILE_LINES: return ProfileLines(chunk, source);
+    default: return InterpretChunk(chunk);
+  }
+}
+
+static InterpretResult Stats(const char* source, const char* json_path) {
+  CompilerStats stats;
+  InterpretResult result = CollectStats(source, &stats);
+
+  if (json_path != NULL) {
+    FILE* out = fopen(json_path, "w");
+    if (out == NULL) {
+      fprintf(stderr, "Could not open file \"%s\".\n", json_path);
+    } else {
+      WriteStatsJson(&stats, out);
+      fclose(out);
+    }
+  } else {
+    PrintStats(&stats, stderr);
+  }
+  return result;
+}
+
+static int ExitCode(InterpretResult result) {
+  if (result == INTERPRET_COMPILE_ERROR) {
+    return 65;
+  }
+  if (result == INTERPRET_RUNTIME_ERROR) {
+    return 70;
+  }
+  return 0;
 }
 
 int main(int argc, char* argv[]) {
-  if (argc != 2) {
-    fprintf(stderr, "Usage: %s [path]\n", argv[0]);
+  const char* path = NULL;
+  const char* c_path = NULL;
+  const char* bytecode_path = NULL;
+  int use_cache = 0;
+  int disasm = 0;
+  int quiet = 0;
+  const char* profile_path = NULL;
+  Engine engine = ENGINE_STACK;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--register") == 0) {
+      engine = ENGINE_REGISTER;
+    } else if (strcmp(argv[i], "--register-verify") == 0) {
+      engine = ENGINE_REGISTER_VERIFY;
+    } else if (strcmp(argv[i], "--jit") == 0) {
+      engine = ENGINE_JIT;
+    } else if (strcmp(argv[i], "--jit-verify") == 0) {
+      engine = ENGINE_JIT_VERIFY;
+    } else if (strcmp(argv[i], "--emit-c") == 0 && i + 1 < argc) {
+      c_path = argv[++i];
+    } else if (strcmp(argv[i], "--emit-bytecode") == 0 && i + 1 < argc) {
+      bytecode_path = argv[++i];
+    } else if (strcmp(argv[i], "--disasm") == 0) {
+      disasm = 1;
+    } else if (strcmp(argv[i], "--binary-output") == 0) {
+      SetOutputFormat(IO_BINARY);
+      quiet = 1;
+    } else if (strcmp(argv[i], "--binary-input") == 0) {
+      SetInputFormat(IO_BINARY);
+    } else if (strcmp(argv[i], "--profile-ops") == 0) {
+      engine = ENGINE_PROFILE_OPS;
+    } else if (strcmp(argv[i], "--profile-ops-json") == 0 && i + 1 < argc) {
+      engine = ENGINE_PROFILE_OPS;
+      profile_path = argv[++i];
+    } else if (strcmp(argv[i], "--profile-functions") == 0) {
+      engine = ENGINE_PROFILE_FUNCTIONS;
+    } else if (strcmp(argv[i], "--profile-lines") == 0) {
+      engine = ENGINE_PROFILE_LINES;
+    } else if (strcmp(argv[i], "--profile-flamegraph") == 0 && i + 1 < argc) {
+      if (engine != ENGINE_PROFILE_FUNCTIONS) {
+        engine = ENGINE_PROFILE_FLAMEGRAPH;
+      }
+      profile_path = argv[++i];
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      engine = ENGINE_STATS;
+    } else if (strcmp(argv[i], "--stats-json") == 0 && i + 1 < argc) {
+      engine = ENGINE_STATS;
+      profile_path = argv[++i];
+    } else if (strcmp(argv[i], "--cache") == 0) {
+      use_cache = 1;
+    } else if (strcmp(argv[i], "--cache-stats") == 0) {
+      PrintCacheStats(stdout);
+      return 0;
+    } else if (argv[i][0] == '-' || path != NULL) {
+      PrintUsage(argv[0]);
+      return 1;
+    } else {
+      path = argv[i];
+    }
+  }
+
+  if (path == NULL) {
+    PrintUsage(argv[0]);
     return 1;
   }
 
-  if (!HasCcbExtension(argv[1])) {
-    fprintf(stderr, "ERROR: \"%s\" has unsupported extension (expected .ccb).\n", argv[1]);
+  if (HasExtension(path, ".ccbc")) {
+    if (engine == ENGINE_REGISTER || engine == ENGINE_REGISTER_VERIFY || engine == ENGINE_STATS || c_path != NULL || bytecode_path != NULL) {
+      fprintf(stderr, "ERROR: \"%s\" is compiled bytecode; this mode needs the .ccb source.\n", path);
+      return 1;
+    }
+    Chunk* chunk = LoadBytecodeFile(path);
+    if (chunk == NULL) {
+      return 1;
+    }
+    if (disasm) {
+      int ok = DisassembleChunk(chunk, NULL, stdout);
+      FreeChunk(chunk);
+      free(chunk);
+      return ok ? 0 : 1;
+    }
+    if (!quiet) {
+      printf("--- Running %s ---\n", path);
+    }
+    InterpretResult result = RunChunk(chunk, NULL, engine, profile_path);
+    FreeChunk(chunk);
+    free(chunk);
+    return ExitCode(result);
+  }
+
+  if (!HasExtension(path, ".ccb")) {
+    fprintf(stderr, "ERROR: \"%s\" has unsupported extension (expected .ccb or .ccbc).\n", path);
     return 1;
   }
 
-  char* source = ReadFile(argv[1]);
+  char* source = ReadFile(path);
   if (source == NULL) {
     return 1;
   }
 
-  printf("--- Compiling and running %s ---\n", argv[1]);
-  InterpretResult result = Interpret(source);
+  if (c_path != NULL) {
+    int ok = EmitC(source, path, c_path);
+    free(source);
+    return ok ? 0 : 65;
+  }
 
-  free(source);
+  if (bytecode_path != NULL) {
+    Chunk* chunk = CompileSource(source);
+    free(source);
+    if (chunk == NULL) {
+      return 65;
+    }
+    int ok = WriteBytecodeFile(chunk, bytecode_path);
+    FreeChunk(chunk);
+    free(chunk);
+    return ok ? 0 : 1;
+  }
 
-  if (result == INTERPRET_COMPILE_ERROR) {
-    return 65;
+  if (disasm) {
+    Chunk* chunk = use_cache ? CompileCached(source) : CompileSource(source);
+    if (chunk == NULL) {
+      free(source);
+      return 65;
+    }
+    int ok = DisassembleChunk(chunk, source, stdout);
+    free(source);
+    FreeChunk(chunk);
+    free(chunk);
+    return ok ? 0 : 1;
   }
-  if (result == INTERPRET_RUNTIME_ERROR) {
-    return 70;
+
+  if (!quiet) {
+    printf("--- Compiling and running %s ---\n", path);
+  }
+  if (engine == ENGINE_REGISTER || engine == ENGINE_REGISTER_VERIFY || engine == ENGINE_STATS) {
+    InterpretResult result = engine == ENGINE_STATS ? Stats(source, profile_path) :
+                             engine == ENGINE_REGISTER_VERIFY ? VerifyRegister(source) :
+                             InterpretRegister(source);
+    free(source);
+    return ExitCode(result);
   }
 
-  return 0;
+  Chunk* chunk = use_cache ? CompileCached(source) : CompileSource(source);
+  if (chunk == NULL) {
+    free(source);
+    return 65;
+  }
+
+  InterpretResult result = RunChunk(chunk, source, engine, profile_path);
+  free(source);
+  FreeChunk(chunk);
+  free(chunk);
+  return ExitCode(result);
 }
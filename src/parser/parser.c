@@ -82,94 +82,355 @@ static void ParserNextToken(Parser* p) {
 
 static int ExpectPeek(Parser* p, TokenType t) {
   if (p->peek_token.type == TOKEN_ILLEGAL) {
-    printf("LEXER ERROR: illegal character '%s'\n", p->peek_token.literal);
+    printf("LEXER ERROR: %d:%d: illegal character '%.*s'\n",
+           p->peek_token.line, p->peek_token.column, p->peek_token.length, p->peek_token.start);
+    p->had_error = 1;
     return 0;
   }
   if (p->peek_token.type == t) {
     ParserNextToken(p);
     return 1;
   }
-  printf("ERROR: Expected token %s, got %s\n", TokenName(t), TokenName(p->peek_token.type));
+  printf("ERROR: %d:%d: Expected token %s, got %s\n", p->peek_token.line, p->peek_token.column,
+         TokenName(t), TokenName(p->peek_token.type));
+  p->had_error = 1;
   return 0;
 }
 
-static char* StrDup(const char* s) {
-  size_t n = strlen(s);
-  char* r = (char*)malloc(n + 1);
-  memcpy(r, s, n + 1);
-  return r;
+
+struct SymbolSlot {
+  uint32_t hash;
+  uint32_t id;  // symbol id + 1, 0 while the slot is empty
+};
+
+// Allocation failures reject the program like a syntax error; only the
+// first one is reported.
+static void OutOfMemory(Parser* p, const char* what) {
+  if (!p->had_error) {
+    printf("ERROR: Out of memory for %s.\n", what);
+  }
+  p->had_error = 1;
+  p->out_of_memory = 1;
+}
+
+static uint32_t HashName(const char* s, size_t n) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < n; i++) {
+    h = (h ^ (unsigned char)s[i]) * 16777619u;
+  }
+  return h;
+}
+
+static int GrowSymbolSlots(Parser* p) {
+  uint32_t capacity = p->symbol_slot_capacity ? p->symbol_slot_capacity * 2 : 256;
+  struct SymbolSlot* slots = (struct SymbolSlot*)calloc(capacity, sizeof(struct SymbolSlot));
+  if (slots == NULL) {
+    OutOfMemory(p, "the symbol table");
+    return 0;
+  }
+  for (uint32_t i = 0; i < p->symbol_slot_capacity; i++) {
+    struct SymbolSlot slot = p->symbol_slots[i];
+    if (slot.id != 0) {
+      uint32_t j = slot.hash & (capacity - 1);
+      while (slots[j].id != 0) {
+        j = (j + 1) & (capacity - 1);
+      }
+      slots[j] = slot;
+    }
+  }
+  free(p->symbol_slots);
+  p->symbol_slots = slots;
+  p->symbol_slot_capacity = capacity;
+  return 1;
+}
+
+// Each distinct name is stored once; later uses get the same id.
+static SymbolId Intern(Parser* p, const char* s, size_t n) {
+  Program* program = p->program;
+  // On failure the name gets symbol 0: the program is rejected before any
+  // symbol is looked up.
+  if ((program->symbol_count + 1) * 2 > p->symbol_slot_capacity && !GrowSymbolSlots(p)) {
+    return 0;
+  }
+  uint32_t hash = HashName(s, n);
+  uint32_t mask = p->symbol_slot_capacity - 1;
+  uint32_t i = hash & mask;
+  while (p->symbol_slots[i].id != 0) {
+    if (p->symbol_slots[i].hash == hash) {
+      SymbolId id = p->symbol_slots[i].id - 1;
+      const char* name = program->symbols[id];
+      if (strncmp(name, s, n) == 0 && name[n] == '\0') {
+        return id;
+      }
+    }
+    i = (i + 1) & mask;
+  }
+
+  if (program->symbol_count == program->symbol_capacity) {
+    uint32_t capacity = program->symbol_capacity ? program->symbol_capacity * 2 : 64;
+    const char** symbols = (const char**)realloc(program->symbols, capacity * sizeof(const char*));
+    if (symbols == NULL) {
+      OutOfMemory(p, "the symbol table");
+      return 0;
+    }
+    program->symbols = symbols;
+    program->symbol_capacity = capacity;
+  }
+  char* name = ArenaStrndup(&program->arena, s, n);
+  SymbolId id = program->symbol_count++;
+  if (name == NULL) {
+    // The name stays out of the table; the program is rejected anyway.
+    if (!p->had_error) {
+      printf("ERROR: Out of memory for the name '%.*s'.\n", (int)n, s);
+    }
+    p->had_error = 1;
+    program->symbols[id] = "";
+    return id;
+  }
+  program->symbols[id] = name;
+  p->symbol_slots[i].hash = hash;
+  p->symbol_slots[i].id = id + 1;
+  return id;
+}
+
+static SymbolId TokenSymbol(Parser* p, Token tok) {
+  return Intern(p, tok.start, (size_t)tok.length);
+}
+
+// Appends s[0, n) to the name being put together in name_buffer.
+static int AppendName(Parser* p, size_t* length, const char* s, size_t n) {
+  if (*length + n + 1 > p->name_capacity) {
+    size_t capacity = p->name_capacity ? p->name_capacity * 2 : 64;
+    while (capacity < *length + n + 1) {
+      capacity *= 2;
+    }
+    char* buffer = (char*)realloc(p->name_buffer, capacity);
+    if (buffer == NULL) {
+      OutOfMemory(p, "a qualified name");
+      return 0;
+    }
+    p->name_buffer = buffer;
+    p->name_capacity = capacity;
+  }
+  memcpy(p->name_buffer + *length, s, n);
+  *length += n;
+  return 1;
+}
+
+// ns.name, or just name when ns is empty; name is taken from the token.
+static SymbolId JoinQualified(Parser* p, const char* ns, Token name) {
+  size_t length = 0;
+  if (ns && ns[0] != '\0' &&
+      (!AppendName(p, &length, ns, strlen(ns)) || !AppendName(p, &length, ".", 1))) {
+    return 0;
+  }
+  if (!AppendName(p, &length, name.start, (size_t)name.length)) {
+    return 0;
+  }
+  return Intern(p, p->name_buffer, length);
 }
 
-static char* JoinQualified(const char* ns, const char* name) {
-  if (!ns || ns[0] == '\0') {
-    return StrDup(name);
+// Like JoinQualified but malloc'ed: the namespace prefix is owned by the
+// parser and freed when its block closes.
+static char* JoinPrefix(const char* ns, Token name) {
+  size_t ln = strlen(ns), lm = (size_t)name.length;
+  char* s = (char*)malloc(ln + lm + 2);
+  if (ln == 0) {
+    memcpy(s, name.start, lm);
+    s[lm] = '\0';
+    return s;
   }
-  size_t ln = strlen(ns), lm = strlen(name);
-  char* s = (char*)malloc(ln + 1 + lm + 1);
   memcpy(s, ns, ln);
   s[ln] = '.';
-  memcpy(s + ln + 1, name, lm);
+  memcpy(s + ln + 1, name.start, lm);
   s[ln + 1 + lm] = '\0';
   return s;
 }
 
-static Statement* ParseStatement(Parser* p);
-static Expression* ParseExpression(Parser* p, Precedence precedence);
-static BlockStatement* ParseBlockStatement(Parser* p);
-static Statement* ParseLetStatement(Parser* p);
-static Statement* ParseWhileStatement(Parser* p);
-static Statement* ParseOutStatement(Parser* p);
-static Statement* ParseInStatement(Parser* p);
-static Statement* ParseExpressionStatement(Parser* p);
-static Expression* ParseIdentifier(Parser* p);
-static Expression* ParseIntegerLiteral(Parser* p);
-static Expression* ParseIfExpression(Parser* p);
-static Expression* ParseInfixExpression(Parser* p, Expression* left);
-static Expression* ParseAssignmentExpression(Parser* p, Expression* left);
-static Statement* ParseNamespace(Parser* p);
-static Statement* ParseFunction(Parser* p);
-static Statement* ParseReturn(Parser* p);
-static Expression* ParseCallExpression(Parser* p, Expression* function);
-
-static Identifier* MakeRawIdent(Token tok) {
-  Identifier* id = (Identifier*)malloc(sizeof(Identifier));
-  id->base.node.type = NODE_IDENTIFIER;
-  id->token = tok;
-  id->value = StrDup(tok.literal);
+static AstNode* At(Parser* p, NodeId id) {
+  return &p->program->nodes[id];
+}
+
+// The node array may move as it grows: callers keep ids across parsing
+// calls and only take a pointer with At for the immediate stores.
+static NodeId NewNode(Parser* p, NodeType type, Token tok) {
+  Program* program = p->program;
+  if (program->node_count == program->node_capacity) {
+    uint32_t capacity = program->node_capacity ? program->node_capacity * 2 : 1024;
+    AstNode* nodes = (AstNode*)realloc(program->nodes, capacity * sizeof(AstNode));
+    if (nodes == NULL) {
+      // Callers store into NO_NODE, the program node, which is discarded.
+      OutOfMemory(p, "the syntax tree");
+      return NO_NODE;
+    }
+    program->nodes = nodes;
+    program->node_capacity = capacity;
+  }
+  NodeId id = program->node_count++;
+  AstNode* node = &program->nodes[id];
+  memset(node, 0, sizeof(AstNode));
+  node->type = (uint8_t)type;
+  node->line = tok.line;
+  node->column = tok.column;
   return id;
 }
 
+// Child lists are collected on a stack shared by all nesting levels, then
+// appended to Program.lists as one run once the list is closed.
+static void PushChild(Parser* p, uint32_t child) {
+  if (p->children_count == p->children_capacity) {
+    uint32_t capacity = p->children_capacity ? p->children_capacity * 2 : 64;
+    uint32_t* children = (uint32_t*)realloc(p->children, capacity * sizeof(uint32_t));
+    if (children == NULL) {
+      OutOfMemory(p, "the syntax tree");
+      return;
+    }
+    p->children = children;
+    p->children_capacity = capacity;
+  }
+  p->children[p->children_count++] = child;
+}
+
+// Pops the children pushed since base and returns where their run starts.
+static uint32_t TakeChildren(Parser* p, uint32_t base, uint32_t* count) {
+  Program* program = p->program;
+  uint32_t n = p->children_count - base;
+  if (program->list_count + n > program->list_capacity) {
+    uint32_t capacity = program->list_capacity ? program->list_capacity * 2 : 1024;
+    while (capacity < program->list_count + n) {
+      capacity *= 2;
+    }
+    uint32_t* lists = (uint32_t*)realloc(program->lists, capacity * sizeof(uint32_t));
+    if (lists == NULL) {
+      OutOfMemory(p, "the syntax tree");
+      p->children_count = base;
+      *count = 0;
+      return program->list_count;
+    }
+    program->lists = lists;
+    program->list_capacity = capacity;
+  }
+  uint32_t first = program->list_count;
+  if (n > 0) {
+    memcpy(program->lists + first, p->children + base, n * sizeof(uint32_t));
+  }
+  program->list_count += n;
+  p->children_count = base;
+  *count = n;
+  return first;
+}
+
+static BinaryOp BinaryOpFor(TokenType t) {
+  switch (t) {
+    case TOKEN_PLUS: return BIN_ADD;
+    case TOKEN_MINUS: return BIN_SUBTRACT;
+    case TOKEN_ASTERISK: return BIN_MULTIPLY;
+    case TOKEN_SLASH: return BIN_DIVIDE;
+    case TOKEN_LESS: return BIN_LESS;
+    case TOKEN_GREATER: return BIN_GREATER;
+    case TOKEN_LESS_EQUAL: return BIN_LESS_EQUAL;
+    case TOKEN_GREATER_EQUAL: return BIN_GREATER_EQUAL;
+    case TOKEN_EQUAL: return BIN_EQUAL;
+    case TOKEN_NOT_EQUAL: return BIN_NOT_EQUAL;
+    default: return BIN_ASSIGN;
+  }
+}
+
+static NodeId ParseStatement(Parser* p);
+static NodeId ParseExpression(Parser* p, Precedence precedence);
+static NodeId ParseBlockStatement(Parser* p);
+static NodeId ParseLetStatement(Parser* p);
+static NodeId ParseWhileStatement(Parser* p);
+static NodeId ParseOutStatement(Parser* p);
+static NodeId ParseInStatement(Parser* p);
+static NodeId ParseExpressionStatement(Parser* p);
+static NodeId ParseIdentifier(Parser* p);
+static NodeId ParseIntegerLiteral(Parser* p);
+static NodeId ParseIfExpression(Parser* p);
+static NodeId ParseInfixExpression(Parser* p, NodeId left);
+static NodeId ParseAssignmentExpression(Parser* p, NodeId left);
+static NodeId ParseNamespace(Parser* p);
+static NodeId ParseFunction(Parser* p);
+static NodeId ParseReturn(Parser* p);
+static NodeId ParseCallExpression(Parser* p, NodeId function);
+
 Parser* NewParser(Lexer* l) {
   Parser* p = (Parser*)malloc(sizeof(Parser));
   p->l = l;
   p->ns_prefix = (char*)malloc(1);
   p->ns_prefix[0] = '\0';
   p->in_function_depth = 0;
-
-  ParserNextToken(p);
+  p->had_error = 0;
+  p->out_of_memory = 0;
+  p->program = NULL;
+  p->children = NULL;
+  p->children_count = 0;
+  p->children_capacity = 0;
+  p->symbol_slots = NULL;
+  p->symbol_slot_capacity = 0;
+  p->name_buffer = NULL;
+  p->name_capacity = 0;
+
+  p->peek_token = NextToken(l);
   ParserNextToken(p);
   return p;
 }
 
 Program* ParseProgram(Parser* p) {
   Program* program = (Program*)malloc(sizeof(Program));
-  program->statements = NULL;
-  program->statement_count = 0;
-
-  while (p->current_token.type != TOKEN_EOF) {
-    Statement* stmt = ParseStatement(p);
-    if (stmt != NULL) {
-      program->statement_count++;
-      program->statements = (Statement**)realloc(program->statements,
-                              program->statement_count * sizeof(Statement*));
-      program->statements[program->statement_count - 1] = stmt;
+  if (program == NULL) {
+    OutOfMemory(p, "the program");
+    return NULL;
+  }
+  memset(program, 0, sizeof(Program));
+  InitArena(&program->arena);
+  p->program = program;
+
+  // Node 0 stands for the program itself and doubles as NO_NODE.
+  Token start = { .type = TOKEN_EOF, .line = 1, .column = 1 };
+  NewNode(p, NODE_PROGRAM, start);
+
+  while (p->current_token.type != TOKEN_EOF && !p->out_of_memory) {
+    NodeId stmt = ParseStatement(p);
+    if (stmt != NO_NODE) {
+      PushChild(p, stmt);
     }
     ParserNextToken(p);
   }
+  program->statements = TakeChildren(p, 0, &program->statement_count);
+
+  // The arrays stay alive through code generation; drop the growth slack.
+  // A failed shrink leaves the larger array in place.
+  AstNode* nodes = NULL;
+  if (program->node_count > 0) {
+    nodes = (AstNode*)realloc(program->nodes, program->node_count * sizeof(AstNode));
+  }
+  if (nodes != NULL) {
+    program->nodes = nodes;
+    program->node_capacity = program->node_count;
+  }
+  uint32_t* lists = NULL;
+  if (program->list_count > 0) {
+    lists = (uint32_t*)realloc(program->lists, program->list_count * sizeof(uint32_t));
+  }
+  if (lists != NULL) {
+    program->lists = lists;
+    program->list_capacity = program->list_count;
+  }
+
+  free(p->children);
+  free(p->symbol_slots);
+  free(p->name_buffer);
+  p->children = NULL;
+  p->children_capacity = 0;
+  p->symbol_slots = NULL;
+  p->symbol_slot_capacity = 0;
+  p->name_buffer = NULL;
+  p->name_capacity = 0;
   return program;
 }
 
-static Statement* ParseStatement(Parser* p) {
+static NodeId ParseStatement(Parser* p) {
   switch (p->current_token.type) {
     case TOKEN_LET: return ParseLetStatement(p);
     case TOKEN_WHILE: return ParseWhileStatement(p);
@@ -182,265 +443,193 @@ static Statement* ParseStatement(Parser* p) {
   }
 }
 
-static Statement* ParseNamespace(Parser* p) {
-  if (!ExpectPeek(p, TOKEN_IDENT)) {
-    return NULL;
+// Statements up to the '}' closing the block opened by the current token.
+static NodeId ParseBlockStatement(Parser* p) {
+  NodeId block = NewNode(p, NODE_BLOCK_STATEMENT, p->current_token);
+
+  uint32_t base = p->children_count;
+  ParserNextToken(p);
+  while (p->current_token.type != TOKEN_RBRACE && p->current_token.type != TOKEN_EOF) {
+    NodeId stmt = ParseStatement(p);
+    if (stmt != NO_NODE) {
+      PushChild(p, stmt);
+    }
+    ParserNextToken(p);
+  }
+  uint32_t count;
+  uint32_t first = TakeChildren(p, base, &count);
+  At(p, block)->as.block.first = first;
+  At(p, block)->as.block.count = count;
+  if (p->current_token.type != TOKEN_RBRACE) {
+    printf("ERROR: expected '}'\n");
+    p->had_error = 1;
   }
-  char* nsname = p->current_token.literal;
+  return block;
+}
 
+static NodeId ParseNamespace(Parser* p) {
+  if (!ExpectPeek(p, TOKEN_IDENT)) {
+    return NO_NODE;
+  }
   char* old = p->ns_prefix;
-  char* combined = (old[0] == '\0') ? StrDup(nsname) : JoinQualified(old, nsname);
+  char* combined = JoinPrefix(old, p->current_token);
   p->ns_prefix = combined;
 
   if (!ExpectPeek(p, TOKEN_LBRACE)) {
     free(combined);
     p->ns_prefix = old;
-    return NULL;
+    return NO_NODE;
   }
 
-  BlockStatement* block = (BlockStatement*)malloc(sizeof(BlockStatement));
-  block->base.node.type = NODE_BLOCK_STATEMENT;
-  block->token = p->current_token;
-  block->statements = NULL;
-  block->statement_count = 0;
-
-  ParserNextToken(p);
-  while (p->current_token.type != TOKEN_RBRACE && p->current_token.type != TOKEN_EOF) {
-    Statement* stmt = ParseStatement(p);
-    if (stmt != NULL) {
-      block->statement_count++;
-      block->statements = (Statement**)realloc(block->statements,
-                                block->statement_count * sizeof(Statement*));
-      block->statements[block->statement_count - 1] = stmt;
-    }
-    ParserNextToken(p);
-  }
-  if (p->current_token.type != TOKEN_RBRACE) {
-    printf("ERROR: expected '}'\n");
-  }
+  NodeId block = ParseBlockStatement(p);
 
   free(p->ns_prefix);
   p->ns_prefix = old;
 
-  return (Statement*)block;
+  return block;
 }
 
-static Statement* ParseFunction(Parser* p) {
+static NodeId ParseFunction(Parser* p) {
+  Token fn_tok = p->current_token;
   if (!ExpectPeek(p, TOKEN_IDENT)) {
-    return NULL;
+    return NO_NODE;
   }
 
-  Identifier* name = (Identifier*)malloc(sizeof(Identifier));
-  name->base.node.type = NODE_IDENTIFIER;
-  name->token = p->current_token;
-  name->value = JoinQualified(p->ns_prefix, p->current_token.literal);
+  SymbolId name = JoinQualified(p, p->ns_prefix, p->current_token);
 
   if (!ExpectPeek(p, TOKEN_LPAREN)) {
-    free(name->value);
-    free(name);
-    return NULL;
+    return NO_NODE;
   }
 
-  Identifier** params = NULL;
-  int param_count = 0;
-
+  uint32_t base = p->children_count;
   if (p->peek_token.type != TOKEN_RPAREN) {
     if (!ExpectPeek(p, TOKEN_IDENT)) {
-      free(name->value); free(name);
-      return NULL;
+      return NO_NODE;
     }
-    params = (Identifier**)realloc(params, (param_count + 1) * sizeof(Identifier*));
-    params[param_count++] = MakeRawIdent(p->current_token);
+    PushChild(p, TokenSymbol(p, p->current_token));
 
     while (p->peek_token.type == TOKEN_COMMA) {
       ParserNextToken(p);
       if (!ExpectPeek(p, TOKEN_IDENT)) {
-        for (int i = 0; i < param_count; i++) {
-          FreeExpression((Expression*)params[i]);
-        }
-        free(params);
-        free(name->value);
-        free(name);
-        return NULL;
+        p->children_count = base;
+        return NO_NODE;
       }
-      params = (Identifier**)realloc(params, (param_count + 1) * sizeof(Identifier*));
-      params[param_count++] = MakeRawIdent(p->current_token);
+      PushChild(p, TokenSymbol(p, p->current_token));
     }
   }
 
+  uint32_t param_count;
+  uint32_t params = TakeChildren(p, base, &param_count);
   if (!ExpectPeek(p, TOKEN_RPAREN)) {
-    for (int i = 0; i < param_count; i++) {
-      FreeExpression((Expression*)params[i]);
-    }
-    free(params);
-    free(name->value);
-    free(name);
-    return NULL;
+    return NO_NODE;
   }
 
-  char* ret_type = NULL;
+  // The return type is checked for syntax only: every value is an int.
   if (p->peek_token.type == TOKEN_ARROW) {
     ParserNextToken(p);
     if (!ExpectPeek(p, TOKEN_IDENT)) {
-      for (int i = 0; i < param_count; i++) {
-        FreeExpression((Expression*)params[i]);
-      }
-      free(params);
-      free(name->value);
-      free(name);
-      return NULL;
+      return NO_NODE;
     }
-    ret_type = StrDup(p->current_token.literal);
   }
 
   if (!ExpectPeek(p, TOKEN_LBRACE)) {
-    if (ret_type) {
-      free(ret_type);
-    }
-    for (int i = 0; i < param_count; i++) {
-      FreeExpression((Expression*)params[i]);
-    }
-    free(params);
-    free(name->value);
-    free(name);
-    return NULL;
+    return NO_NODE;
   }
 
   p->in_function_depth++;
-  BlockStatement* body = ParseBlockStatement(p);
+  NodeId body = ParseBlockStatement(p);
   p->in_function_depth--;
 
-  FunctionStatement* fn = (FunctionStatement*)malloc(sizeof(FunctionStatement));
-  fn->base.node.type = NODE_FUNCTION_STATEMENT;
-  fn->token = (Token){ .type = TOKEN_FN, .literal = StrDup("fn") };
-  fn->name = name;
-  fn->params = params;
-  fn->param_count = param_count;
-  fn->body = body;
-  fn->return_type = ret_type ? ret_type : StrDup("int");
-  return (Statement*)fn;
+  NodeId fn = NewNode(p, NODE_FUNCTION_STATEMENT, fn_tok);
+  AstNode* node = At(p, fn);
+  node->as.fn.name = name;
+  node->as.fn.params = params;
+  node->as.fn.param_count = param_count;
+  node->as.fn.body = body;
+  return fn;
 }
 
-static Statement* ParseReturn(Parser* p) {
-  ReturnStatement* rs = (ReturnStatement*)malloc(sizeof(ReturnStatement));
-  rs->base.node.type = NODE_RETURN_STATEMENT;
-  rs->token = p->current_token;
+static NodeId ParseReturn(Parser* p) {
+  NodeId rs = NewNode(p, NODE_RETURN_STATEMENT, p->current_token);
 
   if (p->peek_token.type == TOKEN_SEMICOLON) {
     ParserNextToken(p);
-    rs->value = NULL;
-    return (Statement*)rs;
+    return rs;
   }
 
   ParserNextToken(p);
-  rs->value = ParseExpression(p, PREC_LOWEST);
+  NodeId value = ParseExpression(p, PREC_LOWEST);
+  At(p, rs)->as.expression = value;
   if (p->peek_token.type == TOKEN_SEMICOLON) {
     ParserNextToken(p);
   }
-  return (Statement*)rs;
+  return rs;
 }
 
-static BlockStatement* ParseBlockStatement(Parser* p) {
-  BlockStatement* block = (BlockStatement*)malloc(sizeof(BlockStatement));
-  block->base.node.type = NODE_BLOCK_STATEMENT;
-  block->token = p->current_token;
-  block->statements = NULL;
-  block->statement_count = 0;
-
-  ParserNextToken(p);
-  while (p->current_token.type != TOKEN_RBRACE && p->current_token.type != TOKEN_EOF) {
-    Statement* stmt = ParseStatement(p);
-    if (stmt != NULL) {
-      block->statement_count++;
-      block->statements = (Statement**)realloc(block->statements,
-                                block->statement_count * sizeof(Statement*));
-      block->statements[block->statement_count - 1] = stmt;
-    }
-    ParserNextToken(p);
-  }
-  if (p->current_token.type != TOKEN_RBRACE) {
-    printf("ERROR: expected '}'\n");
+// Names declared at the top level are qualified by the enclosing
+// namespaces; locals are not.
+static SymbolId DeclaredName(Parser* p) {
+  if (p->in_function_depth > 0) {
+    return TokenSymbol(p, p->current_token);
   }
-  return block;
+  return JoinQualified(p, p->ns_prefix, p->current_token);
 }
 
-static Statement* ParseLetStatement(Parser* p) {
-  LetStatement* stmt = (LetStatement*)malloc(sizeof(LetStatement));
-  stmt->base.node.type = NODE_LET_STATEMENT;
-  stmt->token = p->current_token;
+static NodeId ParseLetStatement(Parser* p) {
+  Token let_tok = p->current_token;
 
   if (!ExpectPeek(p, TOKEN_IDENT)) {
-    free(stmt);
-    return NULL;
+    return NO_NODE;
   }
-
-  Identifier* name = (Identifier*)malloc(sizeof(Identifier));
-  name->base.node.type = NODE_IDENTIFIER;
-  name->token = p->current_token;
-  if (p->in_function_depth > 0) {
-    name->value = StrDup(p->current_token.literal);
-  } else {
-    name->value = JoinQualified(p->ns_prefix, p->current_token.literal);
-  }
-  stmt->name = name;
+  SymbolId name = DeclaredName(p);
 
   if (!ExpectPeek(p, TOKEN_ASSIGN)) {
-    free(name->value);
-    free(name);
-    free(stmt);
-    return NULL;
+    return NO_NODE;
   }
 
   ParserNextToken(p);
-  stmt->value = ParseExpression(p, PREC_LOWEST);
+  NodeId value = ParseExpression(p, PREC_LOWEST);
+
+  NodeId stmt = NewNode(p, NODE_LET_STATEMENT, let_tok);
+  At(p, stmt)->as.let.name = name;
+  At(p, stmt)->as.let.value = value;
 
   if (p->peek_token.type == TOKEN_SEMICOLON) {
     ParserNextToken(p);
   }
-  return (Statement*)stmt;
+  return stmt;
 }
 
-static Statement* ParseOutStatement(Parser* p) {
-  OutStatement* stmt = (OutStatement*)malloc(sizeof(OutStatement));
-  stmt->base.node.type = NODE_OUT_STATEMENT;
-  stmt->token = p->current_token;
+static NodeId ParseOutStatement(Parser* p) {
+  NodeId stmt = NewNode(p, NODE_OUT_STATEMENT, p->current_token);
 
   ParserNextToken(p);
-  stmt->value = ParseExpression(p, PREC_LOWEST);
+  NodeId value = ParseExpression(p, PREC_LOWEST);
+  At(p, stmt)->as.expression = value;
   if (p->peek_token.type == TOKEN_SEMICOLON) {
     ParserNextToken(p);
   }
-  return (Statement*)stmt;
+  return stmt;
 }
 
-static Statement* ParseInStatement(Parser* p) {
-  InStatement* stmt = (InStatement*)malloc(sizeof(InStatement));
-  stmt->base.node.type = NODE_IN_STATEMENT;
-  stmt->token = p->current_token;
+static NodeId ParseInStatement(Parser* p) {
+  Token in_tok = p->current_token;
 
   if (!ExpectPeek(p, TOKEN_IDENT)) {
-    free(stmt);
-    return NULL;
+    return NO_NODE;
   }
 
-  Identifier* name = (Identifier*)malloc(sizeof(Identifier));
-  name->base.node.type = NODE_IDENTIFIER;
-  name->token = p->current_token;
-  if (p->in_function_depth > 0) {
-    name->value = StrDup(p->current_token.literal);
-  } else {
-    name->value = JoinQualified(p->ns_prefix, p->current_token.literal);
-  }
-  stmt->name = name;
+  NodeId stmt = NewNode(p, NODE_IN_STATEMENT, in_tok);
+  At(p, stmt)->as.name = DeclaredName(p);
 
   if (p->peek_token.type == TOKEN_SEMICOLON) {
     ParserNextToken(p);
   }
-  return (Statement*)stmt;
+  return stmt;
 }
 
-static Expression* ParseExpression(Parser* p, Precedence precedence) {
-  Expression* (*prefix_fn)(Parser*) = NULL;
+static NodeId ParseExpression(Parser* p, Precedence precedence) {
+  NodeId (*prefix_fn)(Parser*) = NULL;
   switch (p->current_token.type) {
     case TOKEN_IDENT:
       prefix_fn = ParseIdentifier;
@@ -452,21 +641,23 @@ static Expression* ParseExpression(Parser* p, Precedence precedence) {
       prefix_fn = ParseIfExpression;
       break;
     default:
-      printf("ERROR: Doesn't found prefix-function for token %d\n", p->current_token.type);
-      return NULL;
+      printf("ERROR: %d:%d: Doesn't found prefix-function for token %d\n",
+             p->current_token.line, p->current_token.column, p->current_token.type);
+      p->had_error = 1;
+      return NO_NODE;
   }
 
-  Expression* left_exp = prefix_fn(p);
-  if (left_exp == NULL) {
-    return NULL;
+  NodeId left_exp = prefix_fn(p);
+  if (left_exp == NO_NODE) {
+    return NO_NODE;
   }
 
   for (;;) {
     if (p->peek_token.type == TOKEN_LPAREN) {
       ParserNextToken(p);
       left_exp = ParseCallExpression(p, left_exp);
-      if (left_exp == NULL) {
-        return NULL;
+      if (left_exp == NO_NODE) {
+        return NO_NODE;
       }
       continue;
     }
@@ -476,7 +667,7 @@ static Expression* ParseExpression(Parser* p, Precedence precedence) {
       break;
     }
 
-    Expression* (*infix_fn)(Parser*, Expression*) = NULL;
+    NodeId (*infix_fn)(Parser*, NodeId) = NULL;
     switch (p->peek_token.type) {
       case TOKEN_PLUS:
       case TOKEN_MINUS:
@@ -498,177 +689,175 @@ static Expression* ParseExpression(Parser* p, Precedence precedence) {
     }
     ParserNextToken(p);
     left_exp = infix_fn(p, left_exp);
-    if (left_exp == NULL) {
-      return NULL;
+    if (left_exp == NO_NODE) {
+      return NO_NODE;
     }
   }
   return left_exp;
 }
 
-static Expression* ParseIntegerLiteral(Parser* p) {
-  IntegerLiteral* lit = (IntegerLiteral*)malloc(sizeof(IntegerLiteral));
-  lit->base.node.type = NODE_INTEGER_LITERAL;
-  lit->token = p->current_token;
-  lit->value = atoi(p->current_token.literal);
-  return (Expression*)lit;
+static NodeId ParseIntegerLiteral(Parser* p) {
+  NodeId lit = NewNode(p, NODE_INTEGER_LITERAL, p->current_token);
+  At(p, lit)->as.value = p->current_token.value;
+  return lit;
 }
 
-static Expression* ParseIdentifier(Parser* p) {
+static NodeId ParseIdentifier(Parser* p) {
   Token startTok = p->current_token;
 
-  char* full = StrDup(startTok.literal);
+  size_t length = 0;
+  AppendName(p, &length, startTok.start, (size_t)startTok.length);
   while (p->peek_token.type == TOKEN_DOT) {
     ParserNextToken(p);
     if (!ExpectPeek(p, TOKEN_IDENT)) {
       break;
     }
-    size_t ln = strlen(full), lm = strlen(p->current_token.literal);
-    char* tmp = (char*)malloc(ln + 1 + lm + 1);
-    memcpy(tmp, full, ln);
-    tmp[ln] = '.';
-    memcpy(tmp + ln + 1, p->current_token.literal, lm);
-    tmp[ln + 1 + lm] = '\0';
-    free(full);
-    full = tmp;
-  }
-
-  Identifier* ident = (Identifier*)malloc(sizeof(Identifier));
-  ident->base.node.type = NODE_IDENTIFIER;
-  ident->token = startTok;
-  ident->value = full;
-  return (Expression*)ident;
-}
-
-static Expression* ParseInfixExpression(Parser* p, Expression* left) {
-  InfixExpression* exp = (InfixExpression*)malloc(sizeof(InfixExpression));
-  exp->base.node.type = NODE_INFIX_EXPRESSION;
-  exp->token = p->current_token;
-  exp->operator = p->current_token.literal;
-  exp->left = left;
+    AppendName(p, &length, ".", 1);
+    AppendName(p, &length, p->current_token.start, (size_t)p->current_token.length);
+  }
+
+  NodeId ident = NewNode(p, NODE_IDENTIFIER, startTok);
+  At(p, ident)->as.name = Intern(p, p->name_buffer, length);
+  return ident;
+}
+
+// An infix node takes its position from the left operand.
+static NodeId NewInfix(Parser* p, NodeId left) {
+  NodeId exp = NewNode(p, NODE_INFIX_EXPRESSION, p->current_token);
+  AstNode* node = At(p, exp);
+  node->line = At(p, left)->line;
+  node->column = At(p, left)->column;
+  node->op = (uint8_t)BinaryOpFor(p->current_token.type);
+  node->as.infix.left = left;
+  return exp;
+}
+
+static NodeId ParseInfixExpression(Parser* p, NodeId left) {
+  NodeId exp = NewInfix(p, left);
 
   Precedence precedence = GetPrecedence(p->current_token.type);
   ParserNextToken(p);
-  exp->right = ParseExpression(p, precedence);
-  return (Expression*)exp;
+  NodeId right = ParseExpression(p, precedence);
+  At(p, exp)->as.infix.right = right;
+  return exp;
 }
 
-static Expression* ParseAssignmentExpression(Parser* p, Expression* left) {
-  if (!left || left->node.type != NODE_IDENTIFIER) {
+static NodeId ParseAssignmentExpression(Parser* p, NodeId left) {
+  if (left == NO_NODE || At(p, left)->type != NODE_IDENTIFIER) {
     printf("ERROR: Invalid assignment target.\n");
-    return NULL;
+    p->had_error = 1;
+    return NO_NODE;
   }
-  InfixExpression* exp = (InfixExpression*)malloc(sizeof(InfixExpression));
-  exp->base.node.type = NODE_INFIX_EXPRESSION;
-  exp->token = p->current_token;
-  exp->operator = p->current_token.literal;
-  exp->left = left;
+  NodeId exp = NewInfix(p, left);
 
   Precedence precedence = GetPrecedence(p->current_token.type);
   ParserNextToken(p);
-  exp->right = ParseExpression(p, precedence);
-  return (Expression*)exp;
+  NodeId right = ParseExpression(p, precedence);
+  At(p, exp)->as.infix.right = right;
+  return exp;
 }
 
-static Expression* ParseCallExpression(Parser* p, Expression* function) {
-  CallExpression* call = (CallExpression*)malloc(sizeof(CallExpression));
-  call->base.node.type = NODE_CALL_EXPRESSION;
-  call->token = p->current_token;
-  call->function = function;
-  call->arguments = NULL;
-  call->arg_count = 0;
+static NodeId ParseCallExpression(Parser* p, NodeId function) {
+  NodeId call = NewNode(p, NODE_CALL_EXPRESSION, p->current_token);
+  AstNode* node = At(p, call);
+  node->line = At(p, function)->line;
+  node->column = At(p, function)->column;
+  node->as.call.function = function;
 
   if (p->peek_token.type == TOKEN_RPAREN) {
     ParserNextToken(p);
-    return (Expression*)call;
+    return call;
   }
 
+  uint32_t base = p->children_count;
   ParserNextToken(p);
-  call->arguments = (Expression**)realloc(call->arguments, (call->arg_count+1)*sizeof(Expression*));
-  call->arguments[call->arg_count++] = ParseExpression(p, PREC_LOWEST);
+  PushChild(p, ParseExpression(p, PREC_LOWEST));
 
   while (p->peek_token.type == TOKEN_COMMA) {
     ParserNextToken(p);
     ParserNextToken(p);
-    call->arguments = (Expression**)realloc(call->arguments, (call->arg_count+1)*sizeof(Expression*));
-    call->arguments[call->arg_count++] = ParseExpression(p, PREC_LOWEST);
+    PushChild(p, ParseExpression(p, PREC_LOWEST));
   }
+  uint32_t count;
+  uint32_t first = TakeChildren(p, base, &count);
+  At(p, call)->as.call.args = first;
+  At(p, call)->as.call.arg_count = count;
 
   if (!ExpectPeek(p, TOKEN_RPAREN)) {
     printf("ERROR: expected ')' after arguments, got %s\n", TokenName(p->peek_token.type));
-    free(call->arguments);
-    free(call);
-    return NULL;
+    p->had_error = 1;
+    return NO_NODE;
   }
-  return (Expression*)call;
+  return call;
 }
 
-static Statement* ParseWhileStatement(Parser* p) {
-  WhileStatement* stmt = (WhileStatement*)malloc(sizeof(WhileStatement));
-  stmt->base.node.type = NODE_WHILE_STATEMENT;
-  stmt->token = p->current_token;
+static NodeId ParseWhileStatement(Parser* p) {
+  Token while_tok = p->current_token;
 
   if (!ExpectPeek(p, TOKEN_LPAREN)) {
-    return NULL;
+    return NO_NODE;
   }
   ParserNextToken(p);
-  stmt->condition = ParseExpression(p, PREC_LOWEST);
+  NodeId condition = ParseExpression(p, PREC_LOWEST);
 
   if (!ExpectPeek(p, TOKEN_RPAREN)) {
-    return NULL;
+    return NO_NODE;
   }
   if (!ExpectPeek(p, TOKEN_LBRACE)) {
-    return NULL;
+    return NO_NODE;
   }
 
-  stmt->body = ParseBlockStatement(p);
-  return (Statement*)stmt;
+  NodeId body = ParseBlockStatement(p);
+  NodeId stmt = NewNode(p, NODE_WHILE_STATEMENT, while_tok);
+  At(p, stmt)->as.loop.condition = condition;
+  At(p, stmt)->as.loop.body = body;
+  return stmt;
 }
 
-static Expression* ParseIfExpression(Parser* p) {
-  IfExpression* exp = (IfExpression*)malloc(sizeof(IfExpression));
-  exp->base.node.type = NODE_IF_EXPRESSION;
-  exp->token = p->current_token;
+static NodeId ParseIfExpression(Parser* p) {
+  Token if_tok = p->current_token;
 
   if (!ExpectPeek(p, TOKEN_LPAREN)) {
-    return NULL;
+    return NO_NODE;
   }
 
   ParserNextToken(p);
-  exp->condition = ParseExpression(p, PREC_LOWEST);
+  NodeId condition = ParseExpression(p, PREC_LOWEST);
 
   if (!ExpectPeek(p, TOKEN_RPAREN)) {
-    return NULL;
+    return NO_NODE;
   }
   if (!ExpectPeek(p, TOKEN_LBRACE)) {
-    return NULL;
+    return NO_NODE;
   }
 
-  exp->consequence = ParseBlockStatement(p);
+  NodeId consequence = ParseBlockStatement(p);
+  NodeId alternative = NO_NODE;
 
   if (p->peek_token.type == TOKEN_ELSE) {
     ParserNextToken(p);
     if (!ExpectPeek(p, TOKEN_LBRACE)) {
-      FreeStatement((Statement*)exp->consequence);
-      free(exp);
-      return NULL;
+      return NO_NODE;
     }
-    exp->alternative = ParseBlockStatement(p);
-  } else {
-    exp->alternative = NULL;
+    alternative = ParseBlockStatement(p);
   }
-  return (Expression*)exp;
+
+  NodeId exp = NewNode(p, NODE_IF_EXPRESSION, if_tok);
+  AstNode* node = At(p, exp);
+  node->as.branch.condition = condition;
+  node->as.branch.consequence = consequence;
+  node->as.branch.alternative = alternative;
+  return exp;
 }
 
-static Statement* ParseExpressionStatement(Parser* p) {
-  ExpressionStatement* stmt = (ExpressionStatement*)malloc(sizeof(ExpressionStatement));
-  stmt->base.node.type = NODE_EXPRESSION_STATEMENT;
-  stmt->token = p->current_token;
+static NodeId ParseExpressionStatement(Parser* p) {
+  NodeId stmt = NewNode(p, NODE_EXPRESSION_STATEMENT, p->current_token);
 
-  stmt->expression = ParseExpression(p, PREC_LOWEST);
+  NodeId expression = ParseExpression(p, PREC_LOWEST);
+  At(p, stmt)->as.expression = expression;
 
   if (p->peek_token.type == TOKEN_SEMICOLON) {
     ParserNextToken(p);
   }
-  return (Statement*)stmt;
+  return stmt;
 }
-
@@ -12,6 +12,22 @@ typedef struct {
   char* ns_prefix;
 
   int in_function_depth;
+  // Set by every syntax error; the program is then only fit for freeing.
+  int had_error;
+  // Set with had_error when an allocation fails; parsing stops there.
+  int out_of_memory;
+
+  // The program being built. children is scratch space for the child
+  // lists still open, symbol_slots the open-addressed intern table and
+  // name_buffer where qualified names are put together.
+  Program* program;
+  uint32_t* children;
+  uint32_t children_count;
+  uint32_t children_capacity;
+  struct SymbolSlot* symbol_slots;
+  uint32_t symbol_slot_capacity;
+  char* name_buffer;
+  size_t name_capacity;
 } Parser;
 
 Parser* NewParser(Lexer* l);
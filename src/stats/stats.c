@@ -0,0 +1,231 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#include "stats.h"
+#include "../codegen/codegen.h"
+
+static const char* phase_names[PHASE_COUNT] = {
+  [PHASE_LEX] = "lex",
+  [PHASE_PARSE] = "parse",
+  [PHASE_CODEGEN] = "codegen",
+  [PHASE_DECODE] = "decode",
+  [PHASE_RUN] = "run",
+};
+
+static double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static size_t HeapInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+  // Large blocks (the parser's arena among them) are mmapped and only show
+  // up in hblkhd.
+  struct mallinfo2 mi = mallinfo2();
+  return mi.uordblks + mi.hblkhd;
+#else
+  return 0;
+#endif
+}
+
+static void EndPhase(CompilerStats* stats, Phase phase, double* start) {
+  double now = Now();
+  stats->seconds[phase] = now - *start;
+  *start = now;
+  size_t heap = HeapInUse();
+  if (heap > stats->heap_peak) {
+    stats->heap_peak = heap;
+  }
+}
+
+// Counts nodes as the pointer tree had them: a declared name counts as
+// an identifier node, so the figure stays comparable across versions.
+static int CountStatements(const Program* program, uint32_t first, uint32_t count);
+
+static int CountExpression(const Program* program, NodeId id) {
+  if (id == NO_NODE) {
+    return 0;
+  }
+  const AstNode* expr = &program->nodes[id];
+  switch (expr->type) {
+    case NODE_INFIX_EXPRESSION:
+      return 1 + CountExpression(program, expr->as.infix.left) +
+             CountExpression(program, expr->as.infix.right);
+    case NODE_IF_EXPRESSION: {
+      const AstNode* then_block = &program->nodes[expr->as.branch.consequence];
+      int n = 1 + CountExpression(program, expr->as.branch.condition);
+      n += 1 + CountStatements(program, then_block->as.block.first, then_block->as.block.count);
+      if (expr->as.branch.alternative != NO_NODE) {
+        const AstNode* else_block = &program->nodes[expr->as.branch.alternative];
+        n += 1 + CountStatements(program, else_block->as.block.first, else_block->as.block.count);
+      }
+      return n;
+    }
+    case NODE_CALL_EXPRESSION: {
+      const NodeId* args = program->lists + expr->as.call.args;
+      int n = 1 + CountExpression(program, expr->as.call.function);
+      for (uint32_t i = 0; i < expr->as.call.arg_count; i++) {
+        n += CountExpression(program, args[i]);
+      }
+      return n;
+    }
+    default:
+      return 1;
+  }
+}
+
+static int CountStatement(const Program* program, NodeId id) {
+  if (id == NO_NODE) {
+    return 0;
+  }
+  const AstNode* stmt = &program->nodes[id];
+  switch (stmt->type) {
+    case NODE_LET_STATEMENT:
+      return 2 + CountExpression(program, stmt->as.let.value);
+    case NODE_EXPRESSION_STATEMENT:
+    case NODE_OUT_STATEMENT:
+    case NODE_RETURN_STATEMENT:
+      return 1 + CountExpression(program, stmt->as.expression);
+    case NODE_IN_STATEMENT:
+      return 2;
+    case NODE_BLOCK_STATEMENT:
+      return 1 + CountStatements(program, stmt->as.block.first, stmt->as.block.count);
+    case NODE_WHILE_STATEMENT: {
+      const AstNode* body = &program->nodes[stmt->as.loop.body];
+      return 2 + CountExpression(program, stmt->as.loop.condition) +
+             CountStatements(program, body->as.block.first, body->as.block.count);
+    }
+    case NODE_FUNCTION_STATEMENT: {
+      const AstNode* body = &program->nodes[stmt->as.fn.body];
+      return 3 + (int)stmt->as.fn.param_count +
+             CountStatements(program, body->as.block.first, body->as.block.count);
+    }
+    default:
+      return 1;
+  }
+}
+
+static int CountStatements(const Program* program, uint32_t first, uint32_t count) {
+  int n = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    n += CountStatement(program, program->lists[first + i]);
+  }
+  return n;
+}
+
+static int CountTokens(const char* source) {
+  Lexer* l = NewLexer(source);
+  int count = 0;
+  for (;;) {
+    Token tok = NextToken(l);
+    if (tok.type == TOKEN_EOF) {
+      break;
+    }
+    count++;
+  }
+  free(l);
+  return count;
+}
+
+InterpretResult CollectStats(const char* source, CompilerStats* stats) {
+  memset(stats, 0, sizeof(*stats));
+  stats->result = INTERPRET_COMPILE_ERROR;
+  double start = Now();
+
+  stats->tokens = CountTokens(source);
+  EndPhase(stats, PHASE_LEX, &start);
+
+  Lexer* l = NewLexer(source);
+  Parser* p = NewParser(l);
+  Program* program = ParseProgram(p);
+  if (program != NULL) {
+    stats->ast_nodes = 1 + CountStatements(program, program->statements, program->statement_count);
+  }
+  EndPhase(stats, PHASE_PARSE, &start);
+
+  Chunk* chunk = program == NULL || p->had_error ? NULL : Compile(program);
+  EndPhase(stats, PHASE_CODEGEN, &start);
+  FreeProgram(program);
+  free(p->ns_prefix);
+  free(l);
+  free(p);
+
+  if (chunk != NULL) {
+    stats->bytecode_bytes = chunk->count;
+    stats->constants = chunk->constants_count;
+
+    DecodedChunk decoded;
+    if (DecodeChunk(chunk, &decoded)) {
+      stats->decoded_instructions = decoded.count;
+      EndPhase(stats, PHASE_DECODE, &start);
+
+      VM* vm = NewVM();
+      stats->result = RunVMStats(vm, &decoded, &stats->run);
+      EndPhase(stats, PHASE_RUN, &start);
+      FreeVM(vm);
+      FreeDecoded(&decoded);
+    }
+    FreeChunk(chunk);
+    free(chunk);
+  }
+
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    stats->max_rss_kb = usage.ru_maxrss;
+  }
+  return stats->result;
+}
+
+static double TotalSeconds(const CompilerStats* stats) {
+  double total = 0;
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    total += stats->seconds[i];
+  }
+  return total;
+}
+
+void PrintStats(const CompilerStats* stats, FILE* out) {
+  double total = TotalSeconds(stats);
+  fprintf(out, "%-24s %12s %7s\n", "phase", "ms", "%");
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    fprintf(out, "%-24s %12.3f %6.2f%%\n", phase_names[i], stats->seconds[i] * 1e3,
+            total > 0 ? 100.0 * stats->seconds[i] / total : 0.0);
+  }
+  fprintf(out, "%-24s %12.3f\n\n", "total", total * 1e3);
+
+  fprintf(out, "%-24s %12d\n", "tokens", stats->tokens);
+  fprintf(out, "%-24s %12d\n", "ast nodes", stats->ast_nodes);
+  fprintf(out, "%-24s %12d\n", "bytecode bytes", stats->bytecode_bytes);
+  fprintf(out, "%-24s %12d\n", "constants", stats->constants);
+  fprintf(out, "%-24s %12d\n", "decoded instructions", stats->decoded_instructions);
+  fprintf(out, "%-24s %12zu\n", "peak heap bytes", stats->heap_peak);
+  fprintf(out, "%-24s %12ld\n", "max rss kb", stats->max_rss_kb);
+  fprintf(out, "%-24s %12llu\n", "instructions executed", (unsigned long long)stats->run.instructions);
+  fprintf(out, "%-24s %12d\n", "max stack depth", stats->run.max_stack);
+  fprintf(out, "%-24s %12d\n", "max call depth", stats->run.max_calls);
+}
+
+void WriteStatsJson(const CompilerStats* stats, FILE* out) {
+  fprintf(out, "{\n  \"phases_ms\": {");
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    fprintf(out, "%s\"%s\": %.3f", i > 0 ? ", " : "", phase_names[i], stats->seconds[i] * 1e3);
+  }
+  fprintf(out, "},\n");
+  fprintf(out, "  \"total_ms\": %.3f,\n", TotalSeconds(stats) * 1e3);
+  fprintf(out, "  \"tokens\": %d,\n", stats->tokens);
+  fprintf(out, "  \"ast_nodes\": %d,\n", stats->ast_nodes);
+  fprintf(out, "  \"bytecode_bytes\": %d,\n", stats->bytecode_bytes);
+  fprintf(out, "  \"constants\": %d,\n", stats->constants);
+  fprintf(out, "  \"decoded_instructions\": %d,\n", stats->decoded_instructions);
+  fprintf(out, "  \"peak_heap_bytes\": %zu,\n", stats->heap_peak);
+  fprintf(out, "  \"max_rss_kb\": %ld,\n", stats->max_rss_kb);
+  fprintf(out, "  \"instructions_executed\": %llu,\n", (unsigned long long)stats->run.instructions);
+  fprintf(out, "  \"max_stack_depth\": %d,\n", stats->run.max_stack);
+  fprintf(out, "  \"max_call_depth\": %d,\n", stats->run.max_calls);
+  fprintf(out, "  \"ok\": %s\n}\n", stats->result == INTERPRET_OK ? "true" : "false");
+}
@@ -0,0 +1,42 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "../vm/vm.h"
+
+typedef enum {
+  PHASE_LEX,
+  PHASE_PARSE,
+  PHASE_CODEGEN,
+  PHASE_DECODE,
+  PHASE_RUN,
+  PHASE_COUNT
+} Phase;
+
+typedef struct {
+  double seconds[PHASE_COUNT];
+
+  int tokens;
+  int ast_nodes;
+  int bytecode_bytes;
+  int constants;
+  int decoded_instructions;
+
+  // glibc heap in use, sampled at the end of every phase.
+  size_t heap_peak;
+  // Peak resident set size of the whole process.
+  long max_rss_kb;
+
+  RunStats run;
+  InterpretResult result;
+} CompilerStats;
+
+// Lexes, parses, compiles and runs source on the stack VM, timing each
+// phase separately. The lexing phase is a separate pass over the source
+// (the parser lexes again as it goes), so its time is also part of parse.
+InterpretResult CollectStats(const char* source, CompilerStats* stats);
+void PrintStats(const CompilerStats* stats, FILE* out);
+void WriteStatsJson(const CompilerStats* stats, FILE* out);
+
+#endif
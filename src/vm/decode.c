@@ -0,0 +1,344 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "decode.h"
+
+typedef struct {
+  int pos;
+  uint8_t op;
+  int operand;
+  int target;
+} RawInstr;
+
+int OperandBytes(uint8_t op) {
+  switch (op) {
+    case OP_CONSTANT:
+    case OP_DEFINE_GLOBAL:
+    case OP_GET_GLOBAL:
+    case OP_SET_GLOBAL:
+    case OP_GET_LOCAL:
+    case OP_SET_LOCAL:
+    case OP_IN:
+    case OP_IN_LOCAL:
+      return 1;
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_LOOP:
+      return 2;
+    case OP_CALL:
+      return 3;
+    case OP_POP:
+    case OP_ADD:
+    case OP_SUBTRACT:
+    case OP_MULTIPLY:
+    case OP_DIVIDE:
+    case OP_LESS:
+    case OP_GREATER:
+    case OP_LESS_EQUAL:
+    case OP_GREATER_EQUAL:
+    case OP_EQUAL:
+    case OP_NOT_EQUAL:
+    case OP_OUT:
+    case OP_RETURN:
+      return 0;
+    default:
+      return -1;
+  }
+}
+
+static int ReadShort(const uint8_t* p) {
+  return (p[0] << 8) | p[1];
+}
+
+static int IsBinary(uint8_t op) {
+  return op >= OP_ADD && op <= OP_NOT_EQUAL;
+}
+
+static int IsCompare(uint8_t op) {
+  return op >= OP_LESS && op <= OP_NOT_EQUAL;
+}
+
+// Superinstruction families are laid out in the same order as the binary
+// opcodes, so a family member is found by offsetting from its first entry.
+static uint16_t BinarySuper(uint8_t op, int family) {
+  static const uint16_t first[] = {
+#define X(name, op) SI_##name##_CONST,
+    CCB_BINARY_OPS(X)
+#undef X
+  };
+  return (uint16_t)(first[op - OP_ADD] + family);
+}
+
+static uint16_t JumpSuper(uint8_t op, int family) {
+  static const uint16_t first[] = {
+#define X(name, op) SI_JUMP_UNLESS_##name,
+    CCB_COMPARE_OPS(X)
+#undef X
+  };
+  return (uint16_t)(first[op - OP_LESS] + family);
+}
+
+enum { FAMILY_CONST, FAMILY_LOCAL_CONST, FAMILY_GLOBAL_CONST, FAMILY_LOCALS, FAMILY_GLOBALS };
+enum { JUMP_FAMILY_PLAIN, JUMP_FAMILY_CONST, JUMP_FAMILY_LOCAL_CONST, JUMP_FAMILY_GLOBAL_CONST };
+
+static int Matches(const RawInstr* raw, int n, int i, const uint8_t* is_target,
+                   const uint8_t* ops, int len) {
+  if (i + len > n) {
+    return 0;
+  }
+  for (int k = 0; k < len; k++) {
+    if (k > 0 && is_target[raw[i + k].pos]) {
+      return 0;
+    }
+    uint8_t want = ops[k];
+    uint8_t got = raw[i + k].op;
+    if (want == OP_ADD ? !IsBinary(got) : want == OP_LESS ? !IsCompare(got) : got != want) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Tries to fuse the sequence starting at raw[i] into one instruction.
+// OP_ADD in a pattern stands for any binary opcode, OP_LESS for any comparison.
+static int Fuse(const RawInstr* raw, int n, int i, const uint8_t* is_target,
+                Instr* out, int* target) {
+  static const uint8_t get_const_cmp_jump[][4] = {
+    { OP_GET_LOCAL, OP_CONSTANT, OP_LESS, OP_JUMP_IF_FALSE },
+    { OP_GET_GLOBAL, OP_CONSTANT, OP_LESS, OP_JUMP_IF_FALSE },
+  };
+  static const uint8_t const_cmp_jump[] = { OP_CONSTANT, OP_LESS, OP_JUMP_IF_FALSE };
+  static const uint8_t cmp_jump[] = { OP_LESS, OP_JUMP_IF_FALSE };
+  static const uint8_t get_get_binary[][3] = {
+    { OP_GET_LOCAL, OP_GET_LOCAL, OP_ADD },
+    { OP_GET_GLOBAL, OP_GET_GLOBAL, OP_ADD },
+  };
+  static const uint8_t get_const_binary[][3] = {
+    { OP_GET_LOCAL, OP_CONSTANT, OP_ADD },
+    { OP_GET_GLOBAL, OP_CONSTANT, OP_ADD },
+  };
+  static const uint8_t const_binary[] = { OP_CONSTANT, OP_ADD };
+  static const uint8_t set_global_pop[] = { OP_SET_GLOBAL, OP_POP };
+  static const uint8_t set_local_pop[] = { OP_SET_LOCAL, OP_POP };
+
+  for (int v = 0; v < 2; v++) {
+    if (Matches(raw, n, i, is_target, get_const_cmp_jump[v], 4)) {
+      out->op = JumpSuper(raw[i + 2].op, v == 0 ? JUMP_FAMILY_LOCAL_CONST : JUMP_FAMILY_GLOBAL_CONST);
+      out->arg = (uint16_t)raw[i].operand;
+      out->imm = raw[i + 1].operand;
+      *target = raw[i + 3].target;
+      return 4;
+    }
+  }
+  if (Matches(raw, n, i, is_target, const_cmp_jump, 3)) {
+    out->op = JumpSuper(raw[i + 1].op, JUMP_FAMILY_CONST);
+    out->imm = raw[i].operand;
+    *target = raw[i + 2].target;
+    return 3;
+  }
+  if (Matches(raw, n, i, is_target, cmp_jump, 2)) {
+    out->op = JumpSuper(raw[i].op, JUMP_FAMILY_PLAIN);
+    *target = raw[i + 1].target;
+    return 2;
+  }
+  for (int v = 0; v < 2; v++) {
+    if (Matches(raw, n, i, is_target, get_get_binary[v], 3)) {
+      out->op = BinarySuper(raw[i + 2].op, v == 0 ? FAMILY_LOCALS : FAMILY_GLOBALS);
+      out->arg = (uint16_t)raw[i].operand;
+      out->imm = raw[i + 1].operand;
+      return 3;
+    }
+    if (Matches(raw, n, i, is_target, get_const_binary[v], 3)) {
+      out->op = BinarySuper(raw[i + 2].op, v == 0 ? FAMILY_LOCAL_CONST : FAMILY_GLOBAL_CONST);
+      out->arg = (uint16_t)raw[i].operand;
+      out->imm = raw[i + 1].operand;
+      return 3;
+    }
+  }
+  if (Matches(raw, n, i, is_target, const_binary, 2)) {
+    out->op = BinarySuper(raw[i + 1].op, FAMILY_CONST);
+    out->imm = raw[i].operand;
+    return 2;
+  }
+  if (Matches(raw, n, i, is_target, set_global_pop, 2)) {
+    // Storing a global and dropping the value is exactly OP_DEFINE_GLOBAL.
+    out->op = OP_DEFINE_GLOBAL;
+    out->arg = (uint16_t)raw[i].operand;
+    return 2;
+  }
+  if (Matches(raw, n, i, is_target, set_local_pop, 2)) {
+    out->op = SI_SET_LOCAL_POP;
+    out->arg = (uint16_t)raw[i].operand;
+    return 2;
+  }
+  return 0;
+}
+
+static int ReadRaw(const Chunk* chunk, RawInstr* raw, int* count, uint8_t* is_target) {
+  int n = 0;
+  for (int pos = 0; pos < chunk->count;) {
+    uint8_t op = chunk->code[pos];
+    int operands = OperandBytes(op);
+    if (operands < 0) {
+      printf("DECODE ERROR: Unknown opcode %d at %d\n", op, pos);
+      return 0;
+    }
+    if (pos + 1 + operands > chunk->count) {
+      printf("DECODE ERROR: Truncated instruction at %d\n", pos);
+      return 0;
+    }
+
+    RawInstr* r = &raw[n++];
+    r->pos = pos;
+    r->op = op;
+    r->operand = operands > 0 ? chunk->code[pos + 1] : 0;
+    r->target = -1;
+    switch (op) {
+      case OP_JUMP:
+      case OP_JUMP_IF_FALSE:
+        r->target = pos + 1 + ReadShort(&chunk->code[pos + 1]);
+        break;
+      case OP_LOOP:
+        r->target = pos + 1 - ReadShort(&chunk->code[pos + 1]);
+        break;
+      case OP_CALL:
+        r->target = ReadShort(&chunk->code[pos + 1]);
+        r->operand = chunk->code[pos + 3];
+        break;
+      case OP_CONSTANT:
+        if (r->operand >= chunk->constants_count) {
+          printf("DECODE ERROR: Bad constant index %d at %d\n", r->operand, pos);
+          return 0;
+        }
+        r->operand = chunk->constants[r->operand];
+        break;
+      default:
+        break;
+    }
+    if (r->target >= 0 && r->target < chunk->count) {
+      is_target[r->target] = 1;
+    } else if (r->target != -1) {
+      printf("DECODE ERROR: Bad jump target %d at %d\n", r->target, pos);
+      return 0;
+    }
+    pos += 1 + operands;
+  }
+
+  if (n == 0 || raw[n - 1].op != OP_RETURN) {
+    printf("DECODE ERROR: Chunk does not end with OP_RETURN\n");
+    return 0;
+  }
+  *count = n;
+  return 1;
+}
+
+int DecodeChunk(const Chunk* chunk, DecodedChunk* out) {
+  size_t size = (size_t)chunk->count + 1;
+  RawInstr* raw = (RawInstr*)malloc(size * sizeof(RawInstr));
+  uint8_t* is_target = (uint8_t*)calloc(size, 1);
+  int* index_of = (int*)malloc(size * sizeof(int));
+  int* targets = (int*)malloc(size * sizeof(int));
+  Instr* code = (Instr*)calloc(size, sizeof(Instr));
+  int* code_pos = (int*)malloc(size * sizeof(int));
+  int raw_count = 0;
+  int count = 0;
+  int ok = ReadRaw(chunk, raw, &raw_count, is_target);
+
+  for (int i = 0; ok && i < raw_count;) {
+    for (int pos = raw[i].pos; pos < (i + 1 < raw_count ? raw[i + 1].pos : chunk->count); pos++) {
+      index_of[pos] = -1;
+    }
+    index_of[raw[i].pos] = count;
+
+    Instr* in = &code[count];
+    int target = -1;
+    int fused = Fuse(raw, raw_count, i, is_target, in, &target);
+    if (fused == 0) {
+      in->op = raw[i].op;
+      if (raw[i].op == OP_CONSTANT) {
+        in->imm = raw[i].operand;
+      } else {
+        in->arg = (uint16_t)raw[i].operand;
+      }
+      target = raw[i].target;
+      fused = 1;
+    }
+    for (int k = 1; k < fused; k++) {
+      index_of[raw[i + k].pos] = -1;
+    }
+    code_pos[count] = raw[i].pos;
+    targets[count++] = target;
+    i += fused;
+  }
+
+  for (int i = 0; ok && i < count; i++) {
+    if (targets[i] < 0) {
+      continue;
+    }
+    if (index_of[targets[i]] < 0) {
+      printf("DECODE ERROR: Jump into the middle of an instruction at %d\n", targets[i]);
+      ok = 0;
+      break;
+    }
+    code[i].target = &code[index_of[targets[i]]];
+  }
+
+  free(raw);
+  free(is_target);
+  free(index_of);
+  free(targets);
+  if (!ok) {
+    free(code);
+    free(code_pos);
+    return 0;
+  }
+  out->code = code;
+  out->pos = code_pos;
+  out->count = count;
+  return 1;
+}
+
+void FreeDecoded(DecodedChunk* decoded) {
+  free(decoded->code);
+  free(decoded->pos);
+  decoded->code = NULL;
+  decoded->pos = NULL;
+  decoded->count = 0;
+}
+
+const char* OpName(int op) {
+  switch (op) {
+    case OP_CONSTANT: return "CONSTANT";
+    case OP_POP: return "POP";
+    case OP_DEFINE_GLOBAL: return "DEFINE_GLOBAL";
+    case OP_GET_GLOBAL: return "GET_GLOBAL";
+    case OP_SET_GLOBAL: return "SET_GLOBAL";
+    case OP_GET_LOCAL: return "GET_LOCAL";
+    case OP_SET_LOCAL: return "SET_LOCAL";
+    case OP_JUMP: return "JUMP";
+    case OP_JUMP_IF_FALSE: return "JUMP_IF_FALSE";
+    case OP_LOOP: return "LOOP";
+    case OP_IN: return "IN";
+    case OP_IN_LOCAL: return "IN_LOCAL";
+    case OP_OUT: return "OUT";
+    case OP_CALL: return "CALL";
+    case OP_RETURN: return "RETURN";
+    case SI_SET_LOCAL_POP: return "SET_LOCAL_POP";
+#define X(name, op)                                              \
+    case OP_##name: return #name;                                \
+    case SI_##name##_CONST: return #name "_CONST";               \
+    case SI_##name##_LOCAL_CONST: return #name "_LOCAL_CONST";   \
+    case SI_##name##_GLOBAL_CONST: return #name "_GLOBAL_CONST"; \
+    case SI_##name##_LOCALS: return #name "_LOCALS";             \
+    case SI_##name##_GLOBALS: return #name "_GLOBALS";
+    CCB_BINARY_OPS(X)
+#undef X
+#define X(name, op)                                                                  \
+    case SI_JUMP_UNLESS_##name: return "JUMP_UNLESS_" #name;                         \
+    case SI_JUMP_UNLESS_##name##_CONST: return "JUMP_UNLESS_" #name "_CONST";        \
+    case SI_JUMP_UNLESS_##name##_LOCAL_CONST: return "JUMP_UNLESS_" #name "_LOCAL_CONST"; \
+    case SI_JUMP_UNLESS_##name##_GLOBAL_CONST: return "JUMP_UNLESS_" #name "_GLOBAL_CONST";
+    CCB_COMPARE_OPS(X)
+#undef X
+    default: return "?";
+  }
+}
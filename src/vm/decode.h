@@ -0,0 +1,50 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include "../common/bytecode.h"
+
+// Superinstructions exist only in the decoded stream; DecodeChunk fuses
+// them from the most frequent opcode sequences emitted by codegen.
+typedef enum {
+  SI_SET_LOCAL_POP = OP_RETURN + 1,
+
+#define X(name, op)          \
+  SI_##name##_CONST,         \
+  SI_##name##_LOCAL_CONST,   \
+  SI_##name##_GLOBAL_CONST,  \
+  SI_##name##_LOCALS,        \
+  SI_##name##_GLOBALS,
+  CCB_BINARY_OPS(X)
+#undef X
+
+#define X(name, op)                    \
+  SI_JUMP_UNLESS_##name,               \
+  SI_JUMP_UNLESS_##name##_CONST,       \
+  SI_JUMP_UNLESS_##name##_LOCAL_CONST, \
+  SI_JUMP_UNLESS_##name##_GLOBAL_CONST,
+  CCB_COMPARE_OPS(X)
+#undef X
+
+  SI_COUNT
+} SuperOp;
+
+typedef struct Instr {
+  uint16_t op;
+  uint16_t arg;
+  Value imm;
+  struct Instr* target;
+} Instr;
+
+typedef struct {
+  Instr* code;
+  int* pos;   // bytecode offset each instruction was decoded from
+  int count;
+} DecodedChunk;
+
+int DecodeChunk(const Chunk* chunk, DecodedChunk* out);
+void FreeDecoded(DecodedChunk* decoded);
+const char* OpName(int op);
+// Operand bytes after the opcode byte, or -1 for an unknown opcode.
+int OperandBytes(uint8_t op);
+
+#endif
@@ -0,0 +1,472 @@
+#include <stdlib.h>
+#include <string.h>
+#include "disasm.h"
+#include "decode.h"
+
+#define HEAVY_LINES 10
+#define WASTE_EXAMPLES 5
+
+typedef enum {
+  WASTE_PUSH_POP,
+  WASTE_STORE_RELOAD,
+  WASTE_JUMP_NEXT,
+  WASTE_UNREACHABLE,
+  WASTE_COUNT
+} WasteKind;
+
+static const char* waste_names[WASTE_COUNT] = {
+  "value pushed and popped unused",
+  "store, POP, reload of the same variable",
+  "jump to the next instruction",
+  "unreachable instruction",
+};
+
+typedef struct {
+  int count;
+  int bytes;
+  int examples[WASTE_EXAMPLES];
+} Waste;
+
+typedef struct {
+  const Chunk* chunk;
+  FILE* out;
+
+  int* owner;          // bytecode offset -> function, -1 for the script
+  int* fn_end;
+  uint8_t* is_target;  // reached by a jump, a loop or a call
+
+  const char** line_start;
+  int source_lines;
+
+  Waste waste[WASTE_COUNT];
+} Disasm;
+
+static int ReadShort(const uint8_t* p) {
+  return (p[0] << 8) | p[1];
+}
+
+static int Target(const uint8_t* code, int pos) {
+  switch (code[pos]) {
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+      return pos + 1 + ReadShort(&code[pos + 1]);
+    case OP_LOOP:
+      return pos + 1 - ReadShort(&code[pos + 1]);
+    case OP_CALL:
+      return ReadShort(&code[pos + 1]);
+    default:
+      return -1;
+  }
+}
+
+static int UsesName(uint8_t op) {
+  return op == OP_DEFINE_GLOBAL || op == OP_GET_GLOBAL || op == OP_SET_GLOBAL || op == OP_IN;
+}
+
+static int Validate(Disasm* d) {
+  const Chunk* chunk = d->chunk;
+  for (int pos = 0; pos < chunk->count;) {
+    uint8_t op = chunk->code[pos];
+    int operands = OperandBytes(op);
+    if (operands < 0) {
+      printf("DISASM ERROR: Unknown opcode %d at %d\n", op, pos);
+      return 0;
+    }
+    if (pos + 1 + operands > chunk->count) {
+      printf("DISASM ERROR: Truncated instruction at %d\n", pos);
+      return 0;
+    }
+    if (operands >= 2) {
+      int target = Target(chunk->code, pos);
+      if (target < 0 || target >= chunk->count) {
+        printf("DISASM ERROR: Bad jump target %d at %d\n", target, pos);
+        return 0;
+      }
+      d->is_target[target] = 1;
+    }
+    if ((op == OP_CONSTANT && chunk->code[pos + 1] >= chunk->constants_count) ||
+        (UsesName(op) && chunk->code[pos + 1] >= chunk->names_count)) {
+      printf("DISASM ERROR: Bad operand %d at %d\n", chunk->code[pos + 1], pos);
+      return 0;
+    }
+    pos += 1 + operands;
+  }
+  return 1;
+}
+
+static const Disasm* sort_disasm;
+
+static int CompareBySize(const void* a, const void* b) {
+  int fa = *(const int*)a, fb = *(const int*)b;
+  int sa = sort_disasm->fn_end[fa] - sort_disasm->chunk->functions[fa].offset;
+  int sb = sort_disasm->fn_end[fb] - sort_disasm->chunk->functions[fb].offset;
+  return (sb > sa) - (sb < sa);
+}
+
+// A function body ends where the OP_JUMP emitted just before its entry
+// lands. Ranges are filled from the largest down, so a nested function
+// overrides its enclosing one.
+static void MapFunctions(Disasm* d) {
+  const Chunk* chunk = d->chunk;
+  int n = chunk->function_count;
+  int* order = (int*)malloc(((size_t)n + 1) * sizeof(int));
+  for (int f = 0; f < n; f++) {
+    int entry = chunk->functions[f].offset;
+    d->fn_end[f] = chunk->count;
+    if (entry >= 3 && chunk->code[entry - 3] == OP_JUMP) {
+      int end = Target(chunk->code, entry - 3);
+      if (end > entry && end <= chunk->count) {
+        d->fn_end[f] = end;
+      }
+    }
+    order[f] = f;
+  }
+  sort_disasm = d;
+  qsort(order, n, sizeof(int), CompareBySize);
+  for (int pos = 0; pos < chunk->count; pos++) {
+    d->owner[pos] = -1;
+  }
+  for (int i = 0; i < n; i++) {
+    int f = order[i];
+    for (int pos = chunk->functions[f].offset; pos < d->fn_end[f]; pos++) {
+      d->owner[pos] = f;
+    }
+  }
+  free(order);
+}
+
+static const char* FunctionName(const Disasm* d, int fn) {
+  return fn < 0 ? "<script>" : d->chunk->functions[fn].name;
+}
+
+static int FunctionAt(const Chunk* chunk, int offset) {
+  for (int f = 0; f < chunk->function_count; f++) {
+    if (chunk->functions[f].offset == offset) {
+      return f;
+    }
+  }
+  return -1;
+}
+
+static void SplitLines(Disasm* d, const char* source) {
+  d->line_start = NULL;
+  d->source_lines = 0;
+  if (source == NULL) {
+    return;
+  }
+  int n = 1;
+  for (const char* p = source; *p != '\0'; p++) {
+    n += *p == '\n';
+  }
+  d->line_start = (const char**)malloc(((size_t)n + 1) * sizeof(char*));
+  d->line_start[1] = source;
+  int line = 1;
+  for (const char* p = source; *p != '\0'; p++) {
+    if (*p == '\n') {
+      d->line_start[++line] = p + 1;
+    }
+  }
+  d->source_lines = n;
+}
+
+static void PrintSourceLine(const Disasm* d, int line) {
+  if (line < 1 || line > d->source_lines) {
+    return;
+  }
+  const char* p = d->line_start[line];
+  while (*p == ' ' || *p == '\t') {
+    p++;
+  }
+  const char* end = strchr(p, '\n');
+  fprintf(d->out, " | %.*s", (int)(end != NULL ? end - p : (long)strlen(p)), p);
+}
+
+static void PrintInstruction(const Disasm* d, int pos) {
+  const Chunk* chunk = d->chunk;
+  const uint8_t* code = chunk->code;
+  uint8_t op = code[pos];
+  fprintf(d->out, "%05d %c %-*s", pos, d->is_target[pos] ? '>' : ' ', OperandBytes(op) > 0 ? 14 : 0,
+          OpName(op));
+  switch (op) {
+    case OP_CONSTANT:
+      fprintf(d->out, " %5d  ; %d", code[pos + 1], chunk->constants[code[pos + 1]]);
+      break;
+    case OP_DEFINE_GLOBAL:
+    case OP_GET_GLOBAL:
+    case OP_SET_GLOBAL:
+    case OP_IN:
+      fprintf(d->out, " %5d  ; %s", code[pos + 1], chunk->names[code[pos + 1]]);
+      break;
+    case OP_GET_LOCAL:
+    case OP_SET_LOCAL:
+    case OP_IN_LOCAL:
+      fprintf(d->out, " %5d", code[pos + 1]);
+      break;
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_LOOP:
+      fprintf(d->out, " -> %05d", Target(code, pos));
+      break;
+    case OP_CALL: {
+      int fn = FunctionAt(chunk, Target(code, pos));
+      fprintf(d->out, " -> %05d  ; %s, %d args", Target(code, pos),
+              fn >= 0 ? chunk->functions[fn].name : "?", code[pos + 3]);
+      break;
+    }
+    default:
+      break;
+  }
+  fputc('\n', d->out);
+}
+
+static void NoteWaste(Disasm* d, WasteKind kind, int pos, int bytes) {
+  Waste* w = &d->waste[kind];
+  if (w->count < WASTE_EXAMPLES) {
+    w->examples[w->count] = pos;
+  }
+  w->count++;
+  w->bytes += bytes;
+}
+
+static int IsPush(uint8_t op) {
+  return op == OP_CONSTANT || op == OP_GET_LOCAL || op == OP_GET_GLOBAL;
+}
+
+// Patterns a peephole pass could remove; a jump target in the middle of a
+// pattern makes it necessary, so those are skipped.
+static void FindWaste(Disasm* d) {
+  const Chunk* chunk = d->chunk;
+  const uint8_t* code = chunk->code;
+  int reachable = 1;
+  for (int pos = 0; pos < chunk->count; pos += 1 + OperandBytes(code[pos])) {
+    uint8_t op = code[pos];
+    int size = 1 + OperandBytes(op);
+    if (d->is_target[pos]) {
+      reachable = 1;
+    }
+    if (!reachable) {
+      NoteWaste(d, WASTE_UNREACHABLE, pos, size);
+      continue;
+    }
+
+    int next = pos + size;
+    if (IsPush(op) && next < chunk->count && code[next] == OP_POP && !d->is_target[next]) {
+      NoteWaste(d, WASTE_PUSH_POP, pos, size + 1);
+    }
+    if ((op == OP_SET_LOCAL || op == OP_SET_GLOBAL) && next + 2 < chunk->count &&
+        code[next] == OP_POP && code[next + 1] == (op == OP_SET_LOCAL ? OP_GET_LOCAL : OP_GET_GLOBAL) &&
+        code[next + 2] == code[pos + 1] && !d->is_target[next] && !d->is_target[next + 1]) {
+      NoteWaste(d, WASTE_STORE_RELOAD, pos, 3);
+    }
+    if (op == OP_JUMP && Target(code, pos) == next) {
+      NoteWaste(d, WASTE_JUMP_NEXT, pos, size);
+    }
+    if (op == OP_JUMP || op == OP_LOOP || op == OP_RETURN) {
+      reachable = 0;
+    }
+  }
+}
+
+static void PrintListing(const Disasm* d) {
+  const Chunk* chunk = d->chunk;
+  int fn = -2;
+  int line = -1;
+  for (int pos = 0; pos < chunk->count; pos += 1 + OperandBytes(chunk->code[pos])) {
+    if (d->owner[pos] != fn) {
+      fn = d->owner[pos];
+      fprintf(d->out, "%s== %s ==\n", pos > 0 ? "\n" : "", FunctionName(d, fn));
+      line = -1;
+    }
+    int at = LineForOffset(chunk, pos);
+    if (at != line && at > 0) {
+      fprintf(d->out, "        ; line %d", at);
+      PrintSourceLine(d, at);
+      fputc('\n', d->out);
+    }
+    line = at;
+    PrintInstruction(d, pos);
+  }
+}
+
+static const int* sort_counts;
+
+static int CompareByCount(const void* a, const void* b) {
+  int ca = sort_counts[*(const int*)a], cb = sort_counts[*(const int*)b];
+  if (ca != cb) {
+    return (cb > ca) - (cb < ca);
+  }
+  return *(const int*)a - *(const int*)b;
+}
+
+static void PrintMix(const Disasm* d) {
+  const Chunk* chunk = d->chunk;
+  int ops = OP_RETURN + 1;
+  int fns = chunk->function_count + 1;
+  int* counts = (int*)calloc((size_t)fns * ops, sizeof(int));
+  int* bytes = (int*)calloc((size_t)fns, sizeof(int));
+  int total[OP_RETURN + 1] = {0};
+  int instructions = 0;
+  for (int pos = 0; pos < chunk->count; pos += 1 + OperandBytes(chunk->code[pos])) {
+    int f = d->owner[pos] + 1;
+    counts[f * ops + chunk->code[pos]]++;
+    bytes[f] += 1 + OperandBytes(chunk->code[pos]);
+    total[chunk->code[pos]]++;
+    instructions++;
+  }
+
+  fprintf(d->out, "\n== Instruction mix ==\n");
+  fprintf(d->out, "%-24s %7s %7s  %s\n", "function", "insns", "bytes", "opcodes");
+  int order[OP_RETURN + 1];
+  for (int f = 0; f <= fns; f++) {
+    const int* row = f < fns ? &counts[f * ops] : total;
+    int n = 0;
+    for (int op = 0; op < ops; op++) {
+      n += row[op];
+      order[op] = op;
+    }
+    if (n == 0 && f > 0) {
+      continue;
+    }
+    sort_counts = row;
+    qsort(order, ops, sizeof(int), CompareByCount);
+    fprintf(d->out, "%-24s %7d %7d ", f < fns ? FunctionName(d, f - 1) : "total", n,
+            f < fns ? bytes[f] : chunk->count);
+    for (int i = 0; i < ops && row[order[i]] > 0; i++) {
+      fprintf(d->out, " %s %d", OpName(order[i]), row[order[i]]);
+    }
+    fputc('\n', d->out);
+  }
+  fprintf(d->out, "POP: %d of %d instructions (%.1f%%)\n", total[OP_POP], instructions,
+          instructions ? 100.0 * total[OP_POP] / instructions : 0.0);
+
+  free(counts);
+  free(bytes);
+}
+
+static const int* sort_line_bytes;
+
+static int CompareLines(const void* a, const void* b) {
+  int la = *(const int*)a, lb = *(const int*)b;
+  if (sort_line_bytes[la] != sort_line_bytes[lb]) {
+    return (sort_line_bytes[lb] > sort_line_bytes[la]) - (sort_line_bytes[lb] < sort_line_bytes[la]);
+  }
+  return la - lb;
+}
+
+// Codegen marks one line per statement, so bytes per line are bytes per
+// statement unless several statements share a line.
+static void PrintLineSizes(const Disasm* d) {
+  const Chunk* chunk = d->chunk;
+  fprintf(d->out, "\n== Bytes per source line ==\n");
+  if (chunk->line_count == 0) {
+    fprintf(d->out, "No line table.\n");
+    return;
+  }
+  int max_line = 0;
+  for (int i = 0; i < chunk->line_count; i++) {
+    if (chunk->lines[i].line > max_line) {
+      max_line = chunk->lines[i].line;
+    }
+  }
+  int* line_bytes = (int*)calloc((size_t)max_line + 1, sizeof(int));
+  int* line_insns = (int*)calloc((size_t)max_line + 1, sizeof(int));
+  for (int pos = 0; pos < chunk->count; pos += 1 + OperandBytes(chunk->code[pos])) {
+    int line = LineForOffset(chunk, pos);
+    if (line > 0 && line <= max_line) {
+      line_bytes[line] += 1 + OperandBytes(chunk->code[pos]);
+      line_insns[line]++;
+    }
+  }
+
+  int* lines = (int*)malloc(((size_t)max_line + 1) * sizeof(int));
+  int n = 0;
+  long sum_bytes = 0, sum_insns = 0;
+  for (int line = 1; line <= max_line; line++) {
+    if (line_bytes[line] > 0) {
+      lines[n++] = line;
+      sum_bytes += line_bytes[line];
+      sum_insns += line_insns[line];
+    }
+  }
+  sort_line_bytes = line_bytes;
+  qsort(lines, n, sizeof(int), CompareLines);
+
+  fprintf(d->out, "%7s %7s %6s\n", "bytes", "insns", "line");
+  for (int i = 0; i < n && i < HEAVY_LINES; i++) {
+    fprintf(d->out, "%7d %7d %6d", line_bytes[lines[i]], line_insns[lines[i]], lines[i]);
+    PrintSourceLine(d, lines[i]);
+    fputc('\n', d->out);
+  }
+  if (n > 0) {
+    fprintf(d->out, "%d lines with code: %.1f bytes and %.1f instructions per line on average\n",
+            n, (double)sum_bytes / n, (double)sum_insns / n);
+  }
+
+  free(lines);
+  free(line_bytes);
+  free(line_insns);
+}
+
+static void PrintWaste(const Disasm* d) {
+  const Chunk* chunk = d->chunk;
+  fprintf(d->out, "\n== Possible waste ==\n");
+  int total = 0;
+  for (int k = 0; k < WASTE_COUNT; k++) {
+    const Waste* w = &d->waste[k];
+    if (w->count == 0) {
+      continue;
+    }
+    fprintf(d->out, "%-42s %6d x, %6d bytes  at", waste_names[k], w->count, w->bytes);
+    for (int i = 0; i < w->count && i < WASTE_EXAMPLES; i++) {
+      fprintf(d->out, " %05d", w->examples[i]);
+    }
+    fprintf(d->out, "%s\n", w->count > WASTE_EXAMPLES ? " ..." : "");
+    total += w->bytes;
+  }
+
+  int duplicates = 0;
+  for (int i = 0; i < chunk->constants_count; i++) {
+    for (int j = 0; j < i; j++) {
+      if (chunk->constants[j] == chunk->constants[i]) {
+        fprintf(d->out, "duplicate constant %d: #%d and #%d\n", chunk->constants[i], j, i);
+        duplicates++;
+        break;
+      }
+    }
+  }
+  fprintf(d->out, "%d of %d bytes (%.1f%%) in the patterns above, %d duplicate constants\n",
+          total, chunk->count, chunk->count ? 100.0 * total / chunk->count : 0.0, duplicates);
+}
+
+int DisassembleChunk(const Chunk* chunk, const char* source, FILE* out) {
+  Disasm d;
+  memset(&d, 0, sizeof(d));
+  d.chunk = chunk;
+  d.out = out;
+  d.is_target = (uint8_t*)calloc((size_t)chunk->count + 1, 1);
+  d.owner = (int*)malloc(((size_t)chunk->count + 1) * sizeof(int));
+  d.fn_end = (int*)malloc(((size_t)chunk->function_count + 1) * sizeof(int));
+
+  int ok = Validate(&d);
+  if (ok) {
+    for (int f = 0; f < chunk->function_count; f++) {
+      d.is_target[chunk->functions[f].offset] = 1;
+    }
+    MapFunctions(&d);
+    SplitLines(&d, source);
+    FindWaste(&d);
+
+    fprintf(out, "%d bytes of code, %d constants, %d globals, %d functions\n\n", chunk->count,
+            chunk->constants_count, chunk->names_count, chunk->function_count);
+    PrintListing(&d);
+    PrintMix(&d);
+    PrintLineSizes(&d);
+    PrintWaste(&d);
+  }
+
+  free(d.line_start);
+  free(d.is_target);
+  free(d.owner);
+  free(d.fn_end);
+  return ok;
+}
@@ -0,0 +1,13 @@
+#ifndef DISASM_H
+#define DISASM_H
+
+#include <stdio.h>
+#include "../common/bytecode.h"
+
+// Prints every instruction of chunk with decoded operands, followed by the
+// instruction mix per function, bytecode bytes per source line and code
+// that looks wasted. source is NULL for a loaded .ccbc. Returns 0 if the
+// bytecode is malformed.
+int DisassembleChunk(const Chunk* chunk, const char* source, FILE* out);
+
+#endif
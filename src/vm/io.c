@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "io.h"
+
+// Each thread gets its own buffer so VMs running in parallel never share
+// one; a run flushes its output when it ends.
+static _Thread_local char out_buffer[OUTPUT_BUFFER_SIZE];
+static _Thread_local size_t out_length;
+
+// There is one stdin, so its reader is shared by every run that has no
+// input callback; in_lock hands out one whole value at a time.
+static pthread_mutex_t in_lock = PTHREAD_MUTEX_INITIALIZER;
+static char in_buffer[INPUT_BUFFER_SIZE];
+static const char* in_cur;
+static const char* in_end;
+static IoFormat in_format = IO_TEXT;
+static int in_ready;
+static int in_mapped;
+static int in_eof;
+
+static IoFormat out_format = IO_TEXT;
+static int out_ready;
+static int out_line_buffered;
+
+static const char digit_pairs[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+// A terminal sees every value as soon as it is printed, as with stdio's
+// line buffering.
+static void InitOutput() {
+  out_ready = 1;
+  out_line_buffered = isatty(STDOUT_FILENO);
+  atexit(FlushOutput);
+}
+
+void SetOutputFormat(IoFormat format) {
+  out_format = format;
+}
+
+void FlushOutput() {
+  // Anything printed through stdio (banners, diagnostics) goes first.
+  fflush(stdout);
+
+  size_t done = 0;
+  while (done < out_length) {
+    ssize_t n = write(STDOUT_FILENO, out_buffer + done, out_length - done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    done += (size_t)n;
+  }
+  out_length = 0;
+}
+
+static size_t FormatValue(char* p, Value value) {
+  char tmp[16];
+  char* end = tmp + sizeof(tmp);
+  char* s = end;
+  uint32_t u = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+
+  while (u >= 100) {
+    uint32_t pair = (u % 100) * 2;
+    u /= 100;
+    *--s = digit_pairs[pair + 1];
+    *--s = digit_pairs[pair];
+  }
+  if (u >= 10) {
+    *--s = digit_pairs[u * 2 + 1];
+    *--s = digit_pairs[u * 2];
+  } else {
+    *--s = (char)('0' + u);
+  }
+  if (value < 0) {
+    *--s = '-';
+  }
+
+  size_t n = (size_t)(end - s);
+  memcpy(p, s, n);
+  p[n] = '\n';
+  return n + 1;
+}
+
+void WriteValue(Value value) {
+  if (!out_ready) {
+    InitOutput();
+  }
+  if (out_length > OUTPUT_BUFFER_SIZE - 16) {
+    FlushOutput();
+  }
+
+  if (out_format == IO_BINARY) {
+    uint32_t u = (uint32_t)value;
+    char* p = out_buffer + out_length;
+    p[0] = (char)(u & 0xff);
+    p[1] = (char)((u >> 8) & 0xff);
+    p[2] = (char)((u >> 16) & 0xff);
+    p[3] = (char)((u >> 24) & 0xff);
+    out_length += 4;
+  } else {
+    out_length += FormatValue(out_buffer + out_length, value);
+  }
+
+  if (out_line_buffered) {
+    FlushOutput();
+  }
+}
+
+void SetInputFormat(IoFormat format) {
+  in_format = format;
+}
+
+// A regular file on stdin is mapped whole, starting at the current file
+// offset; anything else is read in large blocks.
+static void InitInput() {
+  in_ready = 1;
+  struct stat st;
+  off_t offset = lseek(STDIN_FILENO, 0, SEEK_CUR);
+  if (fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode) && offset >= 0 && st.st_size > offset) {
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, STDIN_FILENO, 0);
+    if (map != MAP_FAILED) {
+      in_mapped = 1;
+      in_cur = (const char*)map + offset;
+      in_end = (const char*)map + st.st_size;
+    }
+  }
+}
+
+static int Refill() {
+  if (in_mapped || in_eof) {
+    return 0;
+  }
+  // About to block: whatever was printed so far (a prompt) must be visible.
+  FlushOutput();
+
+  ssize_t n;
+  do {
+    n = read(STDIN_FILENO, in_buffer, sizeof(in_buffer));
+  } while (n < 0 && errno == EINTR);
+  if (n <= 0) {
+    in_eof = 1;
+    return 0;
+  }
+  in_cur = in_buffer;
+  in_end = in_buffer + n;
+  return 1;
+}
+
+static inline int PeekChar() {
+  if (in_cur == in_end && !Refill()) {
+    return EOF;
+  }
+  return (unsigned char)*in_cur;
+}
+
+static Value ReadBinaryValue() {
+  uint32_t u = 0;
+  for (int i = 0; i < 4; i++) {
+    int c = PeekChar();
+    if (c == EOF) {
+      return 0;
+    }
+    in_cur++;
+    u |= (uint32_t)c << (8 * i);
+  }
+  return (Value)u;
+}
+
+// Same results as scanf("%d") followed by draining the rest of the line
+// on a bad token: that token reads as 0. End of input reads as 0 too.
+static Value ReadTextValue() {
+  int c = PeekChar();
+  while (c == ' ' || (c >= '\t' && c <= '\r')) {
+    in_cur++;
+    c = PeekChar();
+  }
+
+  int negative = 0;
+  if (c == '-' || c == '+') {
+    negative = c == '-';
+    in_cur++;
+    c = PeekChar();
+  }
+
+  if (c < '0' || c > '9') {
+    while (c != EOF && c != '\n') {
+      in_cur++;
+      c = PeekChar();
+    }
+    if (c == '\n') {
+      in_cur++;
+    }
+    return 0;
+  }
+
+  uint32_t value = 0;
+  do {
+    value = value * 10 + (uint32_t)(c - '0');
+    in_cur++;
+    c = PeekChar();
+  } while (c >= '0' && c <= '9');
+  return (Value)(negative ? 0u - value : value);
+}
+
+Value ReadValue() {
+  pthread_mutex_lock(&in_lock);
+  if (!in_ready) {
+    InitInput();
+  }
+  Value value = in_format == IO_BINARY ? ReadBinaryValue() : ReadTextValue();
+  pthread_mutex_unlock(&in_lock);
+  return value;
+}
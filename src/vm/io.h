@@ -0,0 +1,20 @@
+#ifndef IO_H
+#define IO_H
+
+#include "../common/bytecode.h"
+
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+#define INPUT_BUFFER_SIZE (64 * 1024)
+
+typedef enum {
+  IO_TEXT,
+  IO_BINARY
+} IoFormat;
+
+Value ReadValue();
+void WriteValue(Value value);
+void FlushOutput();
+void SetOutputFormat(IoFormat format);
+void SetInputFormat(IoFormat format);
+
+#endif
@@ -0,0 +1,350 @@
+#include <stdlib.h>
+#include <string.h>
+#include "profile.h"
+
+#define TOP_PAIRS 20
+
+typedef struct {
+  int first;
+  int second;
+  uint64_t count;
+} OpPair;
+
+OpProfile* NewOpProfile() {
+  OpProfile* profile = (OpProfile*)calloc(1, sizeof(OpProfile));
+  profile->last_op = -1;
+  return profile;
+}
+
+void FinishOpProfile(OpProfile* profile) {
+  if (profile->last_op >= 0) {
+    profile->cycles[profile->last_op] += ReadCycles() - profile->last_cycles;
+    profile->last_op = -1;
+  }
+}
+
+static const OpProfile* sort_profile;
+
+static int CompareByCycles(const void* a, const void* b) {
+  uint64_t ca = sort_profile->cycles[*(const int*)a];
+  uint64_t cb = sort_profile->cycles[*(const int*)b];
+  return (ca < cb) - (ca > cb);
+}
+
+static int CompareByCount(const void* a, const void* b) {
+  uint64_t ca = ((const OpPair*)a)->count;
+  uint64_t cb = ((const OpPair*)b)->count;
+  return (ca < cb) - (ca > cb);
+}
+
+static int SortedOps(const OpProfile* profile, int* ops) {
+  int n = 0;
+  for (int op = 0; op < SI_COUNT; op++) {
+    if (profile->counts[op] > 0) {
+      ops[n++] = op;
+    }
+  }
+  sort_profile = profile;
+  qsort(ops, n, sizeof(int), CompareByCycles);
+  return n;
+}
+
+static OpPair* SortedPairs(const OpProfile* profile, int* count) {
+  OpPair* pairs = (OpPair*)malloc(SI_COUNT * SI_COUNT * sizeof(OpPair));
+  int n = 0;
+  for (int a = 0; a < SI_COUNT; a++) {
+    for (int b = 0; b < SI_COUNT; b++) {
+      if (profile->pairs[a][b] > 0) {
+        pairs[n].first = a;
+        pairs[n].second = b;
+        pairs[n].count = profile->pairs[a][b];
+        n++;
+      }
+    }
+  }
+  qsort(pairs, n, sizeof(OpPair), CompareByCount);
+  *count = n;
+  return pairs;
+}
+
+static void Totals(const OpProfile* profile, uint64_t* count, uint64_t* cycles) {
+  *count = 0;
+  *cycles = 0;
+  for (int op = 0; op < SI_COUNT; op++) {
+    *count += profile->counts[op];
+    *cycles += profile->cycles[op];
+  }
+}
+
+void PrintOpProfile(const OpProfile* profile, FILE* out) {
+  uint64_t total_count, total_cycles;
+  Totals(profile, &total_count, &total_cycles);
+  if (total_count == 0) {
+    fprintf(out, "opcode profile: no instructions executed\n");
+    return;
+  }
+
+  int ops[SI_COUNT];
+  int n = SortedOps(profile, ops);
+  fprintf(out, "%-32s %14s %7s %16s %7s %9s\n", "opcode", "count", "count%", "cycles", "cycles%", "cyc/op");
+  for (int i = 0; i < n; i++) {
+    int op = ops[i];
+    fprintf(out, "%-32s %14llu %6.2f%% %16llu %6.2f%% %9.1f\n", OpName(op),
+            (unsigned long long)profile->counts[op], 100.0 * profile->counts[op] / total_count,
+            (unsigned long long)profile->cycles[op],
+            total_cycles ? 100.0 * profile->cycles[op] / total_cycles : 0.0,
+            (double)profile->cycles[op] / profile->counts[op]);
+  }
+  fprintf(out, "%-32s %14llu %7s %16llu\n", "total",
+          (unsigned long long)total_count, "", (unsigned long long)total_cycles);
+
+  int pair_count;
+  OpPair* pairs = SortedPairs(profile, &pair_count);
+  fprintf(out, "\ntop opcode pairs:\n");
+  for (int i = 0; i < pair_count && i < TOP_PAIRS; i++) {
+    fprintf(out, "  %-32s -> %-32s %14llu %6.2f%%\n", OpName(pairs[i].first), OpName(pairs[i].second),
+            (unsigned long long)pairs[i].count, 100.0 * pairs[i].count / total_count);
+  }
+  free(pairs);
+}
+
+void WriteOpProfileJson(const OpProfile* profile, FILE* out) {
+  uint64_t total_count, total_cycles;
+  Totals(profile, &total_count, &total_cycles);
+
+  int ops[SI_COUNT];
+  int n = SortedOps(profile, ops);
+  fprintf(out, "{\n  \"instructions\": %llu,\n  \"cycles\": %llu,\n  \"opcodes\": [",
+          (unsigned long long)total_count, (unsigned long long)total_cycles);
+  for (int i = 0; i < n; i++) {
+    fprintf(out, "%s\n    {\"op\": \"%s\", \"count\": %llu, \"cycles\": %llu}", i > 0 ? "," : "",
+            OpName(ops[i]), (unsigned long long)profile->counts[ops[i]],
+            (unsigned long long)profile->cycles[ops[i]]);
+  }
+  fprintf(out, "\n  ],\n  \"pairs\": [");
+
+  int pair_count;
+  OpPair* pairs = SortedPairs(profile, &pair_count);
+  for (int i = 0; i < pair_count; i++) {
+    fprintf(out, "%s\n    {\"first\": \"%s\", \"second\": \"%s\", \"count\": %llu}", i > 0 ? "," : "",
+            OpName(pairs[i].first), OpName(pairs[i].second), (unsigned long long)pairs[i].count);
+  }
+  fprintf(out, "\n  ]\n}\n");
+  free(pairs);
+}
+
+FnProfile* NewFnProfile(const Chunk* chunk, const DecodedChunk* decoded) {
+  FnProfile* profile = (FnProfile*)calloc(1, sizeof(FnProfile));
+  profile->fn_count = chunk->function_count + 1;
+  profile->fns = (FnStats*)calloc(profile->fn_count, sizeof(FnStats));
+  profile->fns[0].name = "<script>";
+  profile->fn_at = (int*)malloc((decoded->count + 1) * sizeof(int));
+  for (int i = 0; i < decoded->count; i++) {
+    profile->fn_at[i] = -1;
+    for (int f = 0; f < chunk->function_count; f++) {
+      if (decoded->pos[i] == chunk->functions[f].offset) {
+        profile->fn_at[i] = f + 1;
+      }
+    }
+  }
+  for (int f = 0; f < chunk->function_count; f++) {
+    profile->fns[f + 1].name = chunk->functions[f].name;
+  }
+  return profile;
+}
+
+void FreeFnProfile(FnProfile* profile) {
+  free(profile->fns);
+  free(profile->fn_at);
+  free(profile->nodes);
+  free(profile->stack);
+  free(profile);
+}
+
+static int ChildNode(FnProfile* profile, int parent, int fn) {
+  if (parent >= 0) {
+    for (int c = profile->nodes[parent].first_child; c >= 0; c = profile->nodes[c].next_sibling) {
+      if (profile->nodes[c].fn == fn) {
+        return c;
+      }
+    }
+  }
+  if (profile->node_capacity < profile->node_count + 1) {
+    profile->node_capacity = profile->node_capacity < 16 ? 16 : profile->node_capacity * 2;
+    profile->nodes = realloc(profile->nodes, profile->node_capacity * sizeof(CallNode));
+  }
+  int n = profile->node_count++;
+  CallNode* node = &profile->nodes[n];
+  node->parent = parent;
+  node->fn = fn;
+  node->first_child = -1;
+  node->next_sibling = -1;
+  node->self = 0;
+  if (parent >= 0) {
+    node->next_sibling = profile->nodes[parent].first_child;
+    profile->nodes[parent].first_child = n;
+  }
+  return n;
+}
+
+static void PushActivation(FnProfile* profile, int fn, uint64_t now) {
+  int parent = profile->depth > 0 ? profile->stack[profile->depth - 1].node : -1;
+  if (profile->stack_capacity < profile->depth + 1) {
+    profile->stack_capacity = profile->stack_capacity < 16 ? 16 : profile->stack_capacity * 2;
+    profile->stack = realloc(profile->stack, profile->stack_capacity * sizeof(FnActivation));
+  }
+  FnActivation* a = &profile->stack[profile->depth++];
+  a->node = ChildNode(profile, parent, fn);
+  a->fn = fn;
+  a->start = now;
+  profile->fns[fn].calls++;
+  profile->fns[fn].active++;
+}
+
+// Only the outermost activation of a recursive function adds to its
+// inclusive time, so recursion is not counted twice.
+static void PopActivation(FnProfile* profile, uint64_t now) {
+  FnActivation* a = &profile->stack[--profile->depth];
+  FnStats* fn = &profile->fns[a->fn];
+  if (--fn->active == 0) {
+    fn->inclusive += now - a->start;
+  }
+}
+
+static void ChargeSelf(FnProfile* profile, uint64_t now) {
+  if (profile->depth > 0) {
+    profile->nodes[profile->stack[profile->depth - 1].node].self += now - profile->last;
+  }
+  profile->last = now;
+}
+
+void StartFnProfile(FnProfile* profile) {
+  uint64_t now = ReadCycles();
+  profile->start = now;
+  profile->last = now;
+  PushActivation(profile, 0, now);
+}
+
+void ProfileCall(FnProfile* profile, int entry) {
+  uint64_t now = ReadCycles();
+  ChargeSelf(profile, now);
+  int fn = profile->fn_at[entry];
+  PushActivation(profile, fn >= 0 ? fn : 0, now);
+}
+
+void ProfileReturn(FnProfile* profile) {
+  uint64_t now = ReadCycles();
+  ChargeSelf(profile, now);
+  PopActivation(profile, now);
+}
+
+// Frames still open after a runtime error are closed at the same moment.
+void FinishFnProfile(FnProfile* profile) {
+  uint64_t now = ReadCycles();
+  ChargeSelf(profile, now);
+  while (profile->depth > 0) {
+    PopActivation(profile, now);
+  }
+  for (int n = 0; n < profile->node_count; n++) {
+    profile->fns[profile->nodes[n].fn].exclusive += profile->nodes[n].self;
+  }
+}
+
+static const FnProfile* sort_fn_profile;
+
+static int CompareByExclusive(const void* a, const void* b) {
+  uint64_t ea = sort_fn_profile->fns[*(const int*)a].exclusive;
+  uint64_t eb = sort_fn_profile->fns[*(const int*)b].exclusive;
+  return (ea < eb) - (ea > eb);
+}
+
+void PrintFnProfile(const FnProfile* profile, FILE* out) {
+  uint64_t total = profile->fns[0].inclusive;
+  int* order = (int*)malloc(profile->fn_count * sizeof(int));
+  int n = 0;
+  for (int f = 0; f < profile->fn_count; f++) {
+    if (profile->fns[f].calls > 0) {
+      order[n++] = f;
+    }
+  }
+  sort_fn_profile = profile;
+  qsort(order, n, sizeof(int), CompareByExclusive);
+
+  fprintf(out, "%-32s %12s %16s %7s %16s %7s\n", "function", "calls", "inclusive", "incl%", "exclusive", "excl%");
+  for (int i = 0; i < n; i++) {
+    const FnStats* fn = &profile->fns[order[i]];
+    fprintf(out, "%-32s %12llu %16llu %6.2f%% %16llu %6.2f%%\n", fn->name,
+            (unsigned long long)fn->calls,
+            (unsigned long long)fn->inclusive, total ? 100.0 * fn->inclusive / total : 0.0,
+            (unsigned long long)fn->exclusive, total ? 100.0 * fn->exclusive / total : 0.0);
+  }
+  free(order);
+}
+
+static void WriteStack(const FnProfile* profile, int node, FILE* out) {
+  if (profile->nodes[node].parent >= 0) {
+    WriteStack(profile, profile->nodes[node].parent, out);
+    fputc(';', out);
+  }
+  fputs(profile->fns[profile->nodes[node].fn].name, out);
+}
+
+// One "a;b;c <cycles>" line per call path, the input format of
+// flamegraph.pl.
+void WriteCollapsedStacks(const FnProfile* profile, FILE* out) {
+  for (int n = 0; n < profile->node_count; n++) {
+    if (profile->nodes[n].self == 0) {
+      continue;
+    }
+    WriteStack(profile, n, out);
+    fprintf(out, " %llu\n", (unsigned long long)profile->nodes[n].self);
+  }
+}
+
+// Hits of a decoded instruction go to the line of its first bytecode
+// instruction, so a superinstruction is counted once. Lines that produced
+// code but never ran show 0; lines without code are left blank.
+void PrintLineProfile(const Chunk* chunk, const DecodedChunk* decoded, const uint64_t* hits,
+                      const char* source, FILE* out) {
+  int max_line = 0;
+  for (int i = 0; i < chunk->line_count; i++) {
+    if (chunk->lines[i].line > max_line) {
+      max_line = chunk->lines[i].line;
+    }
+  }
+  uint64_t* line_hits = (uint64_t*)calloc((size_t)max_line + 1, sizeof(uint64_t));
+  uint8_t* has_code = (uint8_t*)calloc((size_t)max_line + 1, 1);
+  uint64_t total = 0;
+  for (int i = 0; i < chunk->line_count; i++) {
+    has_code[chunk->lines[i].line] = 1;
+  }
+  for (int i = 0; i < decoded->count; i++) {
+    int line = LineForOffset(chunk, decoded->pos[i]);
+    line_hits[line] += hits[i];
+    total += hits[i];
+  }
+
+  fprintf(out, "%12s %7s %5s\n", "hits", "%", "line");
+  const char* p = source;
+  for (int line = 1; line <= max_line || (p != NULL && *p != '\0'); line++) {
+    int known = line <= max_line && has_code[line];
+    if (known) {
+      fprintf(out, "%12llu %6.2f%% %5d", (unsigned long long)line_hits[line],
+              total ? 100.0 * line_hits[line] / total : 0.0, line);
+    } else if (p == NULL) {
+      continue;
+    } else {
+      fprintf(out, "%12s %7s %5d", "", "", line);
+    }
+    if (p != NULL && *p != '\0') {
+      const char* end = strchr(p, '\n');
+      size_t length = end != NULL ? (size_t)(end - p) : strlen(p);
+      fprintf(out, " | %.*s", (int)length, p);
+      p += length + (end != NULL);
+    }
+    fputc('\n', out);
+  }
+
+  free(line_hits);
+  free(has_code);
+}
@@ -0,0 +1,118 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "decode.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define ReadCycles() __rdtsc()
+#else
+#include <time.h>
+static inline uint64_t ReadCycles() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+// Cycles between two dispatches are charged to the first instruction, so
+// they include the dispatch itself and the profiler's own overhead.
+typedef struct {
+  uint64_t counts[SI_COUNT];
+  uint64_t cycles[SI_COUNT];
+  uint64_t pairs[SI_COUNT][SI_COUNT];
+  int last_op;
+  uint64_t last_cycles;
+} OpProfile;
+
+static inline void ProfileInsn(OpProfile* profile, int op) {
+  uint64_t now = ReadCycles();
+  if (profile->last_op >= 0) {
+    profile->cycles[profile->last_op] += now - profile->last_cycles;
+    profile->pairs[profile->last_op][op]++;
+  }
+  profile->counts[op]++;
+  profile->last_op = op;
+  profile->last_cycles = now;
+}
+
+typedef struct {
+  const char* name;
+  uint64_t calls;
+  uint64_t inclusive;
+  uint64_t exclusive;
+  int active;
+} FnStats;
+
+// One node per distinct call path; self time accumulates in the node of
+// the innermost function, which is what collapsed stacks need.
+typedef struct {
+  int parent;
+  int fn;
+  int first_child;
+  int next_sibling;
+  uint64_t self;
+} CallNode;
+
+typedef struct {
+  int node;
+  int fn;
+  uint64_t start;
+} FnActivation;
+
+typedef struct {
+  uint64_t instructions;
+  int max_stack;
+  int max_calls;
+} RunStats;
+
+static inline void CountStats(RunStats* stats, int stack_depth) {
+  stats->instructions++;
+  if (stack_depth > stats->max_stack) {
+    stats->max_stack = stack_depth;
+  }
+}
+
+static inline void CountCall(RunStats* stats, int call_depth) {
+  if (call_depth > stats->max_calls) {
+    stats->max_calls = call_depth;
+  }
+}
+
+typedef struct {
+  FnStats* fns;      // index 0 is the top-level script
+  int fn_count;
+  int* fn_at;        // decoded instruction index -> function, or -1
+
+  CallNode* nodes;
+  int node_count;
+  int node_capacity;
+
+  FnActivation* stack;
+  int depth;
+  int stack_capacity;
+
+  uint64_t last;
+  uint64_t start;
+} FnProfile;
+
+OpProfile* NewOpProfile();
+void FinishOpProfile(OpProfile* profile);
+void PrintOpProfile(const OpProfile* profile, FILE* out);
+void WriteOpProfileJson(const OpProfile* profile, FILE* out);
+
+FnProfile* NewFnProfile(const Chunk* chunk, const DecodedChunk* decoded);
+void FreeFnProfile(FnProfile* profile);
+void StartFnProfile(FnProfile* profile);
+void ProfileCall(FnProfile* profile, int entry);
+void ProfileReturn(FnProfile* profile);
+void FinishFnProfile(FnProfile* profile);
+void PrintFnProfile(const FnProfile* profile, FILE* out);
+void WriteCollapsedStacks(const FnProfile* profile, FILE* out);
+
+void PrintLineProfile(const Chunk* chunk, const DecodedChunk* decoded, const uint64_t* hits,
+                      const char* source, FILE* out);
+
+#endif
@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "regvm.h"
+#include "verify.h"
+#include "../parser/parser.h"
+#include "../codegen/regcodegen.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(CCB_SWITCH_DISPATCH)
+#define CCB_COMPUTED_GOTO
+#endif
+
+#ifdef CCB_COUNT_INSNS
+static unsigned long long executed;
+#define COUNT_INSN() executed++
+#else
+#define COUNT_INSN() ((void)0)
+#endif
+
+typedef struct {
+  const RegInstr* ret_ip;
+  Value* base;
+  uint16_t dst;
+} RegFrame;
+
+InterpretResult RunRegister(const RegChunk* chunk) {
+  Value* regs = (Value*)calloc(REG_STACK_MAX, sizeof(Value));
+  Value* globals = regs;
+  RegFrame* frames = (RegFrame*)malloc(CALLSTACK_MAX * sizeof(RegFrame));
+  int calltop = 0;
+  InterpretResult result = INTERPRET_OK;
+
+  const RegInstr* code = chunk->code;
+  const RegInstr* ip = code;
+  const RegInstr* in;
+  Value* base = regs;
+
+  if (chunk->frame_size > REG_STACK_MAX) {
+    fprintf(stderr, "RUNTIME ERROR: stack overflow.\n");
+    result = INTERPRET_RUNTIME_ERROR;
+    goto done;
+  }
+
+#ifdef CCB_COMPUTED_GOTO
+  static void* dispatch_table[] = {
+    [ROP_LOADK] = &&L_ROP_LOADK,
+    [ROP_MOVE] = &&L_ROP_MOVE,
+    [ROP_GET_GLOBAL] = &&L_ROP_GET_GLOBAL,
+    [ROP_SET_GLOBAL] = &&L_ROP_SET_GLOBAL,
+#define X(name, op)                         \
+    [ROP_##name] = &&L_ROP_##name,          \
+    [ROP_##name##_K] = &&L_ROP_##name##_K,
+    CCB_BINARY_OPS(X)
+#undef X
+    [ROP_JUMP] = &&L_ROP_JUMP,
+    [ROP_JUMP_IF_FALSE] = &&L_ROP_JUMP_IF_FALSE,
+#define X(name, op)                                             \
+    [ROP_JUMP_UNLESS_##name] = &&L_ROP_JUMP_UNLESS_##name,      \
+    [ROP_JUMP_UNLESS_##name##_K] = &&L_ROP_JUMP_UNLESS_##name##_K,
+    CCB_COMPARE_OPS(X)
+#undef X
+    [ROP_IN_LOCAL] = &&L_ROP_IN_LOCAL,
+    [ROP_OUT] = &&L_ROP_OUT,
+    [ROP_CALL] = &&L_ROP_CALL,
+    [ROP_RETURN] = &&L_ROP_RETURN,
+    [ROP_HALT] = &&L_ROP_HALT
+  };
+
+#define DISPATCH()                     \
+  do {                                 \
+    COUNT_INSN();                      \
+    in = ip++;                         \
+    goto *dispatch_table[in->op];      \
+  } while (0)
+#define CASE(op) L_##op
+#define NEXT DISPATCH()
+
+  DISPATCH();
+#else
+#define CASE(op) case op
+#define NEXT break
+
+  for (;;) {
+    COUNT_INSN();
+    in = ip++;
+    switch (in->op) {
+#endif
+      CASE(ROP_LOADK): {
+        base[in->a] = in->k;
+        NEXT;
+      }
+      CASE(ROP_MOVE): {
+        base[in->a] = base[in->b];
+        NEXT;
+      }
+      CASE(ROP_GET_GLOBAL): {
+        base[in->a] = globals[in->b];
+        NEXT;
+      }
+      CASE(ROP_SET_GLOBAL): {
+        globals[in->a] = base[in->b];
+        NEXT;
+      }
+
+#define X(name, op)                                  \
+      CASE(ROP_##name): {                            \
+        base[in->a] = base[in->b] op base[in->c];    \
+        NEXT;                                        \
+      }                                              \
+      CASE(ROP_##name##_K): {                        \
+        base[in->a] = base[in->b] op in->k;          \
+        NEXT;                                        \
+      }
+      CCB_BINARY_OPS(X)
+#undef X
+
+      CASE(ROP_JUMP): {
+        ip = code + in->target;
+        NEXT;
+      }
+      CASE(ROP_JUMP_IF_FALSE): {
+        if (base[in->a] == 0) {
+          ip = code + in->target;
+        }
+        NEXT;
+      }
+
+#define X(name, op)                                  \
+      CASE(ROP_JUMP_UNLESS_##name): {                \
+        if (!(base[in->a] op base[in->b])) {         \
+          ip = code + in->target;                    \
+        }                                            \
+        NEXT;                                        \
+      }                                              \
+      CASE(ROP_JUMP_UNLESS_##name##_K): {            \
+        if (!(base[in->a] op in->k)) {               \
+          ip = code + in->target;                    \
+        }                                            \
+        NEXT;                                        \
+      }
+      CCB_COMPARE_OPS(X)
+#undef X
+
+      CASE(ROP_IN_LOCAL): {
+        base[in->a] = ReadValue();
+        NEXT;
+      }
+      CASE(ROP_OUT): {
+        WriteValue(base[in->a]);
+        NEXT;
+      }
+
+      CASE(ROP_CALL): {
+        const RegFunction* fn = &chunk->functions[in->target];
+        Value* callee = base + in->b;
+        if (calltop >= CALLSTACK_MAX) {
+          fprintf(stderr, "RUNTIME ERROR: call stack overflow.\n");
+          result = INTERPRET_RUNTIME_ERROR;
+          goto done;
+        }
+        if (callee + fn->frame_size > regs + REG_STACK_MAX) {
+          fprintf(stderr, "RUNTIME ERROR: stack overflow.\n");
+          result = INTERPRET_RUNTIME_ERROR;
+          goto done;
+        }
+        for (int i = fn->param_count; i < fn->local_count; i++) {
+          callee[i] = 0;
+        }
+        RegFrame* fr = &frames[calltop++];
+        fr->ret_ip = ip;
+        fr->base = base;
+        fr->dst = in->a;
+        base = callee;
+        ip = code + fn->entry;
+        NEXT;
+      }
+      CASE(ROP_RETURN): {
+        Value ret = base[in->a];
+        if (calltop == 0) {
+          goto done;
+        }
+        RegFrame* fr = &frames[--calltop];
+        base = fr->base;
+        ip = fr->ret_ip;
+        base[fr->dst] = ret;
+        NEXT;
+      }
+      CASE(ROP_HALT): {
+        goto done;
+      }
+#ifndef CCB_COMPUTED_GOTO
+      default:
+        printf("Unknown opcode %d\n", in->op);
+        result = INTERPRET_RUNTIME_ERROR;
+        goto done;
+    }
+  }
+#endif
+
+#undef CASE
+#undef NEXT
+#undef DISPATCH
+
+done:
+  FlushOutput();
+#ifdef CCB_COUNT_INSNS
+  fprintf(stderr, "instructions executed: %llu\n", executed);
+#endif
+  free(regs);
+  free(frames);
+  return result;
+}
+
+InterpretResult InterpretRegister(const char* source) {
+  Lexer* l = NewLexer(source);
+  Parser* p = NewParser(l);
+  Program* program = ParseProgram(p);
+
+  if (program == NULL || p->had_error) {
+    FreeProgram(program);
+    free(p->ns_prefix);
+    free(l);
+    free(p);
+    return INTERPRET_COMPILE_ERROR;
+  }
+
+  RegChunk* chunk = CompileRegister(program);
+  InterpretResult result = INTERPRET_COMPILE_ERROR;
+  if (chunk != NULL) {
+    result = RunRegister(chunk);
+    FreeRegChunk(chunk);
+    free(chunk);
+  }
+  FreeProgram(program);
+  free(p->ns_prefix);
+  free(l);
+  free(p);
+  return result;
+}
+
+static InterpretResult RunStackSource(void* source) {
+  return Interpret((const char*)source);
+}
+
+static InterpretResult RunRegisterSource(void* source) {
+  return InterpretRegister((const char*)source);
+}
+
+InterpretResult VerifyRegister(const char* source) {
+  VerifyEngine stack = { "stack vm", RunStackSource, (void*)source };
+  VerifyEngine reg = { "register vm", RunRegisterSource, (void*)source };
+  return VerifyEngines("REGISTER VERIFY", stack, reg);
+}
@@ -0,0 +1,17 @@
+#ifndef REGVM_H
+#define REGVM_H
+
+#include "../common/regcode.h"
+#include "vm.h"
+
+// Unlike the stack VM's 256-value stack this fits any recursion up to
+// CALLSTACK_MAX frames, so a program that overflows the stack VM can still
+// finish here; --register-verify reports such runs as not compared.
+#define REG_STACK_MAX 65536
+
+InterpretResult RunRegister(const RegChunk* chunk);
+InterpretResult InterpretRegister(const char* source);
+// Runs the program on the stack and the register VM and compares them.
+InterpretResult VerifyRegister(const char* source);
+
+#endif
@@ -0,0 +1,295 @@
+// The interpreter loop. vm.c includes this file once per variant, with
+// RUN_FUNCTION naming the function, PROFILE_INSN(in) run before every
+// instruction and PROFILE_CALL(in)/PROFILE_RETURN() run when a frame is
+// pushed or popped, so the plain loop carries no profiling code at all.
+
+static InterpretResult RUN_FUNCTION(VM* vm) {
+  const Instr* ip = vm->code->code;
+  const Instr* in;
+#ifdef CCB_COMPUTED_GOTO
+  static void* dispatch_table[] = {
+    [OP_CONSTANT] = &&L_OP_CONSTANT,
+    [OP_POP] = &&L_OP_POP,
+    [OP_DEFINE_GLOBAL] = &&L_OP_DEFINE_GLOBAL,
+    [OP_GET_GLOBAL] = &&L_OP_GET_GLOBAL,
+    [OP_SET_GLOBAL] = &&L_OP_SET_GLOBAL,
+    [OP_GET_LOCAL] = &&L_OP_GET_LOCAL,
+    [OP_SET_LOCAL] = &&L_OP_SET_LOCAL,
+    [OP_JUMP] = &&L_OP_JUMP,
+    [OP_JUMP_IF_FALSE] = &&L_OP_JUMP_IF_FALSE,
+    [OP_LOOP] = &&L_OP_LOOP,
+    [OP_ADD] = &&L_OP_ADD,
+    [OP_SUBTRACT] = &&L_OP_SUBTRACT,
+    [OP_MULTIPLY] = &&L_OP_MULTIPLY,
+    [OP_DIVIDE] = &&L_OP_DIVIDE,
+    [OP_LESS] = &&L_OP_LESS,
+    [OP_GREATER] = &&L_OP_GREATER,
+    [OP_LESS_EQUAL] = &&L_OP_LESS_EQUAL,
+    [OP_GREATER_EQUAL] = &&L_OP_GREATER_EQUAL,
+    [OP_EQUAL] = &&L_OP_EQUAL,
+    [OP_NOT_EQUAL] = &&L_OP_NOT_EQUAL,
+    [OP_IN] = &&L_OP_IN,
+    [OP_IN_LOCAL] = &&L_OP_IN_LOCAL,
+    [OP_OUT] = &&L_OP_OUT,
+    [OP_CALL] = &&L_OP_CALL,
+    [OP_RETURN] = &&L_OP_RETURN,
+    [SI_SET_LOCAL_POP] = &&L_SI_SET_LOCAL_POP,
+#define X(name, op)                                         \
+    [SI_##name##_CONST] = &&L_SI_##name##_CONST,            \
+    [SI_##name##_LOCAL_CONST] = &&L_SI_##name##_LOCAL_CONST,   \
+    [SI_##name##_GLOBAL_CONST] = &&L_SI_##name##_GLOBAL_CONST, \
+    [SI_##name##_LOCALS] = &&L_SI_##name##_LOCALS,          \
+    [SI_##name##_GLOBALS] = &&L_SI_##name##_GLOBALS,
+    CCB_BINARY_OPS(X)
+#undef X
+#define X(name, op)                                                             \
+    [SI_JUMP_UNLESS_##name] = &&L_SI_JUMP_UNLESS_##name,                        \
+    [SI_JUMP_UNLESS_##name##_CONST] = &&L_SI_JUMP_UNLESS_##name##_CONST,        \
+    [SI_JUMP_UNLESS_##name##_LOCAL_CONST] = &&L_SI_JUMP_UNLESS_##name##_LOCAL_CONST, \
+    [SI_JUMP_UNLESS_##name##_GLOBAL_CONST] = &&L_SI_JUMP_UNLESS_##name##_GLOBAL_CONST,
+    CCB_COMPARE_OPS(X)
+#undef X
+  };
+
+#define DISPATCH()                     \
+  do {                                 \
+    COUNT_INSN();                      \
+    in = ip++;                         \
+    PROFILE_INSN(in);                  \
+    goto *dispatch_table[in->op];      \
+  } while (0)
+#define CASE(op) L_##op
+#define NEXT DISPATCH()
+
+  DISPATCH();
+#else
+#define CASE(op) case op
+#define NEXT break
+
+  for (;;) {
+    COUNT_INSN();
+    in = ip++;
+    PROFILE_INSN(in);
+    switch (in->op) {
+#endif
+      CASE(OP_CONSTANT): {
+        PUSH(in->imm);
+        NEXT;
+      }
+      CASE(OP_POP): {
+        Pop(vm);
+        NEXT;
+      }
+      CASE(OP_DEFINE_GLOBAL): {
+        vm->globals[in->arg] = Pop(vm);
+        NEXT;
+      }
+      CASE(OP_GET_GLOBAL): {
+        PUSH(vm->globals[in->arg]);
+        NEXT;
+      }
+      CASE(OP_SET_GLOBAL): {
+        vm->globals[in->arg] = vm->stack_top[-1];
+        NEXT;
+      }
+
+      CASE(OP_GET_LOCAL): {
+        CallFrame* fr = &vm->frames[vm->calltop - 1];
+        PUSH(fr->base[in->arg]);
+        NEXT;
+      }
+      CASE(OP_SET_LOCAL): {
+        CallFrame* fr = &vm->frames[vm->calltop - 1];
+        fr->base[in->arg] = vm->stack_top[-1];
+        NEXT;
+      }
+
+      CASE(OP_ADD): {
+        Value b = Pop(vm);
+        Value a = Pop(vm);
+        PUSH(a + b);
+        NEXT;
+      }
+      CASE(OP_SUBTRACT): {
+        Value b = Pop(vm);
+        Value a = Pop(vm);
+        PUSH(a - b);
+        NEXT;
+      }
+      CASE(OP_MULTIPLY): {
+        Value b = Pop(vm);
+        Value a = Pop(vm);
+        PUSH(a * b);
+        NEXT;
+      }
+      CASE(OP_DIVIDE): {
+        Value b = Pop(vm);
+        Value a = Pop(vm);
+        PUSH(a / b);
+        NEXT;
+      }
+      CASE(OP_LESS): {
+        Value b = Pop(vm);
+        Value a = Pop(vm);
+        PUSH(a < b);
+        NEXT;
+      }
+      CASE(OP_GREATER): {
+        Value b = Pop(vm);
+        Value a = Pop(vm);
+        PUSH(a > b);
+        NEXT;
+      }
+      CASE(OP_LESS_EQUAL): {
+        Value b = Pop(vm);
+        Value a = Pop(vm);
+        PUSH(a <= b);
+        NEXT;
+      }
+      CASE(OP_GREATER_EQUAL): {
+        Value b = Pop(vm);
+        Value a = Pop(vm);
+        PUSH(a >= b);
+        NEXT;
+      }
+      CASE(OP_EQUAL): {
+        Value b = Pop(vm);
+        Value a = Pop(vm);
+        PUSH(a == b);
+        NEXT;
+      }
+      CASE(OP_NOT_EQUAL): {
+        Value b = Pop(vm);
+        Value a = Pop(vm);
+        PUSH(a != b);
+        NEXT;
+      }
+
+      CASE(OP_JUMP):
+      CASE(OP_LOOP): {
+        ip = in->target;
+        NEXT;
+      }
+      CASE(OP_JUMP_IF_FALSE): {
+        if (Pop(vm) == 0) {
+          ip = in->target;
+        }
+        NEXT;
+      }
+
+      CASE(OP_IN): {
+        vm->globals[in->arg] = vm->input(vm->io_user);
+        NEXT;
+      }
+      CASE(OP_IN_LOCAL): {
+        CallFrame* fr = &vm->frames[vm->calltop - 1];
+        fr->base[in->arg] = vm->input(vm->io_user);
+        NEXT;
+      }
+      CASE(OP_OUT): {
+        vm->output(vm->io_user, Pop(vm));
+        NEXT;
+      }
+
+      CASE(OP_CALL): {
+        if (vm->calltop >= CALLSTACK_MAX) {
+          fprintf(stderr, "RUNTIME ERROR: call stack overflow.\n");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        CallFrame* fr = &vm->frames[vm->calltop++];
+        fr->ret_ip = ip;
+        fr->base = vm->stack_top - in->arg;
+        ip = in->target;
+        PROFILE_CALL(in);
+        NEXT;
+      }
+
+      CASE(OP_RETURN): {
+        if (vm->calltop > 0) {
+          Value ret = Pop(vm);
+          CallFrame* fr = &vm->frames[vm->calltop - 1];
+          vm->stack_top = fr->base;
+          vm->calltop--;
+          PROFILE_RETURN();
+          PUSH(ret);
+          ip = fr->ret_ip;
+          NEXT;
+        }
+        return INTERPRET_OK;
+      }
+
+      CASE(SI_SET_LOCAL_POP): {
+        vm->frames[vm->calltop - 1].base[in->arg] = Pop(vm);
+        NEXT;
+      }
+
+#define X(name, op)                                                   \
+      CASE(SI_##name##_CONST): {                                      \
+        vm->stack_top[-1] = vm->stack_top[-1] op in->imm;               \
+        NEXT;                                                         \
+      }                                                               \
+      CASE(SI_##name##_LOCAL_CONST): {                                \
+        PUSH(vm->frames[vm->calltop - 1].base[in->arg] op in->imm);     \
+        NEXT;                                                         \
+      }                                                               \
+      CASE(SI_##name##_GLOBAL_CONST): {                               \
+        PUSH(vm->globals[in->arg] op in->imm);                         \
+        NEXT;                                                         \
+      }                                                               \
+      CASE(SI_##name##_LOCALS): {                                     \
+        Value* base = vm->frames[vm->calltop - 1].base;                 \
+        PUSH(base[in->arg] op base[in->imm]);                         \
+        NEXT;                                                         \
+      }                                                               \
+      CASE(SI_##name##_GLOBALS): {                                    \
+        PUSH(vm->globals[in->arg] op vm->globals[in->imm]);             \
+        NEXT;                                                         \
+      }
+      CCB_BINARY_OPS(X)
+#undef X
+
+#define X(name, op)                                                   \
+      CASE(SI_JUMP_UNLESS_##name): {                                  \
+        Value b = Pop(vm);                                              \
+        Value a = Pop(vm);                                              \
+        if (!(a op b)) {                                              \
+          ip = in->target;                                            \
+        }                                                             \
+        NEXT;                                                         \
+      }                                                               \
+      CASE(SI_JUMP_UNLESS_##name##_CONST): {                          \
+        if (!(Pop(vm) op in->imm)) {                                    \
+          ip = in->target;                                            \
+        }                                                             \
+        NEXT;                                                         \
+      }                                                               \
+      CASE(SI_JUMP_UNLESS_##name##_LOCAL_CONST): {                    \
+        if (!(vm->frames[vm->calltop - 1].base[in->arg] op in->imm)) {  \
+          ip = in->target;                                            \
+        }                                                             \
+        NEXT;                                                         \
+      }                                                               \
+      CASE(SI_JUMP_UNLESS_##name##_GLOBAL_CONST): {                   \
+        if (!(vm->globals[in->arg] op in->imm)) {                      \
+          ip = in->target;                                            \
+        }                                                             \
+        NEXT;                                                         \
+      }
+      CCB_COMPARE_OPS(X)
+#undef X
+#ifndef CCB_COMPUTED_GOTO
+      default:
+        printf("Unknown opcode %d\n", in->op);
+        return INTERPRET_RUNTIME_ERROR;
+    }
+  }
+#endif
+
+stack_overflow:
+  fprintf(stderr, "RUNTIME ERROR: stack overflow.\n");
+  return INTERPRET_RUNTIME_ERROR;
+
+#undef CASE
+#undef NEXT
+#undef DISPATCH
+}
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "verify.h"
+#include "io.h"
+
+typedef struct {
+  char* data;
+  size_t size;
+  char* errors;
+  size_t errors_size;
+  int status;
+} Captured;
+
+static char* ReadAll(FILE* f, size_t* size) {
+  size_t capacity = 4096;
+  char* data = (char*)malloc(capacity);
+  *size = 0;
+  size_t n;
+  while ((n = fread(data + *size, 1, capacity - *size, f)) > 0) {
+    *size += n;
+    if (*size == capacity) {
+      capacity *= 2;
+      data = realloc(data, capacity);
+    }
+  }
+  data[*size] = '\0';
+  return data;
+}
+
+// Runs one engine in a child process with the given stdin contents and
+// captures its stdout, stderr and exit status.
+static Captured RunCaptured(const char* label, VerifyEngine engine, const char* input, size_t input_size) {
+  Captured c = { NULL, 0, NULL, 0, -1 };
+  FILE* in = tmpfile();
+  FILE* out = tmpfile();
+  FILE* err = tmpfile();
+  if (in == NULL || out == NULL || err == NULL) {
+    fprintf(stderr, "%s: tmpfile: ", label);
+    perror(NULL);
+    return c;
+  }
+  fwrite(input, 1, input_size, in);
+  fflush(in);
+  rewind(in);
+
+  FlushOutput();
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    dup2(fileno(in), STDIN_FILENO);
+    dup2(fileno(out), STDOUT_FILENO);
+    dup2(fileno(err), STDERR_FILENO);
+    clearerr(stdin);
+    InterpretResult result = engine.run(engine.arg);
+    FlushOutput();
+    fflush(stdout);
+    _exit(result == INTERPRET_OK ? 0 : result == INTERPRET_COMPILE_ERROR ? 65 : 70);
+  }
+
+  int status = 0;
+  waitpid(pid, &status, 0);
+  c.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+  rewind(out);
+  c.data = ReadAll(out, &c.size);
+  rewind(err);
+  c.errors = ReadAll(err, &c.errors_size);
+  fclose(in);
+  fclose(out);
+  fclose(err);
+  return c;
+}
+
+// The stack VM stops at 256 values and 256 frames; the register VM and the
+// C backend allow deeper recursion, so their runs go on past that point.
+static int RanOutOfStack(const Captured* expected, const Captured* actual) {
+  if (expected->status != 70 || actual->status == 70 || actual->size < expected->size ||
+      memcmp(expected->data, actual->data, expected->size) != 0) {
+    return 0;
+  }
+  return strstr(expected->errors, "stack overflow.") != NULL;
+}
+
+InterpretResult VerifyEngines(const char* label, VerifyEngine expected_engine, VerifyEngine actual_engine) {
+  size_t input_size;
+  char* input = ReadAll(stdin, &input_size);
+
+  Captured expected = RunCaptured(label, expected_engine, input, input_size);
+  Captured actual = RunCaptured(label, actual_engine, input, input_size);
+  free(input);
+
+  fwrite(expected.data, 1, expected.size, stdout);
+  fflush(stdout);
+  fwrite(expected.errors, 1, expected.errors_size, stderr);
+  if (expected.status != actual.status || expected.size != actual.size) {
+    fwrite(actual.errors, 1, actual.errors_size, stderr);
+  }
+
+  int same = expected.status == actual.status && expected.size == actual.size &&
+             memcmp(expected.data, actual.data, expected.size) == 0;
+  if (same) {
+    fprintf(stderr, "%s: OK (%zu bytes of output, exit status %d)\n",
+            label, expected.size, expected.status);
+  } else if (RanOutOfStack(&expected, &actual)) {
+    fprintf(stderr, "%s: NOT COMPARED, %s ran out of stack after %zu bytes of "
+            "output that %s matches; the engines' stack limits differ\n",
+            label, expected_engine.name, expected.size, actual_engine.name);
+  } else {
+    size_t i = 0;
+    int line = 1;
+    while (i < expected.size && i < actual.size && expected.data[i] == actual.data[i]) {
+      if (expected.data[i] == '\n') {
+        line++;
+      }
+      i++;
+    }
+    fprintf(stderr, "%s: MISMATCH at output line %d "
+            "(%s: %zu bytes, exit %d; %s: %zu bytes, exit %d)\n",
+            label, line, expected_engine.name, expected.size, expected.status,
+            actual_engine.name, actual.size, actual.status);
+  }
+
+  free(expected.data);
+  free(expected.errors);
+  free(actual.data);
+  free(actual.errors);
+  if (!same) {
+    return INTERPRET_RUNTIME_ERROR;
+  }
+  return expected.status == 0 ? INTERPRET_OK :
+         expected.status == 65 ? INTERPRET_COMPILE_ERROR : INTERPRET_RUNTIME_ERROR;
+}
@@ -0,0 +1,19 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include "vm.h"
+
+// One side of a differential run: run(arg) executes the program against
+// the process's stdin and stdout.
+typedef struct {
+  const char* name;
+  InterpretResult (*run)(void* arg);
+  void* arg;
+} VerifyEngine;
+
+// Runs both engines in child processes on the same input, prints the
+// expected output and reports to stderr under label whether the output
+// and exit status agree. A mismatch is a runtime error.
+InterpretResult VerifyEngines(const char* label, VerifyEngine expected, VerifyEngine actual);
+
+#endif
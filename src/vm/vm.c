@@ -6,246 +6,217 @@
 #include "../parser/parser.h"
 #include "../codegen/codegen.h"
 
-VM vm;
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(CCB_SWITCH_DISPATCH)
+#define CCB_COMPUTED_GOTO
+#endif
+
+#ifdef CCB_COUNT_INSNS
+#define COUNT_INSN() vm->executed++
+#else
+#define COUNT_INSN() ((void)0)
+#endif
+
+#define PUSH(value)                                 \
+  do {                                              \
+    if (vm->stack_top - vm->stack >= STACK_MAX) {   \
+      goto stack_overflow;                          \
+    }                                               \
+    *vm->stack_top++ = (value);                     \
+  } while (0)
+
+static inline Value Pop(VM* vm) {
+  vm->stack_top--;
+  return *vm->stack_top;
+}
 
-static inline void Push(Value value) {
-  if (vm.stack_top - vm.stack >= STACK_MAX) {
-    fprintf(stderr, "RUNTIME ERROR: stack overflow.\n");
-    exit(1);
-  }
-  *vm.stack_top = value;
-  vm.stack_top++;
+static Value StdinInput(void* user) {
+  (void)user;
+  return ReadValue();
 }
 
-static inline Value Pop() {
-  vm.stack_top--;
-  return *vm.stack_top;
+static void StdoutOutput(void* user, Value value) {
+  (void)user;
+  WriteValue(value);
 }
 
-void InitVM() {
-  vm.stack_top = vm.stack;
-  memset(vm.globals, 0, sizeof(vm.globals));
-  vm.calltop = 0;
+VM* NewVM() {
+  VM* vm = (VM*)malloc(sizeof(VM));
+  ResetVM(vm);
+  SetVMIO(vm, NULL, NULL, NULL);
+  return vm;
 }
 
-void FreeVM() {}
-
-static InterpretResult Run() {
-  for (;;) {
-    uint8_t instruction = *vm.ip++;
-    switch (instruction) {
-      case OP_CONSTANT: {
-        uint8_t i = *vm.ip++;
-        Push(vm.chunk->constants[i]);
-        break;
-      }
-      case OP_POP: {
-        Pop();
-        break;
-      }
-      case OP_DEFINE_GLOBAL: {
-        uint8_t i = *vm.ip++;
-        vm.globals[i] = Pop();
-        break;
-      }
-      case OP_GET_GLOBAL: {
-        uint8_t i = *vm.ip++;
-        Push(vm.globals[i]);
-        break;
-      }
-      case OP_SET_GLOBAL: {
-        uint8_t i = *vm.ip++;
-        vm.globals[i] = vm.stack_top[-1];
-        break;
-      }
-
-      case OP_GET_LOCAL: {
-        uint8_t i = *vm.ip++;
-        CallFrame* fr = &vm.frames[vm.calltop - 1];
-        Push(fr->base[i]);
-        break;
-      }
-      case OP_SET_LOCAL: {
-        uint8_t i = *vm.ip++;
-        CallFrame* fr = &vm.frames[vm.calltop - 1];
-        fr->base[i] = vm.stack_top[-1];
-        break;
-      }
-
-      case OP_ADD: {
-        Value b = Pop();
-        Value a = Pop();
-        Push(a + b);
-        break;
-      }
-      case OP_SUBTRACT: {
-        Value b = Pop();
-        Value a = Pop();
-        Push(a - b);
-        break;
-      }
-      case OP_MULTIPLY: {
-        Value b = Pop();
-        Value a = Pop();
-        Push(a * b);
-        break;
-      }
-      case OP_DIVIDE: {
-        Value b = Pop();
-        Value a = Pop();
-        Push(a / b);
-        break;
-      }
-      case OP_LESS: {
-        Value b = Pop();
-        Value a = Pop();
-        Push(a < b);
-        break;
-      }
-      case OP_GREATER: {
-        Value b = Pop();
-        Value a = Pop();
-        Push(a > b);
-        break;
-      }
-      case OP_LESS_EQUAL: {
-        Value b = Pop();
-        Value a = Pop();
-        Push(a <= b);
-        break;
-      }
-      case OP_GREATER_EQUAL: {
-        Value b = Pop();
-        Value a = Pop();
-        Push(a >= b);
-        break;
-      }
-      case OP_EQUAL: {
-        Value b = Pop();
-        Value a = Pop();
-        Push(a == b);
-        break;
-      }
-      case OP_NOT_EQUAL: {
-        Value b = Pop();
-        Value a = Pop();
-        Push(a != b);
-        break;
-      }
-
-      case OP_JUMP: {
-        uint16_t offset = (uint16_t)(vm.ip[0] << 8) | vm.ip[1];
-        vm.ip += offset;
-        break;
-      }
-      case OP_JUMP_IF_FALSE: {
-        uint16_t offset = (uint16_t)(vm.ip[0] << 8) | vm.ip[1];
-        if (vm.stack_top[-1] == 0) {
-          vm.ip += offset;
-        } else {
-          vm.ip += 2;
-        }
-        Pop();
-        break;
-      }
-      case OP_LOOP: {
-        uint16_t offset = (uint16_t)(vm.ip[0] << 8) | vm.ip[1];
-        vm.ip -= offset;
-        break;
-      }
-
-      case OP_IN: {
-        uint8_t i = *vm.ip++; int val;
-        if (scanf("%d", &val) != 1) {
-          val = 0;
-          while (getchar() != '\n');
-        }
-        vm.globals[i] = val;
-        break;
-      }
-      case OP_IN_LOCAL: {
-        uint8_t i = *vm.ip++; int val;
-        if (scanf("%d", &val) != 1) {
-          val = 0;
-          while (getchar() != '\n');
-        }
-        CallFrame* fr = &vm.frames[vm.calltop - 1];
-        fr->base[i] = val;
-        break;
-      }
-      case OP_OUT: {
-        printf("%d\n", Pop());
-        break;
-      }
-
-      case OP_CALL: {
-        uint16_t offset = (uint16_t)(vm.ip[0] << 8) | vm.ip[1];
-        vm.ip += 2;
-        uint8_t argc = *vm.ip++;
-
-        if (vm.calltop >= CALLSTACK_MAX) {
-          fprintf(stderr, "RUNTIME ERROR: call stack overflow.\n");
-          return INTERPRET_RUNTIME_ERROR;
-        }
-        CallFrame* fr = &vm.frames[vm.calltop++];
-        fr->ret_ip = vm.ip;
-        fr->base = vm.stack_top - argc;
-        vm.ip = vm.chunk->code + offset;
-        break;
-      }
-
-      case OP_RETURN: {
-        if (vm.calltop > 0) {
-          Value ret = Pop();
-          CallFrame* fr = &vm.frames[vm.calltop - 1];
-          vm.stack_top = fr->base;
-          vm.calltop--;
-          Push(ret);
-          vm.ip = fr->ret_ip;
-          break;
-        }
-        return INTERPRET_OK;
-      }
-
-      default:
-        printf("Unknown opcode %d\n", instruction);
-        return INTERPRET_RUNTIME_ERROR;
-    }
-  }
+// NULL callbacks select stdin/stdout.
+void SetVMIO(VM* vm, InputFn input, OutputFn output, void* user) {
+  vm->input = input != NULL ? input : StdinInput;
+  vm->output = output != NULL ? output : StdoutOutput;
+  vm->io_user = user;
 }
 
-InterpretResult Interpret(const char* source) {
+void ResetVM(VM* vm) {
+  vm->code = NULL;
+  vm->stack_top = vm->stack;
+  memset(vm->globals, 0, sizeof(vm->globals));
+  vm->calltop = 0;
+  vm->profile = NULL;
+  vm->fn_profile = NULL;
+  vm->insn_hits = NULL;
+  vm->run_stats = NULL;
+#ifdef CCB_COUNT_INSNS
+  vm->executed = 0;
+#endif
+}
+
+void FreeVM(VM* vm) {
+  free(vm);
+}
+
+#define PROFILE_CALL(in) ((void)0)
+#define PROFILE_RETURN() ((void)0)
+
+#define RUN_FUNCTION Run
+#define PROFILE_INSN(in) ((void)0)
+#include "run.h"
+#undef RUN_FUNCTION
+#undef PROFILE_INSN
+
+#define RUN_FUNCTION RunProfiled
+#define PROFILE_INSN(in) ProfileInsn(vm->profile, (in)->op)
+#include "run.h"
+#undef RUN_FUNCTION
+#undef PROFILE_INSN
+
+#define RUN_FUNCTION RunLineProfiled
+#define PROFILE_INSN(in) (vm->insn_hits[(in) - vm->code->code]++)
+#include "run.h"
+#undef RUN_FUNCTION
+#undef PROFILE_INSN
+
+#undef PROFILE_CALL
+#undef PROFILE_RETURN
+#define RUN_FUNCTION RunCallProfiled
+#define PROFILE_INSN(in) ((void)0)
+#define PROFILE_CALL(in) ProfileCall(vm->fn_profile, (int)((in)->target - vm->code->code))
+#define PROFILE_RETURN() ProfileReturn(vm->fn_profile)
+#include "run.h"
+#undef RUN_FUNCTION
+#undef PROFILE_INSN
+#undef PROFILE_CALL
+#undef PROFILE_RETURN
+
+#define RUN_FUNCTION RunWithStats
+#define PROFILE_INSN(in) CountStats(vm->run_stats, (int)(vm->stack_top - vm->stack))
+#define PROFILE_CALL(in) CountCall(vm->run_stats, vm->calltop)
+#define PROFILE_RETURN() ((void)0)
+#include "run.h"
+#undef RUN_FUNCTION
+#undef PROFILE_INSN
+#undef PROFILE_CALL
+#undef PROFILE_RETURN
+
+// Globals survive between runs on the same VM; the stack and call frames
+// start empty every time. The decoded code is only read, so one copy can
+// be run by any number of VMs at once.
+InterpretResult RunVM(VM* vm, const DecodedChunk* code) {
+  vm->code = code;
+  vm->stack_top = vm->stack;
+  vm->calltop = 0;
+  InterpretResult result = Run(vm);
+  FlushOutput();
+  return result;
+}
+
+InterpretResult RunVMProfiled(VM* vm, const DecodedChunk* code, OpProfile* profile) {
+  vm->code = code;
+  vm->stack_top = vm->stack;
+  vm->calltop = 0;
+  vm->profile = profile;
+  InterpretResult result = RunProfiled(vm);
+  FinishOpProfile(profile);
+  vm->profile = NULL;
+  FlushOutput();
+  return result;
+}
+
+InterpretResult RunVMCallProfiled(VM* vm, const DecodedChunk* code, FnProfile* profile) {
+  vm->code = code;
+  vm->stack_top = vm->stack;
+  vm->calltop = 0;
+  vm->fn_profile = profile;
+  StartFnProfile(profile);
+  InterpretResult result = RunCallProfiled(vm);
+  FinishFnProfile(profile);
+  vm->fn_profile = NULL;
+  FlushOutput();
+  return result;
+}
+
+// hits[i] counts executions of decoded instruction i.
+InterpretResult RunVMLineProfiled(VM* vm, const DecodedChunk* code, uint64_t* hits) {
+  vm->code = code;
+  vm->stack_top = vm->stack;
+  vm->calltop = 0;
+  vm->insn_hits = hits;
+  InterpretResult result = RunLineProfiled(vm);
+  vm->insn_hits = NULL;
+  FlushOutput();
+  return result;
+}
+
+InterpretResult RunVMStats(VM* vm, const DecodedChunk* code, RunStats* stats) {
+  vm->code = code;
+  vm->stack_top = vm->stack;
+  vm->calltop = 0;
+  vm->run_stats = stats;
+  InterpretResult result = RunWithStats(vm);
+  vm->run_stats = NULL;
+  FlushOutput();
+  return result;
+}
+
+Chunk* CompileSource(const char* source) {
   Lexer* l = NewLexer(source);
   Parser* p = NewParser(l);
   Program* program = ParseProgram(p);
 
-  if (program == NULL) {
-    free(p->ns_prefix);
-    free(l);
-    free(p);
+  Chunk* chunk = NULL;
+  if (program != NULL && !p->had_error) {
+    chunk = Compile(program);
+  }
+  FreeProgram(program);
+
+  free(p->ns_prefix);
+  free(l);
+  free(p);
+  return chunk;
+}
+
+InterpretResult InterpretChunk(Chunk* chunk) {
+  DecodedChunk decoded;
+  if (!DecodeChunk(chunk, &decoded)) {
     return INTERPRET_COMPILE_ERROR;
   }
 
-  Chunk* chunk = Compile(program);
+  VM* vm = NewVM();
+  InterpretResult result = RunVM(vm, &decoded);
+#ifdef CCB_COUNT_INSNS
+  fprintf(stderr, "instructions executed: %llu\n", vm->executed);
+#endif
+
+  FreeVM(vm);
+  FreeDecoded(&decoded);
+  return result;
+}
+
+InterpretResult Interpret(const char* source) {
+  Chunk* chunk = CompileSource(source);
   if (chunk == NULL) {
-    free(p->ns_prefix);
-    free(l);
-    free(p);
     return INTERPRET_COMPILE_ERROR;
   }
 
-  InitVM();
-  vm.chunk = chunk;
-  vm.ip = chunk->code;
-
-  InterpretResult result = Run();
+  InterpretResult result = InterpretChunk(chunk);
 
   FreeChunk(chunk);
   free(chunk);
-  FreeProgram(program);
-  free(p->ns_prefix);
-  free(l);
-  free(p);
   return result;
 }
-
@@ -2,19 +2,24 @@
 #define VM_H
 
 #include "../common/bytecode.h"
+#include "decode.h"
+#include "io.h"
+#include "profile.h"
 
 #define STACK_MAX 256
 #define GLOBALS_MAX 256
 #define CALLSTACK_MAX 256
 
 typedef struct {
-  uint8_t* ret_ip;
+  const Instr* ret_ip;
   Value* base;
 } CallFrame;
 
+typedef Value (*InputFn)(void* user);
+typedef void (*OutputFn)(void* user, Value value);
+
 typedef struct {
-  Chunk* chunk;
-  uint8_t* ip;
+  const DecodedChunk* code;
 
   Value stack[STACK_MAX];
   Value* stack_top;
@@ -23,6 +28,18 @@ typedef struct {
 
   CallFrame frames[CALLSTACK_MAX];
   int calltop;
+
+  InputFn input;
+  OutputFn output;
+  void* io_user;
+
+  OpProfile* profile;
+  FnProfile* fn_profile;
+  uint64_t* insn_hits;
+  RunStats* run_stats;
+#ifdef CCB_COUNT_INSNS
+  unsigned long long executed;
+#endif
 } VM;
 
 typedef enum {
@@ -31,8 +48,19 @@ typedef enum {
   INTERPRET_RUNTIME_ERROR
 } InterpretResult;
 
-void InitVM();
-void FreeVM();
+VM* NewVM();
+void ResetVM(VM* vm);
+void FreeVM(VM* vm);
+void SetVMIO(VM* vm, InputFn input, OutputFn output, void* user);
+InterpretResult RunVM(VM* vm, const DecodedChunk* code);
+InterpretResult RunVMProfiled(VM* vm, const DecodedChunk* code, OpProfile* profile);
+InterpretResult RunVMCallProfiled(VM* vm, const DecodedChunk* code, FnProfile* profile);
+InterpretResult RunVMLineProfiled(VM* vm, const DecodedChunk* code, uint64_t* hits);
+InterpretResult RunVMStats(VM* vm, const DecodedChunk* code, RunStats* stats);
+
+// NULL after printing a syntax or codegen error.
+Chunk* CompileSource(const char* source);
+InterpretResult InterpretChunk(Chunk* chunk);
 InterpretResult Interpret(const char* source);
 
 #endif